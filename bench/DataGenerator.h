@@ -0,0 +1,279 @@
+/**
+ * @file DataGenerator.h
+ * @author Candidate 1034792
+ * @brief Declaration and definition of the DataGenerator class
+ *
+ * Shared by the benchmarks, so defined here rather than in the library.
+ */
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Generator of synthetic university data in N-Triples
+ *
+ * The DataGenerator class produces data shaped like the LUBM benchmark's:
+ * universities made of departments, each with professors, students,
+ * courses and publications linked to one another. The scale factor is the
+ * number of universities, each of which adds roughly 6000 triples, and the
+ * same scale factor and seed always give the same triples in the same
+ * order.
+ *
+ * As in WatDiv, some links are skewed rather than uniform: degrees are
+ * mostly from a few universities and popular courses are taken by more
+ * students, so that the joins over them are uneven in size.
+ *
+ * Resources are named from the `http://bench/` namespace, with the classes
+ * and properties used by the benchmark queries given by `type()` and
+ * `property()`.
+ */
+class DataGenerator {
+    public:
+        // Number of each kind of entity, per department unless noted
+        static constexpr int DEPARTMENTS = 6;     // Per university
+        static constexpr int PROFESSORS = 12;
+        static constexpr int LECTURERS = 4;
+        static constexpr int UNDERGRADUATES = 80;
+        static constexpr int GRADUATES = 20;
+        static constexpr int COURSES = 24;
+        static constexpr int GRADUATE_COURSES = 10;
+        static constexpr int RESEARCH_GROUPS = 4;
+
+        DataGenerator(int scale, unsigned seed = 1) :
+            _scale(scale), _seed(seed) {}
+
+        /**
+         * @brief Generates every triple
+         *
+         * @param emit Called with the subject, predicate and object of each
+         *      triple, in N-Triples syntax
+         */
+        void generate(const std::function<void(const std::string&,
+                                               const std::string&,
+                                               const std::string&)>& emit) {
+            std::mt19937 random(_seed);
+            auto pick = [&](int n) { return (int) (random() % n); };
+            for (int u = 0; u < _scale; u++) {
+                std::string university = entity("University", u);
+                emit(university, property("type"), type("University"));
+                emit(university, property("name"), _literal(university));
+                for (int d = 0; d < DEPARTMENTS; d++) {
+                    _department(random, pick, emit, u, d);
+                }
+            }
+        }
+
+        /**
+         * @brief Gets the URI of an entity
+         *
+         * @param kind Kind of entity, such as `Department`
+         * @param ids Numbers identifying the entity, outermost first
+         * @return std::string URI of the entity
+         */
+        static std::string entity(const std::string& kind,
+                                  std::initializer_list<int> ids) {
+            std::string uri = "<http://bench/" + kind;
+            for (int id : ids) uri += "_" + std::to_string(id);
+            return uri + ">";
+        }
+        static std::string entity(const std::string& kind, int id) {
+            return entity(kind, {id});
+        }
+        static std::string type(const std::string& name) {
+            return "<http://bench/class/" + name + ">";
+        }
+        static std::string property(const std::string& name) {
+            return "<http://bench/property/" + name + ">";
+        }
+
+        /**
+         * @brief Gets a fixed mix of queries over the generated data
+         *
+         * Covers selective lookups, stars, chains, cyclic joins and large
+         * counts, all with results at any scale factor.
+         *
+         * @return std::vector<std::pair<std::string, std::string>> Name and
+         *      command of each query
+         */
+        static std::vector<std::pair<std::string, std::string>> queries() {
+            auto p = [](const std::string& name) {
+                return " " + property(name) + " "; };
+            auto t = [](const std::string& name) {
+                return " " + property("type") + " " + type(name) + " . "; };
+            return {
+                {"student_course", "SELECT ?x WHERE { ?x" +
+                    t("GraduateStudent") + "?x" + p("takesCourse") +
+                    entity("GraduateCourse", {0, 0, 0}) + " . }"},
+                {"degree_triangle", "SELECT ?x ?y ?z WHERE { ?x" +
+                    t("GraduateStudent") + "?y" + t("University") + "?z" +
+                    t("Department") + "?x" + p("memberOf") + "?z . ?z" +
+                    p("subOrganizationOf") + "?y . ?x" +
+                    p("undergraduateDegreeFrom") + "?y . }"},
+                {"author_lookup", "SELECT ?x WHERE { ?x" + t("Publication") +
+                    "?x" + p("publicationAuthor") +
+                    entity("Faculty", {0, 0, 0}) + " . }"},
+                {"professor_star", "SELECT ?x ?n ?e WHERE { ?x" +
+                    p("worksFor") + entity("Department", {0, 0}) + " . ?x" +
+                    t("FullProfessor") + "?x" + p("name") + "?n . ?x" +
+                    p("emailAddress") + "?e . }"},
+                {"members_chain", "COUNT ?x WHERE { ?x" + p("memberOf") +
+                    "?d . ?d" + p("subOrganizationOf") +
+                    entity("University", 0) + " . }"},
+                {"type_scan", "COUNT ?x WHERE { ?x" +
+                    t("UndergraduateStudent") + "}"},
+                {"teacher_students", "SELECT ?x ?c WHERE { " +
+                    entity("Faculty", {0, 0, 0}) + p("teacherOf") +
+                    "?c . ?x" + p("takesCourse") + "?c . }"},
+                {"advisor_course", "SELECT ?x ?y ?c WHERE { ?x" +
+                    p("advisor") + "?y . ?y" + p("teacherOf") + "?c . ?x" +
+                    p("takesCourse") + "?c . }"},
+                {"department_star", "COUNT ?x ?c ?a WHERE { ?x" +
+                    p("takesCourse") + "?c . ?x" + p("advisor") + "?a . ?x" +
+                    p("memberOf") + entity("Department", {0, 0}) + " . }"},
+                {"alumni_faculty", "SELECT ?x ?y WHERE { ?x" + p("headOf") +
+                    "?d . ?d" + p("subOrganizationOf") + "?u . ?y" +
+                    p("doctoralDegreeFrom") + "?u . ?y" + p("worksFor") +
+                    "?d . }"},
+            };
+        }
+
+    private:
+        int _scale;
+        unsigned _seed;
+
+        /**
+         * @brief Helper function to get the name of an entity
+         *
+         * @param uri URI of the entity
+         * @return std::string Name of the entity, without whitespace
+         */
+        static std::string _name(const std::string& uri) {
+            return uri.substr(14, uri.size() - 15);
+        }
+        static std::string _literal(const std::string& uri) {
+            return "\"" + _name(uri) + "\"";
+        }
+
+        /**
+         * @brief Helper function to pick a university with a skew towards
+         *      the first few
+         *
+         * @param random Random number generator
+         * @return int Number of the university
+         */
+        int _skewed_university(std::mt19937& random) const {
+            double x = std::uniform_real_distribution<double>(0, 1)(random);
+            return std::min(_scale - 1, (int) (_scale * x * x * x));
+        }
+
+        /**
+         * @brief Helper function to generate the triples of one department
+         *
+         * @param random Random number generator
+         * @param pick Picks a number below its argument uniformly
+         * @param emit Called with each triple
+         * @param u Number of the department's university
+         * @param d Number of the department within its university
+         */
+        template <class Pick, class Emit>
+        void _department(std::mt19937& random, Pick& pick, Emit& emit,
+                         int u, int d) {
+            std::string department = entity("Department", {u, d});
+            emit(department, property("type"), type("Department"));
+            emit(department, property("subOrganizationOf"),
+                 entity("University", u));
+            emit(department, property("name"), _literal(department));
+            for (int g = 0; g < RESEARCH_GROUPS; g++) {
+                std::string group = entity("ResearchGroup", {u, d, g});
+                emit(group, property("type"), type("ResearchGroup"));
+                emit(group, property("subOrganizationOf"), department);
+            }
+            for (int c = 0; c < COURSES; c++) {
+                std::string course = entity("Course", {u, d, c});
+                emit(course, property("type"), type("Course"));
+                emit(course, property("name"), _literal(course));
+            }
+            for (int c = 0; c < GRADUATE_COURSES; c++) {
+                std::string course = entity("GraduateCourse", {u, d, c});
+                emit(course, property("type"), type("GraduateCourse"));
+                emit(course, property("name"), _literal(course));
+            }
+
+            // Faculty, each teaching two courses and one graduate course,
+            // with publications of their own
+            static const char* ranks[] = {"FullProfessor",
+                                          "AssociateProfessor",
+                                          "AssistantProfessor"};
+            int faculty = PROFESSORS + LECTURERS;
+            for (int f = 0; f < faculty; f++) {
+                std::string member = entity("Faculty", {u, d, f});
+                emit(member, property("type"),
+                     type(f < PROFESSORS ? ranks[f % 3] : "Lecturer"));
+                emit(member, property("worksFor"), department);
+                emit(member, property("name"), _literal(member));
+                emit(member, property("emailAddress"),
+                     "\"" + _name(member) + "@bench\"");
+                emit(member, property("doctoralDegreeFrom"),
+                     entity("University", _skewed_university(random)));
+                for (int k = 0; k < 2; k++) {
+                    emit(member, property("teacherOf"),
+                         entity("Course", {u, d, (f * 2 + k) % COURSES}));
+                }
+                emit(member, property("teacherOf"),
+                     entity("GraduateCourse", {u, d, f % GRADUATE_COURSES}));
+                if (f == 0) emit(member, property("headOf"), department);
+                int publications = f < PROFESSORS ? 3 + pick(6) : pick(2);
+                for (int p = 0; p < publications; p++) {
+                    std::string publication =
+                        entity("Publication", {u, d, f, p});
+                    emit(publication, property("type"), type("Publication"));
+                    emit(publication, property("publicationAuthor"), member);
+                }
+            }
+
+            // Students take a few courses, skewed towards the popular ones
+            auto popular = [&](int n) {
+                double x = std::uniform_real_distribution<double>(0,
+                                                                  1)(random);
+                return std::min(n - 1, (int) (n * x * x)); };
+            for (int s = 0; s < UNDERGRADUATES; s++) {
+                std::string student = entity("Undergraduate", {u, d, s});
+                emit(student, property("type"),
+                     type("UndergraduateStudent"));
+                emit(student, property("memberOf"), department);
+                emit(student, property("name"), _literal(student));
+                for (int k = 2 + pick(3); k > 0; k--) {
+                    emit(student, property("takesCourse"),
+                         entity("Course", {u, d, popular(COURSES)}));
+                }
+                if (s % 5 == 0) {
+                    emit(student, property("advisor"),
+                         entity("Faculty", {u, d, pick(PROFESSORS)}));
+                }
+            }
+            for (int s = 0; s < GRADUATES; s++) {
+                std::string student = entity("Graduate", {u, d, s});
+                emit(student, property("type"), type("GraduateStudent"));
+                emit(student, property("memberOf"), department);
+                emit(student, property("name"), _literal(student));
+                emit(student, property("undergraduateDegreeFrom"),
+                     entity("University", _skewed_university(random)));
+                emit(student, property("advisor"),
+                     entity("Faculty", {u, d, pick(PROFESSORS)}));
+                for (int k = 1 + pick(3); k > 0; k--) {
+                    emit(student, property("takesCourse"),
+                         entity("GraduateCourse",
+                                {u, d, popular(GRADUATE_COURSES)}));
+                }
+                if (s % 4 == 0) {
+                    emit(student, property("teachingAssistantOf"),
+                         entity("Course", {u, d, pick(COURSES)}));
+                }
+            }
+        }
+};
@@ -0,0 +1,212 @@
+/**
+ * @file component_bench.cpp
+ * @author Candidate 1034792
+ * @brief Microbenchmarks for the components on the load and query paths
+ *
+ * Times, over data from the DataGenerator class, the encoding of resources
+ * into the dictionary, RDFIndex::add and RDFIndex::evaluate for every
+ * pattern type on each index implementation, and Query::parse and
+ * Query::plan for the benchmark query mix. Each pattern type is probed
+ * with constants taken from random triples, so every probe has matches.
+ *
+ * Results are printed one per line as a name and a value separated by a
+ * tab, so that runs on different commits can be compared with `diff` or
+ * joined on the name. Times are the best of a few rounds.
+ *
+ * Usage: `component-bench [scale] [rounds]`, with a scale of 10 and 3
+ * rounds by default.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <DataGenerator.h>
+#include <Dictionary.h>
+#include <Query.h>
+#include <RDFIndex.h>
+#include <utils.h>
+
+// Number of probes per pattern type, fewer for types with many matches
+static const int NUM_PROBES = 20000;
+static const int NUM_SCAN_PROBES = 10;
+// Times each query is parsed and planned per round
+static const int NUM_QUERY_REPEATS = 200;
+
+/**
+ * @brief Prints one result, with no decimals if it is a whole number
+ *
+ * @param name Name of the measurement
+ * @param value Measured value
+ */
+static void report(const std::string& name, double value) {
+    std::cout << name << "\t";
+    if (value == (long long) value) std::cout << (long long) value;
+    else std::cout << std::fixed << std::setprecision(1) << value;
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Times a function over several rounds
+ *
+ * @param rounds Number of times to call the function
+ * @param f Function to time
+ * @return double Least time taken by a call, in nanoseconds
+ */
+template <class F>
+static double best_ns(int rounds, F f) {
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < rounds; r++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        f();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(
+            end - start).count());
+    }
+    return best;
+}
+
+/**
+ * @brief Encodes a resource as System::_encode_resource does, checking its
+ *      syntax before adding it to the dictionary
+ *
+ * @param dictionary Dictionary to add the resource to
+ * @param view URI or literal
+ * @return Resource ID of the resource
+ */
+static Resource encode_resource(Dictionary& dictionary,
+                                std::string_view view) {
+    size_t n = view.size();
+    if (n < 2 || !((view[0] == '<' && view[n-1] == '>') ||
+                   (view[0] == '"' && view[n-1] == '"')))
+        throw std::invalid_argument("Malformed resource");
+    return dictionary.encode(view);
+}
+
+/**
+ * @brief Benchmarks RDFIndex::add and RDFIndex::evaluate on one index
+ *      implementation
+ *
+ * @param type Name of the implementation
+ * @param triples Triples to add
+ * @param rounds Number of rounds to time
+ */
+static void measure_index(const std::string& type,
+                          const std::vector<ResourceTriple>& triples,
+                          int rounds) {
+    std::unique_ptr<RDFIndex> index;
+    double add_ns = best_ns(rounds, [&]() {
+        index = RDFIndex::create(type);
+        for (auto [s, p, o] : triples) index->add(s, p, o);
+        index->prepare_reads(); });
+    report("add." + type + ".ns_per_triple", add_ns / triples.size());
+
+    std::vector<ResourceTriple> samples;
+    std::mt19937 random(3);
+    for (int i = 0; i < NUM_PROBES; i++)
+        samples.push_back(triples[random() % triples.size()]);
+
+    // Name of each PatternType, and which of its terms are constants
+    static const char* names[] = {"XYZ", "SYZ", "XPZ", "XYO", "SPZ", "SYO",
+                                  "XPO", "SPO"};
+    static const bool constants[][3] = {
+        {false, false, false}, {true, false, false}, {false, true, false},
+        {false, false, true}, {true, true, false}, {true, false, true},
+        {false, true, true}, {true, true, true}};
+    for (int type_index = XYZ; type_index <= SPO; type_index++) {
+        const bool* fixed = constants[type_index];
+        // Patterns fixing neither subject nor object match a large share of
+        // the data, so are probed far less
+        bool scan = !fixed[0] && !fixed[2];
+        int num_probes = scan ? NUM_SCAN_PROBES : NUM_PROBES;
+        std::vector<SlotPattern> probes;
+        for (int i = 0; i < num_probes; i++) {
+            auto [s, p, o] = samples[i];
+            Resource values[] = {s, p, o};
+            SlotTerm terms[3];
+            for (int k = 0; k < 3; k++) {
+                terms[k] = fixed[k] ? SlotTerm{NO_SLOT, values[k]}
+                                    : SlotTerm{k, INVALID_RESOURCE};
+            }
+            probes.emplace_back(terms[0], terms[1], terms[2]);
+        }
+
+        long long rows = 0;
+        double ns = best_ns(rounds, [&]() {
+            Resource row[3];
+            rows = 0;
+            for (auto& [a, b, c] : probes) {
+                std::function<bool()> next = index->evaluate(a, b, c, row);
+                while (next()) rows++;
+            } });
+        std::string name = "evaluate." + type + "." + names[type_index];
+        report(name + ".ns_per_probe", ns / probes.size());
+        report(name + ".ns_per_row", ns / std::max<long long>(rows, 1));
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        std::cout << "Usage: " << argv[0] << " [scale] [rounds]"
+                  << std::endl;
+        return 1;
+    }
+    int scale = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+    int rounds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 3;
+
+    std::vector<std::string> terms;
+    DataGenerator(scale).generate([&](const std::string& s,
+                                      const std::string& p,
+                                      const std::string& o) {
+        terms.push_back(s);
+        terms.push_back(p);
+        terms.push_back(o); });
+    report("scale", scale);
+    report("triples", terms.size() / 3);
+
+    // Encoding into an empty dictionary adds each resource the first time
+    // it is seen, and finds it after that
+    std::unique_ptr<Dictionary> dictionary;
+    double encode_ns = best_ns(rounds, [&]() {
+        dictionary = std::make_unique<Dictionary>();
+        for (const std::string& term : terms)
+            encode_resource(*dictionary, term); });
+    report("encode.ns_per_resource", encode_ns / terms.size());
+    report("encode.distinct_resources", dictionary->size());
+
+    std::vector<ResourceTriple> triples;
+    for (size_t i = 0; i < terms.size(); i += 3) {
+        triples.emplace_back(dictionary->find(terms[i]),
+                             dictionary->find(terms[i+1]),
+                             dictionary->find(terms[i+2]));
+    }
+    measure_index("linked", triples, rounds);
+    measure_index("permutation", triples, rounds);
+
+    // Queries are given without their keyword, as System passes them
+    std::unique_ptr<RDFIndex> index = RDFIndex::create("linked");
+    index->add_bulk(triples, 1);
+    index->prepare_reads();
+    auto find = [&](std::string name) { return dictionary->find(name); };
+    for (auto& [name, command] : DataGenerator::queries()) {
+        std::string text = command.substr(command.find(' ') + 1);
+        double parse_ns = best_ns(rounds, [&]() {
+            for (int i = 0; i < NUM_QUERY_REPEATS; i++)
+                Query::parse(text, find); });
+        Query query = Query::parse(text, find);
+        double plan_ns = best_ns(rounds, [&]() {
+            for (int i = 0; i < NUM_QUERY_REPEATS; i++) query.plan(*index); });
+        report("parse." + name + ".us", parse_ns / NUM_QUERY_REPEATS / 1000);
+        report("plan." + name + ".us", plan_ns / NUM_QUERY_REPEATS / 1000);
+    }
+    return 0;
+}
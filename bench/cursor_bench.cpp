@@ -0,0 +1,172 @@
+/**
+ * @file cursor_bench.cpp
+ * @author Candidate 1034792
+ * @brief Microbenchmark for index cursors
+ *
+ * Compares, for each pattern type and index implementation, the rows per
+ * second produced by the type-erased RDFIndex::evaluate iterator with those
+ * produced by the implementation's own cursor. Every probe opens a fresh
+ * iterator or reopens the same cursor, as the nested loop join does.
+ */
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <LinkedIndex.h>
+#include <PermutationIndex.h>
+#include <RDFIndex.h>
+#include <utils.h>
+
+// Size of the generated data set, and default number of probes per pattern
+// type
+static const int NUM_TRIPLES = 1000000;
+static const int NUM_RESOURCES = 100000;
+static const int NUM_PREDICATES = 32;
+static const int NUM_PROBES = 20000;
+
+/**
+ * @brief Pattern to benchmark, as a function of a triple to take constants
+ *      from
+ */
+struct Case {
+    std::string name;
+    // Number of probes, fewer for patterns with many matches
+    int probes;
+    std::function<SlotPattern(ResourceTriple)> make;
+};
+
+/**
+ * @brief Times the probes of one pattern type using one iteration method
+ *
+ * @param probes Patterns to evaluate
+ * @param open Counts the matches of a pattern, writing each into a row
+ * @param rows Set to the total number of matches
+ * @return double Time taken in milliseconds
+ */
+template <class Open>
+static double time_probes(const std::vector<SlotPattern>& probes, Open open,
+                          long long& rows) {
+    Resource row[3];
+    rows = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto& [a, b, c] : probes) rows += open(a, b, c, row);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * @brief Benchmarks every pattern type on one index implementation
+ *
+ * @tparam Index Index implementation
+ * @param name Name of the implementation
+ * @param triples Triples to load
+ * @param cases Pattern types to benchmark
+ */
+template <class Index>
+static void measure(std::string name, std::vector<ResourceTriple> triples,
+                    const std::vector<Case>& cases) {
+    std::vector<ResourceTriple> samples;
+    std::mt19937 random(3);
+    for (int i = 0; i < NUM_PROBES; i++)
+        samples.push_back(triples[random() % triples.size()]);
+    Index index;
+    index.add_bulk(triples, 1);
+    typename Index::Cursor cursor(index);
+    // Builds any deferred structures before timing
+    cursor.open({0, INVALID_RESOURCE}, {1, INVALID_RESOURCE},
+                {2, INVALID_RESOURCE});
+
+    std::cout << std::endl << name << std::endl << std::left
+              << std::setw(14) << "pattern" << std::right
+              << std::setw(8) << "probes" << std::setw(12) << "rows"
+              << std::setw(16) << "evaluate Mrow/s"
+              << std::setw(16) << "cursor Mrow/s" << std::setw(10)
+              << "speedup" << std::endl;
+    for (const Case& c : cases) {
+        std::vector<SlotPattern> probes;
+        for (int i = 0; i < c.probes; i++)
+            probes.push_back(c.make(samples[i]));
+
+        long long generated, cursored;
+        double generator_ms = time_probes(probes,
+            [&](SlotTerm a, SlotTerm b, SlotTerm c, Resource* row) {
+                std::function<bool()> next = index.evaluate(a, b, c, row);
+                long long n = 0;
+                while (next()) n++;
+                return n; }, generated);
+        double cursor_ms = time_probes(probes,
+            [&](SlotTerm a, SlotTerm b, SlotTerm c, Resource* row) {
+                cursor.open(a, b, c);
+                long long n = 0;
+                while (cursor.next(row)) n++;
+                return n; }, cursored);
+        if (generated != cursored) {
+            std::cerr << "Mismatch in " << c.name << std::endl;
+            exit(1);
+        }
+        // Count each probe as at least one row, so that probes with few
+        // matches still measure the cost of opening the iterator
+        double work = std::max<long long>(generated, probes.size());
+        std::cout << std::left << std::setw(14) << c.name << std::right
+                  << std::setw(8) << probes.size()
+                  << std::setw(12) << generated << std::fixed
+                  << std::setprecision(1)
+                  << std::setw(16) << work / generator_ms / 1000
+                  << std::setw(16) << work / cursor_ms / 1000
+                  << std::setw(9) << generator_ms / cursor_ms << "x"
+                  << std::endl;
+    }
+}
+
+int main() {
+    // Random graph with a skewed predicate distribution and some triples
+    // repeating a resource, so every filter has matches
+    std::mt19937 random(1);
+    std::vector<ResourceTriple> triples;
+    for (int i = 0; i < NUM_TRIPLES; i++) {
+        Resource s = random() % NUM_RESOURCES;
+        Resource p = NUM_RESOURCES + (random() % NUM_PREDICATES)
+                                     * (random() % NUM_PREDICATES)
+                                     / NUM_PREDICATES;
+        Resource o = random() % NUM_RESOURCES;
+        if (i % 50 == 0) o = s;
+        triples.emplace_back(s, p, o);
+    }
+
+    auto var = [](Slot slot) { return SlotTerm{slot, INVALID_RESOURCE}; };
+    auto res = [](Resource r) { return SlotTerm{NO_SLOT, r}; };
+    std::vector<Case> cases = {
+        {"?x ?y ?z", 1, [&](ResourceTriple) {
+            return SlotPattern{var(0), var(1), var(2)}; }},
+        {"?x ?y ?x", 1, [&](ResourceTriple) {
+            return SlotPattern{var(0), var(1), var(0)}; }},
+        {"s ?y ?z", NUM_PROBES, [&](ResourceTriple t) {
+            return SlotPattern{res(std::get<0>(t)), var(1), var(2)}; }},
+        {"?x p ?z", 20, [&](ResourceTriple t) {
+            return SlotPattern{var(0), res(std::get<1>(t)), var(2)}; }},
+        {"?x ?y o", NUM_PROBES, [&](ResourceTriple t) {
+            return SlotPattern{var(0), var(1), res(std::get<2>(t))}; }},
+        {"s p ?z", NUM_PROBES, [&](ResourceTriple t) {
+            return SlotPattern{res(std::get<0>(t)), res(std::get<1>(t)),
+                               var(2)}; }},
+        {"s ?y o", NUM_PROBES, [&](ResourceTriple t) {
+            return SlotPattern{res(std::get<0>(t)), var(1),
+                               res(std::get<2>(t))}; }},
+        {"?x p o", NUM_PROBES, [&](ResourceTriple t) {
+            return SlotPattern{var(0), res(std::get<1>(t)),
+                               res(std::get<2>(t))}; }},
+        {"s p o", NUM_PROBES, [&](ResourceTriple t) {
+            return SlotPattern{res(std::get<0>(t)), res(std::get<1>(t)),
+                               res(std::get<2>(t))}; }},
+    };
+    std::cout << NUM_TRIPLES << " triples" << std::endl;
+    measure<LinkedIndex>("linked", triples, cases);
+    measure<PermutationIndex>("permutation", triples, cases);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file cyclic_bench.cpp
+ * @author Candidate 1034792
+ * @brief Benchmark for joins of cyclic queries
+ *
+ * Compares, for a few cyclic query shapes over a generated graph with a
+ * few hubs, the time taken to count the results of each
+ * query using pairwise nested loop joins, pairwise hash joins and the
+ * worst-case optimal generic join.
+ */
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <BatchJoin.h>
+#include <GenericJoin.h>
+#include <LinkedIndex.h>
+#include <PermutationIndex.h>
+#include <Query.h>
+#include <utils.h>
+
+// Size of the generated graph
+static const int NUM_NODES = 20000;
+static const int NUM_EDGES = 100000;
+static const int NUM_HUBS = 200;
+// Resource of the graph's only predicate
+static const Resource KNOWS = NUM_NODES;
+
+/**
+ * @brief Query to benchmark, as a list of edges between variables
+ */
+struct Case {
+    std::string name;
+    std::vector<std::pair<Variable, Variable>> edges;
+};
+
+/**
+ * @brief Times counting the results of a query with a given plan
+ *
+ * @tparam Join Join engine to use
+ * @param index Index to evaluate the query over
+ * @param compiled Compiled query
+ * @param rows Set to the number of results
+ * @return double Time taken in milliseconds
+ */
+template <class Join, class Index>
+static double time_join(Index& index, const CompiledQuery& compiled,
+                        long long& rows) {
+    rows = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    Join(index, compiled, false).run([&](const Batch& batch) {
+        rows += batch.size; });
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * @brief Benchmarks every query on one index implementation
+ *
+ * @tparam Index Index implementation
+ * @param name Name of the implementation
+ * @param triples Triples to load
+ * @param cases Queries to benchmark
+ */
+template <class Index>
+static void measure(std::string name, std::vector<ResourceTriple> triples,
+                    const std::vector<Case>& cases) {
+    Index index;
+    index.add_bulk(triples, 1);
+
+    std::cout << std::endl << name << std::endl << std::left
+              << std::setw(10) << "query" << std::right
+              << std::setw(12) << "rows" << std::setw(16) << "nested loop ms"
+              << std::setw(12) << "hash ms" << std::setw(14) << "generic ms"
+              << std::setw(10) << "speedup" << std::endl;
+    for (const Case& c : cases) {
+        std::vector<Variable> variables;
+        std::vector<TriplePattern> patterns;
+        for (auto& [x, y] : c.edges) {
+            patterns.emplace_back(Term{x}, Term{KNOWS}, Term{y});
+            for (const Variable& var : {x, y}) {
+                if (std::find(variables.begin(), variables.end(), var)
+                    == variables.end()) variables.push_back(var);
+            }
+        }
+        Query query(variables, patterns);
+        std::vector<PlanStep> plan = query.plan(index);
+
+        // Compare the generic join with pairwise joins in the same order
+        CompiledQuery generic = query.compile(plan);
+        for (PlanStep& step : plan) step.join = NESTED_LOOP;
+        CompiledQuery nested = query.compile(plan);
+        for (size_t i = 1; i < plan.size(); i++) plan[i].join = HASH_JOIN;
+        CompiledQuery hashed = query.compile(plan);
+
+        long long nested_rows, hashed_rows, generic_rows;
+        double nested_ms = time_join<BatchJoin<Index>>(index, nested,
+                                                       nested_rows);
+        double hashed_ms = time_join<BatchJoin<Index>>(index, hashed,
+                                                       hashed_rows);
+        double generic_ms = time_join<GenericJoin<Index>>(index, generic,
+                                                          generic_rows);
+        if (nested_rows != generic_rows || hashed_rows != generic_rows) {
+            std::cerr << "Mismatch in " << c.name << std::endl;
+            exit(1);
+        }
+        std::cout << std::left << std::setw(10) << c.name << std::right
+                  << std::setw(12) << generic_rows << std::fixed
+                  << std::setprecision(1) << std::setw(16) << nested_ms
+                  << std::setw(12) << hashed_ms << std::setw(14) << generic_ms
+                  << std::setw(9) << std::min(nested_ms, hashed_ms)
+                                     / generic_ms << "x" << std::endl;
+    }
+}
+
+int main() {
+    // Random graph in which a few hubs have many incoming and outgoing
+    // edges, so there are far more paths of two edges than short cycles
+    std::mt19937 random(1);
+    std::vector<ResourceTriple> triples;
+    for (int i = 0; i < NUM_EDGES; i++) {
+        Resource node = random() % NUM_NODES, hub = random() % NUM_HUBS;
+        if (i % 10 == 0) triples.emplace_back(node, KNOWS,
+                                              random() % NUM_NODES);
+        else if (i % 2 == 0) triples.emplace_back(node, KNOWS, hub);
+        else triples.emplace_back(hub, KNOWS, node);
+    }
+
+    std::vector<Case> cases = {
+        {"triangle", {{"a", "b"}, {"b", "c"}, {"c", "a"}}},
+        {"square", {{"a", "b"}, {"b", "c"}, {"c", "d"}, {"d", "a"}}},
+        {"clique", {{"a", "b"}, {"a", "c"}, {"a", "d"}, {"b", "c"},
+                    {"b", "d"}, {"c", "d"}}},
+    };
+    std::cout << NUM_EDGES << " edges between " << NUM_NODES << " nodes, "
+              << NUM_HUBS << " of them hubs" << std::endl;
+    measure<LinkedIndex>("linked", triples, cases);
+    measure<PermutationIndex>("permutation", triples, cases);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file dictionary_bench.cpp
+ * @author Candidate 1034792
+ * @brief Microbenchmark for the Dictionary class
+ *
+ * Compares the memory use and encode, lookup and decode times of the
+ * Dictionary class with those of the string vector and hash map it
+ * replaced. Resources are read from an N-Triples file given as the only
+ * argument, or generated if none is given.
+ */
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <malloc.h>
+#include <Dictionary.h>
+#include <MappedFile.h>
+#include <utils.h>
+
+// Bytes currently allocated on the heap, including allocator rounding
+static size_t heap_bytes = 0;
+
+void* operator new(size_t size) {
+    void* p = std::malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    heap_bytes += malloc_usable_size(p);
+    return p;
+}
+void operator delete(void* p) noexcept {
+    if (p != nullptr) heap_bytes -= malloc_usable_size(p);
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+/**
+ * @brief The previous dictionary: every string is held twice, once in a
+ *      vector indexed by ID and once as a key of a hash map
+ */
+struct BaselineDictionary {
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, Resource> ids;
+
+    Resource encode(std::string_view view) {
+        std::string name(view);
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        strings.push_back(name);
+        return ids[name] = strings.size()-1;
+    }
+    Resource find(std::string_view view) const {
+        auto it = ids.find(std::string(view));
+        return it == ids.end() ? INVALID_RESOURCE : it->second;
+    }
+    void decode_to(Resource id, std::string& out) const {
+        out += strings[id];
+    }
+};
+
+/**
+ * @brief Times a function
+ *
+ * @param f Function to time
+ * @return double Time taken in milliseconds
+ */
+template <class F>
+static double time_ms(F f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * @brief Measures one dictionary implementation and prints a table row
+ *
+ * @tparam D Dictionary type
+ * @param name Name of the implementation
+ * @param words Resources to encode, in order, with repeats
+ * @param order IDs in the order in which to decode them
+ */
+template <class D>
+static void measure(std::string name,
+                    const std::vector<std::string_view>& words,
+                    const std::vector<Resource>& order) {
+    size_t before = heap_bytes;
+    D* dictionary = new D();
+    long long checksum = 0;
+    double encode = time_ms([&]() {
+        for (std::string_view word : words)
+            checksum += dictionary->encode(word);
+    });
+    size_t bytes = heap_bytes - before;
+    double find = time_ms([&]() {
+        for (std::string_view word : words)
+            checksum += dictionary->find(word);
+    });
+    std::string out;
+    double decode = time_ms([&]() {
+        for (Resource id : order) {
+            out.clear();
+            dictionary->decode_to(id, out);
+            checksum += out.size();
+        }
+    });
+    delete dictionary;
+
+    std::cout << std::left << std::setw(12) << name << std::right
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << bytes / 1048576.0
+              << std::setw(12) << encode
+              << std::setw(12) << find
+              << std::setw(12) << decode
+              << "   (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    // Collect the resources of every triple, with repeats
+    std::vector<std::string_view> words;
+    std::unique_ptr<MappedFile> file;
+    std::string generated;
+    if (argc > 1) {
+        file = std::make_unique<MappedFile>(argv[1]);
+        std::string_view contents = file->contents();
+        size_t begin = 0;
+        for (size_t i = 0; i <= contents.size(); i++) {
+            if (i < contents.size() && !std::isspace((unsigned char)
+                                                     contents[i])) continue;
+            if (i > begin && contents.substr(begin, i-begin) != ".")
+                words.push_back(contents.substr(begin, i-begin));
+            begin = i+1;
+        }
+    } else {
+        // Two million triples over a few namespaces, a third with literals
+        std::mt19937 random(42);
+        std::vector<size_t> ends;
+        for (int t = 0; t < 2000000; t++) {
+            int ns = random() % 8;
+            generated += "<http://example.org/dataset" + std::to_string(ns)
+                         + "/resource/entity"
+                         + std::to_string(random() % 400000) + ">";
+            ends.push_back(generated.size());
+            generated += "<http://example.org/vocabulary#property"
+                         + std::to_string(random() % 64) + ">";
+            ends.push_back(generated.size());
+            if (t % 3 == 0)
+                generated += "\"value " + std::to_string(random() % 100000)
+                             + "\"";
+            else
+                generated += "<http://example.org/dataset"
+                             + std::to_string(random() % 8) + "/resource/entity"
+                             + std::to_string(random() % 400000) + ">";
+            ends.push_back(generated.size());
+        }
+        size_t begin = 0;
+        for (size_t end : ends) {
+            words.emplace_back(generated.data() + begin, end - begin);
+            begin = end;
+        }
+    }
+
+    // Decode distinct resources in a random order, as query results do
+    BaselineDictionary distinct;
+    for (std::string_view word : words) distinct.encode(word);
+    std::vector<Resource> order(distinct.strings.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937(7));
+    size_t total = 0;
+    for (auto& string : distinct.strings) total += string.size();
+    std::cout << words.size() << " resources, " << order.size()
+              << " distinct, " << std::fixed << std::setprecision(1)
+              << total / 1048576.0 << " MiB of distinct strings" << std::endl;
+    distinct = BaselineDictionary();
+
+    std::cout << std::left << std::setw(12) << "" << std::right
+              << std::setw(12) << "MiB" << std::setw(12) << "encode ms"
+              << std::setw(12) << "find ms" << std::setw(12) << "decode ms"
+              << std::endl;
+    measure<BaselineDictionary>("baseline", words, order);
+    measure<Dictionary>("dictionary", words, order);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file generate_data.cpp
+ * @author Candidate 1034792
+ * @brief Generator of synthetic benchmark data
+ *
+ * Writes the triples of the DataGenerator class to standard output in
+ * N-Triples, so that the same data can be loaded by the store and by
+ * other systems.
+ *
+ * Usage: `generate-data [scale] [seed]`, where the scale is the number of
+ * universities, 1 by default.
+ */
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <DataGenerator.h>
+
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        std::cout << "Usage: " << argv[0] << " [scale] [seed]" << std::endl;
+        return 1;
+    }
+    int scale = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1;
+    unsigned seed = argc > 2 ? std::atoi(argv[2]) : 1;
+
+    std::ios::sync_with_stdio(false);
+    std::string line;
+    DataGenerator(scale, seed).generate([&](const std::string& s,
+                                            const std::string& p,
+                                            const std::string& o) {
+        line.clear();
+        line += s;
+        line += ' ';
+        line += p;
+        line += ' ';
+        line += o;
+        line += " .\n";
+        std::cout << line; });
+    return 0;
+}
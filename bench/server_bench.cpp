@@ -0,0 +1,143 @@
+/**
+ * @file server_bench.cpp
+ * @author Candidate 1034792
+ * @brief Load generator for the query server
+ *
+ * Runs a number of clients against a running query server for a fixed
+ * time, each sending the commands of a file in turn over its own
+ * connection and waiting for each response before sending the next, then
+ * reports the throughput and the latency of the requests.
+ *
+ * Usage: `server-bench [address] [command_file] [clients] [seconds]`, where
+ * the command file holds one command per line.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <Server.h>
+
+/**
+ * @brief Requests sent by one client and their outcomes
+ */
+struct ClientStats {
+    // Latency of each request answered `OK` or `ERROR`, in microseconds
+    std::vector<double> latencies;
+    size_t errors = 0, busy = 0, failed = 0;
+};
+
+/**
+ * @brief Sends commands from one client until the time is up
+ *
+ * @param address Address the server listens on
+ * @param commands Commands to send, in turn starting from a given one
+ * @param first Index of the first command to send
+ * @param end Time at which to stop
+ * @param stats Set to the client's requests and their outcomes
+ */
+static void run_client(const std::string& address,
+                       const std::vector<std::string>& commands, size_t first,
+                       std::chrono::steady_clock::time_point end,
+                       ClientStats& stats) {
+    int fd = -1;
+    std::string body;
+    for (size_t i = first; std::chrono::steady_clock::now() < end; i++) {
+        if (fd < 0 && (fd = Server::connect(address)) < 0) {
+            stats.failed++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::string status = Server::request(fd, commands[i % commands.size()],
+                                             body);
+        auto finish = std::chrono::steady_clock::now();
+        if (status == "OK" || status == "ERROR") {
+            stats.latencies.push_back(std::chrono::duration<double,
+                std::micro>(finish - start).count());
+            if (status == "ERROR") stats.errors++;
+            continue;
+        }
+        // Turned away or disconnected, so back off and reconnect
+        if (status == "BUSY") stats.busy++;
+        else stats.failed++;
+        close(fd);
+        fd = -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (fd >= 0) close(fd);
+}
+
+/**
+ * @brief Gets a percentile of sorted values
+ *
+ * @param sorted Values in ascending order, not empty
+ * @param p Percentile, between 0 and 100
+ * @return double Smallest value at least `p` percent of values are at most
+ */
+static double percentile(const std::vector<double>& sorted, double p) {
+    size_t k = (size_t) (p / 100 * sorted.size());
+    return sorted[std::min(k, sorted.size() - 1)];
+}
+
+int main(int argc, char** argv) {
+    if (argc != 5) {
+        std::cout << "Usage: " << argv[0]
+                  << " [address] [command_file] [clients] [seconds]"
+                  << std::endl;
+        return 1;
+    }
+    std::string address(argv[1]);
+    std::vector<std::string> commands;
+    std::ifstream file(argv[2]);
+    for (std::string line; std::getline(file, line);)
+        if (!line.empty()) commands.push_back(line);
+    if (commands.empty()) {
+        std::cout << "No commands in " << argv[2] << std::endl;
+        return 1;
+    }
+    int clients = std::max(1, std::atoi(argv[3]));
+    double seconds = std::max(0.0, std::atof(argv[4]));
+
+    std::vector<ClientStats> stats(clients);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<
+        std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(seconds));
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back(run_client, std::cref(address),
+                             std::cref(commands), c, end, std::ref(stats[c]));
+    }
+    for (std::thread& thread : threads) thread.join();
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    size_t errors = 0, busy = 0, failed = 0;
+    for (const ClientStats& s : stats) {
+        latencies.insert(latencies.end(), s.latencies.begin(),
+                         s.latencies.end());
+        errors += s.errors;
+        busy += s.busy;
+        failed += s.failed;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::fixed << std::setprecision(1)
+              << "Requests: " << latencies.size() << " (" << errors
+              << " errors, " << busy << " turned away, " << failed
+              << " failed)" << std::endl
+              << "Throughput: " << latencies.size() / elapsed << " queries/s"
+              << std::endl;
+    if (!latencies.empty()) {
+        std::cout << "Latency: p50 " << percentile(latencies, 50) / 1000
+                  << " ms, p99 " << percentile(latencies, 99) / 1000
+                  << " ms" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file workload_bench.cpp
+ * @author Candidate 1034792
+ * @brief End-to-end benchmark of loading and querying
+ *
+ * Writes the data of the DataGenerator class to a temporary N-Triples file,
+ * loads it into a System through the `LOAD` command and then runs the
+ * DataGenerator's fixed query mix a number of times, each query through
+ * its `SELECT` or `COUNT` command with the results decoded as for the
+ * command line. Reports the load throughput, the latency percentiles of
+ * each query and of the mix as a whole, and the peak resident set size.
+ *
+ * Results are printed one per line as a name and a value separated by a
+ * tab, so that runs on different commits can be compared with `diff` or
+ * joined on the name. The number of results of each query is printed too,
+ * so that a change in the results is not mistaken for a change in speed.
+ *
+ * Usage: `workload-bench [scale] [index_type] [threads] [repetitions]`,
+ * with a scale of 20, the linked index, one thread and 20 repetitions by
+ * default.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <DataGenerator.h>
+#include <System.h>
+#include <utils.h>
+
+/**
+ * @brief Prints one result, with no decimals if it is a whole number
+ *
+ * @param name Name of the measurement
+ * @param value Measured value
+ */
+static void report(const std::string& name, double value) {
+    std::cout << name << "\t";
+    if (value == (long long) value) std::cout << (long long) value;
+    else std::cout << std::fixed << std::setprecision(3) << value;
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Gets a percentile of sorted values
+ *
+ * @param sorted Values in ascending order, not empty
+ * @param p Percentile, between 0 and 100
+ * @return double Smallest value at least `p` percent of values are at most
+ */
+static double percentile(const std::vector<double>& sorted, double p) {
+    size_t k = (size_t) (p / 100 * sorted.size());
+    return sorted[std::min(k, sorted.size() - 1)];
+}
+
+/**
+ * @brief Prints the percentiles of a set of latencies
+ *
+ * @param name Name of the set
+ * @param latencies Latencies in milliseconds, not empty
+ */
+static void report_latencies(const std::string& name,
+                             std::vector<double> latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    report(name + ".p50_ms", percentile(latencies, 50));
+    report(name + ".p90_ms", percentile(latencies, 90));
+    report(name + ".p99_ms", percentile(latencies, 99));
+    report(name + ".max_ms", latencies.back());
+}
+
+/**
+ * @brief Gets the peak resident set size of the process so far
+ *
+ * @return double Peak resident set size in megabytes
+ */
+static double peak_rss_mb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+/**
+ * @brief Gets the number of results a query reports
+ *
+ * @param output Output of the query's command
+ * @return double Number of results, or -1 if none is reported
+ */
+static double results_of(const std::string& output) {
+    size_t end = output.rfind(" results returned");
+    if (end == std::string::npos) return -1;
+    size_t begin = output.find_last_of('\n', end);
+    begin = begin == std::string::npos ? 0 : begin + 1;
+    return std::atof(output.substr(begin, end - begin).c_str());
+}
+
+int main(int argc, char** argv) {
+    if (argc > 5) {
+        std::cout << "Usage: " << argv[0]
+                  << " [scale] [index_type] [threads] [repetitions]"
+                  << std::endl;
+        return 1;
+    }
+    int scale = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+    std::string index_type = argc > 2 ? argv[2] : "linked";
+    int threads = argc > 3 ? std::max(1, std::atoi(argv[3])) : 1;
+    int repetitions = argc > 4 ? std::max(1, std::atoi(argv[4])) : 20;
+
+    // Written straight to the file, so the data is never held in memory
+    char path[] = "/tmp/workload-benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cerr << "Could not create a temporary file" << std::endl;
+        return 1;
+    }
+    close(fd);
+    size_t triples = 0;
+    {
+        std::ofstream file(path);
+        DataGenerator(scale).generate([&](const std::string& s,
+                                          const std::string& p,
+                                          const std::string& o) {
+            file << s << ' ' << p << ' ' << o << " .\n";
+            triples++; });
+    }
+    report("scale", scale);
+    report("threads", threads);
+    report("triples", triples);
+
+    System system(index_type, threads);
+    std::ostringstream out;
+    try {
+        auto start = std::chrono::steady_clock::now();
+        system.execute(Command::LOAD, path, out, false, NO_DEADLINE);
+        double load_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        report("load.ms", load_ms);
+        report("load.triples_per_s", triples / load_ms * 1000);
+        report("load.peak_rss_mb", peak_rss_mb());
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::remove(path);
+        return 1;
+    }
+    std::remove(path);
+
+    // The first run of each query plans it, and later runs reuse the plan
+    auto queries = DataGenerator::queries();
+    std::vector<std::vector<double>> latencies(queries.size());
+    std::vector<double> results(queries.size());
+    std::vector<double> all;
+    for (int r = 0; r < repetitions; r++) {
+        for (size_t q = 0; q < queries.size(); q++) {
+            const std::string& command = queries[q].second;
+            size_t space = command.find(' ');
+            out.str("");
+            auto start = std::chrono::steady_clock::now();
+            try {
+                system.execute(which_command.at(command.substr(0, space)),
+                               command.substr(space + 1), out, false,
+                               NO_DEADLINE);
+            } catch (const std::exception& e) {
+                std::cerr << "Error in " << queries[q].first << ": "
+                          << e.what() << std::endl;
+                return 1;
+            }
+            double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            latencies[q].push_back(ms);
+            all.push_back(ms);
+            results[q] = results_of(out.str());
+        }
+    }
+    for (size_t q = 0; q < queries.size(); q++) {
+        std::string name = "query." + queries[q].first;
+        report(name + ".results", results[q]);
+        report_latencies(name, latencies[q]);
+    }
+    report_latencies("mix", all);
+    report("peak_rss_mb", peak_rss_mb());
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file Arena.h
+ * @author Candidate 1034792
+ * @brief Declaration and implementation of the Arena class template
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <sys/mman.h>
+
+/**
+ * @brief Contiguous, append-only storage for trivially copyable elements
+ *
+ * Reserves a range of virtual address space for the expected number of
+ * elements and commits physical pages to it in chunks as elements are
+ * appended. Once the range is full, a range of twice the size is reserved
+ * and the committed pages are remapped into it, so elements are never
+ * copied and indices remain stable, though addresses only do so until the
+ * arena next grows. Destruction is a single unmap.
+ *
+ * @tparam T Element type, must be trivially copyable
+ */
+template <class T>
+class Arena {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Arena elements must be trivially copyable");
+
+    public:
+        /**
+         * @brief Reserves address space for an expected number of elements
+         *
+         * No physical memory is used until elements are appended.
+         *
+         * @param capacity Number of elements to reserve space for; the
+         *      arena grows beyond it as needed
+         */
+        explicit Arena(size_t capacity = 0) :
+                _data(nullptr), _size(0), _reserved(0), _committed(0) {
+            _reserve(_round_up(std::max<size_t>(capacity, 1) * sizeof(T)));
+        }
+        ~Arena() { munmap(_data, _reserved); }
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /**
+         * @brief Appends an element, committing more memory if necessary
+         *
+         * @param value Element to append
+         * @return size_t Index of the new element
+         */
+        size_t push_back(const T& value) {
+            size_t needed = (_size + 1) * sizeof(T);
+            if (needed > _committed) _commit(needed);
+            _data[_size] = value;
+            return _size++;
+        }
+
+        /**
+         * @brief Makes space for a number of elements without growing again
+         *
+         * @param capacity Number of elements to make space for
+         */
+        void reserve(size_t capacity) {
+            size_t bytes = _round_up(capacity * sizeof(T));
+            if (bytes > _reserved) _reserve(bytes);
+        }
+
+        /**
+         * @brief Removes all elements, keeping the memory committed for reuse
+         */
+        void clear() { _size = 0; }
+
+        T& operator[](size_t i) { return _data[i]; }
+        const T& operator[](size_t i) const { return _data[i]; }
+        T* data() { return _data; }
+        size_t size() const { return _size; }
+        // Number of elements that fit without moving the arena
+        size_t capacity() const { return _reserved / sizeof(T); }
+        bool empty() const { return _size == 0; }
+        // Bytes of physical memory committed to the arena so far
+        size_t committed_bytes() const { return _committed; }
+
+    private:
+        // Granularity in which physical memory is committed
+        static constexpr size_t _CHUNK_BYTES = 1 << 21;
+
+        T* _data;
+        size_t _size;
+        size_t _reserved, _committed;
+
+        static size_t _round_up(size_t bytes) {
+            return (bytes + _CHUNK_BYTES - 1) / _CHUNK_BYTES * _CHUNK_BYTES;
+        }
+        void _commit(size_t bytes) {
+            size_t target = _round_up(bytes);
+            if (target > _reserved) _reserve(std::max(target, 2 * _reserved));
+            if (mprotect(reinterpret_cast<char*>(_data) + _committed,
+                         target - _committed, PROT_READ | PROT_WRITE) != 0)
+                throw std::bad_alloc();
+            _committed = target;
+        }
+        /**
+         * @brief Helper function to move the arena into a larger range of
+         *      address space, remapping the committed pages without copying
+         *
+         * @param bytes Size of the new range, a multiple of the chunk size
+         */
+        void _reserve(size_t bytes) {
+            void* base = mmap(nullptr, bytes, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                              -1, 0);
+            if (base == MAP_FAILED) throw std::bad_alloc();
+            if (_committed > 0 &&
+                mremap(_data, _committed, _committed,
+                       MREMAP_MAYMOVE | MREMAP_FIXED, base) == MAP_FAILED) {
+                munmap(base, bytes);
+                throw std::bad_alloc();
+            }
+            if (_data != nullptr) {
+                munmap(reinterpret_cast<char*>(_data) + _committed,
+                       _reserved - _committed);
+            }
+            _data = static_cast<T*>(base);
+            _reserved = bytes;
+        }
+};
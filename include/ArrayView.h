@@ -0,0 +1,143 @@
+/**
+ * @file ArrayView.h
+ * @author Candidate 1034792
+ * @brief Declaration and implementation of the ArrayView class template
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Read-only view of a contiguous array owned elsewhere
+ *
+ * Lets the same code read arrays held in a `std::vector` or mapped directly
+ * from a file.
+ *
+ * @tparam T Element type
+ */
+template <class T>
+class ArrayView {
+    public:
+        ArrayView() : _data(nullptr), _size(0) {}
+        ArrayView(const T* data, size_t size) : _data(data), _size(size) {}
+        ArrayView(const std::vector<T>& v) : _data(v.data()), _size(v.size()) {}
+
+        const T& operator[](size_t i) const { return _data[i]; }
+        const T* begin() const { return _data; }
+        const T* end() const { return _data + _size; }
+        const T* data() const { return _data; }
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+    private:
+        const T* _data;
+        size_t _size;
+};
+
+/**
+ * @brief Array held either in memory or in a mapped file
+ *
+ * Reads go to whichever holds the array. The array is copied into memory
+ * the first time it is modified.
+ *
+ * Copies of an array share its storage in memory, each reading only its
+ * own elements. Appending to an array that ends where its storage does
+ * writes past the end of every other copy, so needs no copy, and storage
+ * shared with other copies is replaced by a larger copy rather than
+ * reallocated, so addresses they read stay valid. Elements are otherwise
+ * only changed in place by MappableArray::store; MappableArray::modify
+ * first copies storage that is shared.
+ *
+ * @tparam T Element type, must be trivially copyable
+ */
+template <class T>
+class MappableArray {
+    public:
+        MappableArray() : _data(nullptr), _size(0), _is_mapped(false) {}
+
+        const T& operator[](size_t i) const { return _data[i]; }
+        size_t size() const { return _size; }
+        ArrayView<T> view() const { return ArrayView<T>(_data, _size); }
+        // Bytes allocated in memory, and used in place from a mapped file
+        size_t memory_usage() const {
+            return _owned ? _owned->capacity() * sizeof(T) : 0; }
+        size_t mapped_bytes() const {
+            return _is_mapped ? _size * sizeof(T) : 0; }
+
+        /**
+         * @brief Uses an array within a mapped file, discarding the contents
+         */
+        void map(ArrayView<T> mapped) {
+            _owned.reset();
+            _data = mapped.data();
+            _size = mapped.size();
+            _is_mapped = true;
+        }
+        /**
+         * @brief Replaces the contents with storage of their own
+         */
+        void assign(std::vector<T> values) {
+            _owned = std::make_shared<std::vector<T>>(std::move(values));
+            _data = _owned->data();
+            _size = _owned->size();
+            _is_mapped = false;
+        }
+        /**
+         * @brief Appends value-initialised elements
+         *
+         * @param n Number of elements to append
+         * @return T* First of the new elements, for filling in
+         */
+        T* extend(size_t n) {
+            bool shared = _owned.use_count() > 1;
+            if (!_owned || _owned->size() != _size ||
+                (shared && _size + n > _owned->capacity())) {
+                auto storage = std::make_shared<std::vector<T>>();
+                storage->reserve(2 * (_size + n));
+                storage->assign(_data, _data + _size);
+                _owned = std::move(storage);
+                _is_mapped = false;
+            }
+            _owned->resize(_size + n);
+            _data = _owned->data();
+            _size += n;
+            return _owned->data() + _size - n;
+        }
+        void push_back(const T& value) { *extend(1) = value; }
+        void append(const T* first, const T* last) {
+            std::copy(first, last, extend(last - first)); }
+        /**
+         * @brief Gets the elements for modification, copying them if their
+         *      storage is shared or mapped
+         */
+        T* modify() {
+            if (_owned.use_count() != 1 || _owned->size() != _size)
+                assign(std::vector<T>(_data, _data + _size));
+            return _owned->data();
+        }
+        /**
+         * @brief Sets an element in place, even in storage shared with other
+         *      copies of the array
+         *
+         * Other copies may be reading the element concurrently, so must
+         * ignore the values stored and read it with MappableArray::load.
+         *
+         * @param i Position of the element
+         * @param value New value, of an integer type
+         */
+        void store(size_t i, T value) {
+            if (_is_mapped) modify();
+            __atomic_store_n(_owned->data() + i, value, __ATOMIC_RELAXED);
+        }
+        T load(size_t i) const {
+            return __atomic_load_n(_data + i, __ATOMIC_RELAXED); }
+
+    private:
+        // Storage in memory, unless mapped, and the elements read
+        std::shared_ptr<std::vector<T>> _owned;
+        const T* _data;
+        size_t _size;
+        bool _is_mapped;
+};
@@ -0,0 +1,182 @@
+/**
+ * @file BatchJoin.h
+ * @author Candidate 1034792
+ * @brief Declaration of the BatchJoin class
+ */
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <PerfCounters.h>
+#include <Query.h>
+#include <utils.h>
+
+// Maximum number of rows in a batch of bindings
+const size_t BATCH_SIZE = 1024;
+
+/**
+ * @brief A batch of rows of bindings, stored by column
+ *
+ * Only the columns of slots in use at a given point of a join are allocated;
+ * the rest are empty.
+ */
+struct Batch {
+    // Bindings of each slot, one per row
+    std::vector<std::vector<Resource>> columns;
+    // Number of rows
+    size_t size = 0;
+};
+
+/**
+ * @brief Work done by one stage of a BatchJoin
+ */
+struct StageProfile {
+    // Cursors opened on the index, and the matches read from them
+    size_t probes = 0, matches = 0;
+    // Matches rejected by the checks for variables repeated in the pattern
+    size_t rejected = 0;
+    // Time spent in the stage, not counting the stages it passes rows on
+    // to, and the hardware events counted meanwhile; only kept while
+    // profiling
+    std::chrono::steady_clock::duration time{0};
+    uint64_t events[PerfCounters::EVENTS] = {};
+};
+
+/**
+ * @brief Batch-at-a-time evaluation of a compiled query
+ *
+ * The BatchJoin class performs the joins of a query's patterns in a
+ * pipeline of stages, one per pattern. Each stage takes a batch of bindings
+ * from the previous stage, extends every row of it with the matching rows
+ * of its pattern, and collects the extended rows into a batch of its own,
+ * passing it on once full. Checks for variables repeated within a pattern
+ * run over whole columns of matches, and only the slots needed by later
+ * stages are carried along.
+ *
+ * Each stage joins using the operator the query's plan chose for it:
+ *  - a nested loop join probes the index with the row's bindings
+ *  - a hash join reads the pattern's matches into a hash table, keyed on
+ *          the variables bound earlier, on the first row and probes it
+ *  - a merge join steps through the pattern's matches, sorted on the one
+ *          variable bound earlier, as the rows arrive sorted on it
+ *
+ * Every operator keeps the order of the rows it extends.
+ *
+ * The work of each stage is counted as it runs. When profiling, the time
+ * and hardware events are also charged to the stage running whenever the
+ * join passes a batch from one stage to another, which costs a few
+ * system calls per batch.
+ *
+ * Besides running the whole pipeline, the matches of the first pattern can
+ * be read out and slices of them run through the later stages separately.
+ * Copies of a BatchJoin share its hash tables once built, so that several
+ * threads can each run slices with a copy of their own.
+ *
+ * Defined for the LinkedIndex and PermutationIndex classes, the cursors of
+ * which are used directly.
+ *
+ * Member function documentation provided in implementation file
+ * `k_batch_join.cpp`.
+ */
+template <class Index>
+class BatchJoin {
+    public:
+        BatchJoin(Index&, const CompiledQuery&, bool);
+        void run(const std::function<void(const Batch&)>&);
+        void scan(Batch&);
+        void prepare();
+        void run(const Batch&, size_t, size_t,
+                 const std::function<void(const Batch&)>&);
+        const std::vector<size_t>& produced() const;
+        void profile(const PerfCounters*);
+        const std::vector<StageProfile>& profiles() const {
+            return _profiles;
+        }
+        void set_deadline(Deadline deadline) { _deadline = deadline; }
+
+    private:
+        using _Cursor = typename Index::Cursor;
+        // End of a chain of rows in a hash table
+        static constexpr uint32_t _NO_ENTRY = UINT32_MAX;
+
+        // Matches of a pattern, chained by the hash of their key
+        struct _HashTable {
+            Batch rows;
+            // First row of each bucket, and next row of each row's chain
+            std::vector<uint32_t> buckets, chain;
+        };
+
+        // Evaluation of one pattern
+        struct _Stage {
+            _Cursor cursor;
+            JoinMethod join;
+            // Pattern, with any repeated variable given a spare slot at each
+            // occurrence after its first. For hash and merge joins, variables
+            // bound by earlier stages are given spare slots too.
+            SlotPattern pattern;
+            // Whether each slot of the pattern is substituted by the binding
+            // of earlier stages (for nested loop joins only)
+            bool bound[3];
+            // Pairs of slots a match must have equal bindings for
+            std::vector<std::pair<Slot, Slot>> equal;
+            // Slots bound by earlier stages and still needed afterwards
+            std::vector<Slot> carried;
+            // Slots bound by this stage
+            std::vector<Slot> written;
+            // Slots bound by earlier stages, and the spare slots of the
+            // pattern their bindings are matched against
+            std::vector<std::pair<Slot, Slot>> keys;
+            // Slots written by the cursor, and where it writes the next
+            // match
+            std::vector<Slot> read;
+            std::vector<Resource*> targets;
+            // Rows produced
+            Batch out;
+            // For hash joins, the hash table once built, which is never
+            // modified afterwards
+            std::shared_ptr<const _HashTable> table;
+            // For merge joins, the matches read ahead, and whether the merge
+            // has started
+            Batch inner;
+            bool ready = false;
+            // For merge joins, position of the next match read ahead,
+            // whether the cursor is exhausted, and the matches with the
+            // current key
+            size_t ahead = 0;
+            bool exhausted = false;
+            Batch group;
+            Resource group_key = INVALID_RESOURCE;
+        };
+
+        std::vector<_Stage> _stages;
+        // Number of rows produced by each stage
+        std::vector<size_t> _produced;
+        // Positions of rows passing a check, within a run of matches
+        std::vector<uint32_t> _selection;
+        const std::function<void(const Batch&)>* _sink;
+        // Time by which evaluation must finish, checked before each batch
+        Deadline _deadline = NO_DEADLINE;
+        // Work done by each stage, and by the output after the last
+        std::vector<StageProfile> _profiles;
+        // Whether time and events are being charged to stages, the
+        // counters to read them from if any, the stage being charged, and
+        // the time and events when it last changed
+        bool _profiling = false;
+        const PerfCounters* _counters = nullptr;
+        size_t _current = 0;
+        std::chrono::steady_clock::time_point _last;
+        uint64_t _last_events[PerfCounters::EVENTS] = {};
+
+        void _push(size_t, const Batch&);
+        size_t _charge(size_t);
+        void _finish(size_t);
+        bool _read(_Stage&, Batch&, size_t);
+        void _read_all(_Stage&, Batch&);
+        void _emit(size_t, const Batch&, size_t, const Batch&, size_t);
+        void _probe(size_t, const Batch&, size_t);
+        void _probe_hash(size_t, const Batch&, size_t);
+        void _probe_merge(size_t, const Batch&, size_t);
+        void _build_hash(_Stage&);
+};
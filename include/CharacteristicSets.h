@@ -0,0 +1,82 @@
+/**
+ * @file CharacteristicSets.h
+ * @author Candidate 1034792
+ * @brief Declaration of the CharacteristicSets class
+ */
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <PagedArray.h>
+#include <Snapshot.h>
+#include <utils.h>
+
+/**
+ * @brief Characteristic sets of the subjects of a set of triples
+ *
+ * The characteristic set of a subject is the set of predicates of its
+ * triples. For each distinct characteristic set, the CharacteristicSets
+ * class keeps the number of subjects having it and the total number of
+ * their triples with each of its predicates. Since predicates of the same
+ * subject are often correlated, these estimate the size of subject stars
+ * far better than statistics of each predicate alone.
+ *
+ * Subjects can be added in bulk, or their triples added one at a time.
+ * Copies share the pages of the per-subject array until they write to
+ * them, so copying costs in proportion to the distinct sets only. Snapshots
+ * hold the distinct sets but not the set of each subject.
+ *
+ * Member function documentation provided in implementation file
+ * `m_characteristic_sets.cpp`.
+ */
+class CharacteristicSets {
+    public:
+        // Number of triples of a subject with each predicate, sorted by
+        // predicate
+        using Counts = std::vector<std::pair<Resource, size_t>>;
+
+        void clear();
+        void add_subject(Resource, const Counts&);
+        void add(Resource, Resource);
+        void extend(Resource, Resource, const Counts&);
+        const std::vector<Resource>& predicates(Resource) const;
+        double estimate_star(const std::vector<Resource>&) const;
+        size_t size() const { return _sets.size(); }
+        size_t memory_usage() const;
+        void save(SnapshotWriter&) const;
+        void open(const Snapshot&);
+
+    private:
+        // Identifier of a characteristic set
+        using _SetId = uint32_t;
+        static constexpr _SetId _NO_SET = UINT32_MAX;
+
+        // One distinct characteristic set
+        struct _Set {
+            // Predicates in the set, in ascending order
+            std::vector<Resource> predicates;
+            // Number of subjects with exactly these predicates
+            size_t subjects;
+            // Total number of triples of these subjects with each predicate
+            std::vector<size_t> triples;
+        };
+
+        // Hash function for sets of predicates
+        struct _Hash {
+            size_t operator()(const std::vector<Resource>& predicates) const {
+                size_t seed = 0;
+                for (Resource p : predicates) _hash_combine(seed, p);
+                return seed;
+            }
+        };
+
+        std::vector<_Set> _sets;
+        // Identifier of each set of predicates
+        std::unordered_map<std::vector<Resource>, _SetId, _Hash> _ids;
+        // Set of each subject, indexed by subject resource
+        PagedArray<_SetId> _subject_sets;
+
+        _SetId _find(const std::vector<Resource>&);
+        void _update(_SetId, const Counts&, int);
+};
@@ -0,0 +1,121 @@
+/**
+ * @file CountJoin.h
+ * @author Candidate 1034792
+ * @brief Declaration of the CountJoin class
+ */
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <BatchJoin.h>
+#include <Query.h>
+#include <ThreadPool.h>
+#include <utils.h>
+
+/**
+ * @brief Counting the results of a compiled query without enumerating them
+ *
+ * The CountJoin class counts the rows a join of a query's patterns would
+ * produce. Patterns are split into components, connected through variables
+ * not yet bound, whose counts are multiplied. Within a component, the
+ * first pattern in plan order has its matches enumerated, binding its
+ * variables and splitting the rest of the component into smaller ones,
+ * and a component of a single pattern is counted by the index from its
+ * list lengths. The count of a component depends only on the bindings of
+ * its variables bound outside it, so is kept for each distinct binding
+ * and reused. Star and tree queries are thus counted in time near the
+ * number of matches of their patterns rather than the number of results.
+ *
+ * The split of patterns into components depends only on the query, so is
+ * worked out once, as a tree of components.
+ *
+ * Given a pool of several threads, the matches of the first pattern of
+ * each component of more than one pattern, before binding any variables,
+ * are read and split into morsels, which the threads count the rest of the
+ * component for as tasks of one job. Each thread counts with a CountJoin
+ * of its own, so keeps counts for reuse only within its own morsels.
+ *
+ * The cursors opened and the counts taken from the index for each pattern
+ * are counted as its probes, and the matches enumerated and counts taken
+ * as its matches, like the stages of a BatchJoin; time is not charged to
+ * patterns.
+ *
+ * Defined for the LinkedIndex and PermutationIndex classes, the cursors of
+ * which are used directly.
+ *
+ * Member function documentation provided in implementation file
+ * `q_count_join.cpp`.
+ */
+template <class Index>
+class CountJoin {
+    public:
+        CountJoin(Index&, const CompiledQuery&, ThreadPool* = nullptr);
+        size_t run();
+        const std::vector<StageProfile>& profiles() const {
+            return _profiles;
+        }
+        void set_deadline(Deadline deadline) { _deadline = deadline; }
+
+    private:
+        using _Cursor = typename Index::Cursor;
+
+        // Number of matches enumerated between checks of the deadline
+        static constexpr size_t _CHECK_INTERVAL = 1024;
+        // Most counts kept per component
+        static constexpr size_t _MAX_KEPT = 1 << 20;
+        // Number of morsels to aim for per thread
+        static constexpr size_t _MORSELS_PER_THREAD = 16;
+
+        // Hash function for bindings of several variables
+        struct _Hash {
+            size_t operator()(const std::vector<Resource>& values) const {
+                size_t seed = 0;
+                for (Resource value : values) _hash_combine(seed, value);
+                return seed;
+            }
+        };
+
+        // Set of patterns connected through variables not bound outside it
+        struct _Component {
+            // First pattern of the set in plan order, and its position in
+            // the query, with the variables bound outside the set marked as
+            // such
+            SlotPattern pattern;
+            size_t position;
+            bool bound[3];
+            // Variables of the set bound outside it
+            std::vector<Slot> inputs;
+            // Components the rest of the set splits into once the
+            // pattern's variables are bound; none if the set is just the
+            // pattern
+            std::vector<size_t> parts;
+            // Cursor over the pattern's matches
+            _Cursor cursor;
+            // Count for each binding of the inputs seen so far, and the
+            // binding being looked up
+            std::unordered_map<std::vector<Resource>, size_t, _Hash> counts;
+            std::vector<Resource> key;
+        };
+
+        Index* _index;
+        const CompiledQuery* _query;
+        // Pool of threads to count on, if any
+        ThreadPool* _pool;
+        std::vector<_Component> _components;
+        // Components all patterns split into, before binding any variables
+        std::vector<size_t> _roots;
+        // Bindings of the variables bound so far, indexed by slot
+        std::vector<Resource> _row;
+        // Probes and matches of each pattern
+        std::vector<StageProfile> _profiles;
+        // Time by which evaluation must finish, and the matches enumerated
+        // since it was last checked
+        Deadline _deadline = NO_DEADLINE;
+        size_t _steps = 0;
+
+        std::vector<size_t> _split(const std::vector<size_t>&,
+                                   const std::vector<bool>&);
+        size_t _count(size_t);
+        size_t _count_parallel(size_t);
+        size_t _count_parts(size_t);
+        SlotPattern _substitute(const _Component&) const;
+};
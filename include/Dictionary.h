@@ -0,0 +1,94 @@
+/**
+ * @file Dictionary.h
+ * @author Candidate 1034792
+ * @brief Declaration of the Dictionary class
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ArrayView.h>
+#include <MappedFile.h>
+#include <Snapshot.h>
+#include <utils.h>
+
+/**
+ * @brief Compact two-way mapping between resource URIs and integer IDs
+ *
+ * Each string is split into a prefix (up to its last `/` or `#`, typically a
+ * namespace) and a suffix. Prefixes are stored once each in a prefix table,
+ * and each string is stored once, as its prefix's number and its suffix,
+ * in a single byte arena. IDs are numbered consecutively from 0 and decoded
+ * through an array of arena offsets. Strings are encoded through
+ * open-addressing hash tables holding only IDs, split into shards by hash so
+ * that they can be filled in parallel.
+ *
+ * All of the above are flat arrays, so the dictionary can be used in place
+ * from a snapshot.
+ *
+ * Copies of the dictionary share its arrays, so that copying it takes
+ * constant time. Strings and prefixes are only ever appended, and each copy
+ * reads only the IDs below its own size. Hash table slots are set in place
+ * and read atomically, and copies skip slots holding IDs they lack, so
+ * adding strings to the latest copy leaves earlier copies unchanged even
+ * while they are read. A copy that is not the latest to have added strings
+ * first takes arrays of its own.
+ *
+ * Member function documentation provided in implementation file
+ * `j_dictionary.cpp`.
+ */
+class Dictionary {
+    public:
+        // Number of shards of the string-to-ID hash table
+        static constexpr size_t SHARDS = 64;
+
+        Dictionary();
+        Resource find(std::string_view) const;
+        Resource encode(std::string_view);
+        void insert_all(const std::vector<std::string_view>&, int);
+        std::string decode(Resource) const;
+        void decode_to(Resource, std::string&) const;
+        size_t size() const { return _entry_offsets.size() - 1; }
+        size_t memory_usage() const;
+        void report_memory(std::vector<MemoryUsage>&) const;
+        void save(SnapshotWriter&) const;
+        void open(const Snapshot&, bool);
+        static size_t shard_of(std::string_view);
+
+    private:
+        // Prefix table: prefixes are concatenated, with prefix k occupying
+        // _prefixes[_prefix_offsets[k]] up to _prefixes[_prefix_offsets[k+1]]
+        MappableArray<char> _prefixes;
+        MappableArray<uint64_t> _prefix_offsets;
+        // Open-addressing table from prefix to prefix number plus one
+        MappableArray<uint32_t> _prefix_slots;
+        // Byte arena holding, for each ID, its prefix number and suffix
+        // length as variable-length integers followed by its suffix
+        MappableArray<char> _entries;
+        MappableArray<uint64_t> _entry_offsets;
+        // Open-addressing tables from string to ID plus one, one per shard,
+        // and the number of IDs in each
+        MappableArray<uint32_t> _slots[SHARDS];
+        MappableArray<uint32_t> _shard_sizes;
+        // Snapshot file the arrays are mapped from, if any
+        std::shared_ptr<MappedFile> _mapping;
+        // Size of the latest of the copies sharing the arrays to add strings
+        std::shared_ptr<size_t> _head;
+
+        void _detach();
+        Resource _find(std::string_view, uint64_t) const;
+        std::string_view _prefix(uint32_t) const;
+        uint32_t _find_prefix(std::string_view) const;
+        uint32_t _add_prefix(std::string_view);
+        void _read_entry(Resource, uint32_t&, std::string_view&) const;
+        bool _equals(Resource, std::string_view) const;
+        void _insert_slot(size_t, uint64_t, Resource);
+        void _grow_shard(size_t, size_t);
+        static size_t _prefix_length(std::string_view);
+        static uint64_t _hash(std::string_view);
+        static size_t _put_varint(char*, uint64_t);
+        static uint64_t _get_varint(const char*&);
+};
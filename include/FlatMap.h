@@ -0,0 +1,309 @@
+/**
+ * @file FlatMap.h
+ * @author Candidate 1034792
+ * @brief Declaration and implementation of the FlatMap class template
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <PagedArray.h>
+#include <utils.h>
+
+/**
+ * @brief Key of three resources packed into 96 bits
+ */
+struct PackedTriple {
+    uint32_t words[3];
+    bool operator==(const PackedTriple& other) const {
+        return words[0] == other.words[0] && words[1] == other.words[1] &&
+               words[2] == other.words[2];
+    }
+};
+
+/**
+ * @brief Packs resources into the integer keys of a FlatMap
+ *
+ * @return uint64_t or PackedTriple The resources, first in the high bits
+ */
+inline uint64_t pack_key(Resource a) { return (uint32_t) a; }
+inline uint64_t pack_key(Resource a, Resource b) {
+    return (uint64_t) (uint32_t) a << 32 | (uint32_t) b;
+}
+inline PackedTriple pack_key(Resource a, Resource b, Resource c) {
+    return PackedTriple{{(uint32_t) a, (uint32_t) b, (uint32_t) c}};
+}
+
+/**
+ * @brief Hash function for the packed keys of a FlatMap
+ *
+ * Mixes every bit of the key into the high and low bits of the hash, both
+ * of which the map uses.
+ */
+struct PackedHash {
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ull;
+        return x ^ (x >> 33);
+    }
+    uint64_t operator()(uint64_t key) const { return mix(key); }
+    uint64_t operator()(const PackedTriple& key) const {
+        return mix(((uint64_t) key.words[0] << 32 | key.words[1])
+                   ^ mix(key.words[2]));
+    }
+};
+
+/**
+ * @brief Open-addressing hash map from packed integer keys to values
+ *
+ * Entries are stored in a single flat array of slots, with a separate
+ * array holding one control byte per slot: either empty, or seven bits of
+ * the hash of the slot's key. Slots are probed in groups of 16 aligned to
+ * the group size, comparing all 16 control bytes against the hash at once
+ * with SSE2 where available, so that a lookup usually reads one group of
+ * control bytes and one slot, and almost never compares a key that does
+ * not match. Groups are probed in triangular order, which visits every
+ * group as the number of groups is a power of two.
+ *
+ * The table grows to twice its size once more than 7/8 of its slots are
+ * full. Entries are never removed other than all at once, so no tombstones
+ * are needed. Growing moves the slots, so pointers to values are only
+ * valid until the next insertion or copy of the map.
+ *
+ * Both arrays are held in PagedArray pages that copies of the map share,
+ * so a copy costs only the page tables, and a write copies only the page
+ * it falls in while another map still holds it. Only the non-const
+ * functions write, so a map can be read while a copy of it is written.
+ *
+ * Replaces the node-based `std::unordered_map`, which costs an allocation
+ * per entry and a cache miss for each of the bucket and the node per
+ * lookup.
+ *
+ * @tparam Key Packed key type, `uint64_t` or PackedTriple
+ * @tparam Value Value type, default constructible
+ * @tparam Hash Hash function for keys
+ */
+template <class Key, class Value, class Hash = PackedHash>
+class FlatMap {
+    public:
+        /**
+         * @brief Looks up the value of a key
+         *
+         * @param key Key to look up
+         * @return const Value* Value of the key, or null if not present
+         */
+        const Value* find(const Key& key) const {
+            if (_size == 0) return nullptr;
+            size_t i = _find(key, Hash()(key));
+            return (i == _NOT_FOUND) ? nullptr : &_slots[i].value;
+        }
+        size_t count(const Key& key) const { return find(key) != nullptr; }
+
+        /**
+         * @brief Inserts a key with a value, unless already present
+         *
+         * Unlike FlatMap::try_emplace, this writes nothing if the key is
+         * present.
+         *
+         * @param key Key to insert
+         * @param value Value to give the key if not present
+         * @return std::pair<const Value*, bool> Value of the key, and
+         *      whether it was inserted
+         */
+        std::pair<const Value*, bool> insert(const Key& key,
+                                             const Value& value) {
+            auto [i, inserted] = _emplace(key, value);
+            return {&_slots[i].value, inserted};
+        }
+
+        /**
+         * @brief Inserts a key with a value, unless already present
+         *
+         * @param key Key to insert
+         * @param value Value to give the key if not present
+         * @return std::pair<Value*, bool> Value of the key, to be written
+         *      to, and whether it was inserted
+         */
+        std::pair<Value*, bool> try_emplace(const Key& key,
+                                            const Value& value) {
+            auto [i, inserted] = _emplace(key, value);
+            return {&_slots.write(i).value, inserted};
+        }
+
+        /**
+         * @brief Gets the value of a key, inserting it with a default value
+         *      if not present
+         *
+         * @param key Key to look up
+         * @return Value& Value of the key
+         */
+        Value& operator[](const Key& key) {
+            return *try_emplace(key, Value()).first;
+        }
+
+        /**
+         * @brief Makes space for a number of entries without growing
+         *
+         * @param entries Number of entries to make space for
+         */
+        void reserve(size_t entries) {
+            size_t slots = _GROUP;
+            while (slots * 7 < entries * 8) slots *= 2;
+            if (slots > _slots.size()) _rehash(slots);
+        }
+
+        /**
+         * @brief Removes all entries, freeing the table
+         */
+        void clear() {
+            _control.clear();
+            _slots.clear();
+            _size = 0;
+        }
+
+        size_t size() const { return _size; }
+        size_t memory_usage() const {
+            return _control.memory_usage() + _slots.memory_usage();
+        }
+
+    private:
+        // Number of slots probed at once
+        static constexpr size_t _GROUP = 16;
+        // Control byte of an empty slot; those of full slots are below 0x80
+        static constexpr uint8_t _EMPTY = 0x80;
+        static constexpr size_t _NOT_FOUND = SIZE_MAX;
+
+        struct _Slot {
+            Key key;
+            Value value;
+        };
+
+        // Both arrays are paged in about 4 KiB, so that the scattered
+        // writes of a batch of insertions copy little of a shared map
+        using _Controls = PagedArray<uint8_t, 12>;
+        using _Slots = PagedArray<_Slot, 8>;
+
+        // Control byte of each slot
+        _Controls _control;
+        _Slots _slots;
+        size_t _size = 0;
+
+        /**
+         * @brief Helper function to find the slots of a group whose control
+         *      bytes equal a given byte
+         *
+         * @param group First control byte of the group
+         * @param byte Control byte to look for
+         * @return uint32_t Bit mask of the matching slots within the group
+         */
+        static uint32_t _match(const uint8_t* group, uint8_t byte) {
+#ifdef __SSE2__
+            __m128i control = _mm_loadu_si128((const __m128i*) group);
+            return _mm_movemask_epi8(
+                _mm_cmpeq_epi8(control, _mm_set1_epi8((char) byte)));
+#else
+            uint32_t mask = 0;
+            for (size_t k = 0; k < _GROUP; k++)
+                mask |= (uint32_t) (group[k] == byte) << k;
+            return mask;
+#endif
+        }
+
+        /**
+         * @brief Helper function to get the group a hash is probed from,
+         *      and the control byte of its slot
+         */
+        size_t _first_group(uint64_t hash) const {
+            return (hash >> 7) & (_slots.size() / _GROUP - 1);
+        }
+        static uint8_t _control_byte(uint64_t hash) { return hash & 0x7F; }
+
+        /**
+         * @brief Helper function to find the slot holding a key
+         *
+         * @param key Key to look for
+         * @param hash Hash of the key
+         * @return size_t Position of the slot, or _NOT_FOUND
+         */
+        size_t _find(const Key& key, uint64_t hash) const {
+            size_t groups = _slots.size() / _GROUP;
+            size_t group = _first_group(hash);
+            uint8_t byte = _control_byte(hash);
+            for (size_t step = 1;; step++) {
+                const uint8_t* control = &_control[group * _GROUP];
+                for (uint32_t mask = _match(control, byte); mask;
+                     mask &= mask - 1) {
+                    size_t i = group * _GROUP + __builtin_ctz(mask);
+                    if (_slots[i].key == key) return i;
+                }
+                if (_match(control, _EMPTY)) return _NOT_FOUND;
+                group = (group + step) & (groups - 1);
+            }
+        }
+
+        /**
+         * @brief Helper function to find the slot of a key, inserting the
+         *      key with a value if not present
+         *
+         * @param key Key to look for
+         * @param value Value to give the key if not present
+         * @return std::pair<size_t, bool> Position of the slot, and
+         *      whether the key was inserted
+         */
+        std::pair<size_t, bool> _emplace(const Key& key, const Value& value) {
+            uint64_t hash = Hash()(key);
+            size_t i = (_size == 0) ? _NOT_FOUND : _find(key, hash);
+            if (i != _NOT_FOUND) return {i, false};
+            if ((_size + 1) * 8 > _slots.size() * 7)
+                _rehash(std::max(_GROUP, _slots.size() * 2));
+            i = _insert(hash);
+            _slots.write(i) = _Slot{key, value};
+            _size++;
+            return {i, true};
+        }
+
+        /**
+         * @brief Helper function to claim an empty slot for a key not
+         *      present, which there must be space for
+         *
+         * @param hash Hash of the key
+         * @return size_t Position of the slot, with its control byte set
+         */
+        size_t _insert(uint64_t hash) {
+            size_t groups = _slots.size() / _GROUP;
+            size_t group = _first_group(hash);
+            for (size_t step = 1;; step++) {
+                uint32_t empty = _match(&_control[group * _GROUP], _EMPTY);
+                if (empty) {
+                    size_t i = group * _GROUP + __builtin_ctz(empty);
+                    _control.write(i) = _control_byte(hash);
+                    return i;
+                }
+                group = (group + step) & (groups - 1);
+            }
+        }
+
+        /**
+         * @brief Helper function to move all entries into a table of a new
+         *      size
+         *
+         * @param slots New number of slots, a power of two of at least a
+         *      group, with space for every entry
+         */
+        void _rehash(size_t slots) {
+            _Controls control(slots, _EMPTY);
+            _Slots old(slots, _Slot());
+            std::swap(control, _control);
+            std::swap(old, _slots);
+            for (size_t i = 0; i < old.size(); i++) {
+                if (control[i] & _EMPTY) continue;
+                _slots.write(_insert(Hash()(old[i].key))) = old[i];
+            }
+        }
+};
@@ -0,0 +1,85 @@
+/**
+ * @file GenericJoin.h
+ * @author Candidate 1034792
+ * @brief Declaration of the GenericJoin class
+ */
+#pragma once
+#include <functional>
+#include <vector>
+#include <BatchJoin.h>
+#include <Query.h>
+#include <utils.h>
+
+/**
+ * @brief Worst-case optimal evaluation of a compiled query
+ *
+ * The GenericJoin class evaluates all of a query's patterns at once, binding
+ * one variable at a time in slot order rather than joining one pattern at a
+ * time. For each variable, the pattern containing it with the fewest
+ * matches under the bindings so far proposes candidate values, and every
+ * other pattern containing it must have a match with each candidate for it
+ * to be kept. Patterns in which the variable is the only one left unbound
+ * give sorted lists of values, which are intersected with the candidates
+ * unless much longer. The work done is thus bounded by the largest possible
+ * output of the query, however large the result of joining any subset of
+ * its patterns, which makes it suited to cyclic queries.
+ *
+ * Rows are passed on in batches in the same form as by BatchJoin.
+ *
+ * Defined for the LinkedIndex and PermutationIndex classes, the cursors of
+ * which are used directly.
+ *
+ * Member function documentation provided in implementation file
+ * `l_generic_join.cpp`.
+ */
+template <class Index>
+class GenericJoin {
+    public:
+        GenericJoin(Index&, const CompiledQuery&, bool);
+        void run(const std::function<void(const Batch&)>&);
+        void set_deadline(Deadline deadline) { _deadline = deadline; }
+
+    private:
+        using _Cursor = typename Index::Cursor;
+
+        // Cost of checking a candidate by opening a cursor, relative to that
+        // of reading one value into a list to intersect with
+        static constexpr size_t _PROBE_COST = 8;
+        // Number of bindings tried between checks of the deadline
+        static constexpr size_t _CHECK_INTERVAL = 1024;
+
+        // Binding of one variable
+        struct _Level {
+            // Patterns containing the variable
+            std::vector<size_t> patterns;
+            // Candidate values, values of another pattern to intersect them
+            // with, and the patterns to check each candidate against; reused
+            // for every binding of earlier levels
+            std::vector<Resource> candidates, values;
+            std::vector<size_t> checks;
+            // Estimated matches of each pattern
+            std::vector<size_t> matches;
+        };
+
+        Index* _index;
+        const CompiledQuery* _query;
+        std::vector<_Level> _levels;
+        // Patterns without variables, which must each have a match
+        std::vector<size_t> _ground;
+        // Bindings of the variables bound so far, indexed by slot, and a
+        // row for cursors to write bindings that are not kept into
+        std::vector<Resource> _row, _scratch;
+        _Cursor _cursor;
+        // Rows produced, and the slots output
+        Batch _out;
+        std::vector<Slot> _output;
+        const std::function<void(const Batch&)>* _sink;
+        // Time by which evaluation must finish, and the bindings tried since
+        // it was last checked
+        Deadline _deadline = NO_DEADLINE;
+        size_t _steps = 0;
+
+        void _bind(size_t);
+        void _read(SlotPattern, size_t, std::vector<Resource>&);
+        SlotPattern _substitute(size_t, size_t);
+};
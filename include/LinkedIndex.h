@@ -0,0 +1,331 @@
+/**
+ * @file LinkedIndex.h
+ * @author Candidate 1034792
+ * @brief Declaration of the LinkedIndex class
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <Arena.h>
+#include <CharacteristicSets.h>
+#include <FlatMap.h>
+#include <PostingList.h>
+#include <RDFIndex.h>
+#include <utils.h>
+
+/**
+ * @brief Linked-list RDF indexing data structure
+ * 
+ * The LinkedIndex class implements the RDFIndex interface using the triple
+ * table with SP-, OP- and P-lists and the hash-map indexes described in
+ * the paper. The hash-maps are open-addressing FlatMap tables keyed by
+ * resources packed into integers.
+ * 
+ * Lists of at least a given number of rows are also kept as compressed
+ * PostingList copies: P-lists and OP-lists, scanned for patterns fixing
+ * only a predicate or only an object, as ascending row positions, and the
+ * p-groups of OP-lists, scanned for patterns fixing a predicate and an
+ * object, as ascending subjects. Scanning these decodes a block of rows at
+ * a time and reads the triple table in order, rather than following one
+ * link per row. They are brought up to date by LinkedIndex::prepare_reads;
+ * until then, the linked lists that triples have since joined are walked
+ * instead.
+ * 
+ * Versions of the index extended from one another by LinkedIndex::extended
+ * share the triple table, each holding the rows before a given position,
+ * along with the hash-map pages and compressed lists left unchanged. A row
+ * joins its SP- and OP-lists just after the first row of its p-group, or
+ * at the head through the hash-maps, so an earlier version walking a list
+ * skips the rows past its own and finds the list as it was. Links of
+ * shared rows are written and read atomically, so that this can happen
+ * while later rows are added.
+ * 
+ * Member function documentation provided in implementation file `a_index.cpp`.
+ */
+class LinkedIndex : public RDFIndex {
+    public:
+        class Cursor;
+
+        explicit LinkedIndex(size_t compress_threshold = COMPRESS_THRESHOLD) :
+            _arena(std::make_shared<Arena<_TableRow>>()),
+            _table(_arena->data()), _rows(0),
+            _compress_threshold(compress_threshold) {}
+        void add(Resource, Resource, Resource) override;
+        void add_bulk(std::vector<ResourceTriple>&, int) override;
+        std::unique_ptr<RDFIndex> extended(std::vector<ResourceTriple>&,
+                                           int) const override;
+        std::function<bool()> evaluate(SlotTerm, SlotTerm, SlotTerm,
+                                       Resource*) override;
+        size_t estimate(SlotTerm, SlotTerm, SlotTerm) override;
+        size_t count(SlotTerm, SlotTerm, SlotTerm) override;
+        TripleStatistics statistics() override;
+        TripleStatistics statistics(Resource) override;
+        double estimate_star(const std::vector<Resource>&) override;
+        void prepare_reads() override;
+        void report_memory(std::vector<MemoryUsage>&) const override;
+        void save(SnapshotWriter&) override;
+        void open(const Snapshot&, bool, int) override;
+
+    private:
+        // Position of a row in the triple table
+        using _RowId = uint32_t;
+        static constexpr _RowId _NO_ROW = UINT32_MAX;
+
+        // Represents a single row in the triple table, with list links
+        // stored as row positions rather than pointers
+        struct _TableRow { 
+            Resource s, p, o;
+            _RowId next_SP, next_OP, next_P;
+        };
+
+        // Hash-maps keyed by one or two resources packed into 64 bits, or
+        // by three packed into 96 bits; see `FlatMap.h`
+        template <class Value> using _Map = FlatMap<uint64_t, Value>;
+        using _TripleMap = FlatMap<PackedTriple, _RowId>;
+
+        // Triple table, stored contiguously and shared with the versions
+        // extended from this one, of which this version holds the first
+        // _rows rows
+        std::shared_ptr<Arena<_TableRow>> _arena;
+        _TableRow* _table;
+        _RowId _rows;
+        // Index structures as specified in the paper this is based on
+        _Map<_RowId> _index_S, _index_O, _index_P;
+        _Map<_RowId> _index_SP, _index_OP;
+        _TripleMap _index_SPO;
+        // Length counters for SP- and OP-lists, by subject and object
+        _Map<size_t> _len_S, _len_O;
+        // Length counters for the p-groups within SP- and OP-lists
+        _Map<size_t> _len_SP, _len_OP;
+        // Statistics of the triples with each predicate; P-list lengths are
+        // their numbers of triples
+        _Map<TripleStatistics> _stats_P;
+        // Characteristic sets of the subjects
+        CharacteristicSets _sets;
+
+        // Compressed copy of a list, unused once the list has changed
+        struct _Postings {
+            std::shared_ptr<const PostingList> list;
+            bool current;
+        };
+
+        // Number of rows from which lists are compressed, or 0 for none
+        size_t _compress_threshold;
+        std::vector<_Postings> _postings;
+        // Positions in _postings of the compressed P-lists and OP-lists, by
+        // predicate and object, and of the compressed OP-list p-groups
+        _Map<uint32_t> _postings_P, _postings_O, _postings_OP;
+        // Number of rows of the triple table the compressed lists include
+        _RowId _compressed_rows = 0;
+        // Values added to the lists of one kind since they were last
+        // compressed; see `a_index.cpp`
+        struct _Additions;
+
+        void _build(std::vector<ResourceTriple>&, int);
+        void _append(const _TableRow&);
+        void _reserve_rows(size_t);
+        void _link(const std::vector<_RowId>&, Resource _TableRow::*,
+                   _RowId _TableRow::*, _Map<_RowId>&);
+        bool _compressed(size_t) const;
+        void _outdate(_Map<uint32_t>&, uint64_t, size_t);
+        void _register(_Map<uint32_t>&, uint64_t);
+        void _compress(const _Map<uint32_t>&, _Additions&,
+                       std::vector<uint32_t>(LinkedIndex::*)(uint64_t) const);
+        std::vector<uint32_t> _rows_P(uint64_t) const;
+        std::vector<uint32_t> _rows_O(uint64_t) const;
+        std::vector<uint32_t> _subjects_OP(uint64_t) const;
+        template <class Map, class K>
+        static _RowId _find(const Map&, const K&);
+
+        /**
+         * @brief Follows a link from a row, skipping the rows past this
+         *      version's
+         *
+         * @param row Row to follow the link of
+         * @param link SP- or OP-list link field
+         * @return _RowId Next row of the list in this version, or _NO_ROW
+         */
+        _RowId _next(const _TableRow& row, _RowId _TableRow::*link) const {
+            _RowId next = __atomic_load_n(&(row.*link), __ATOMIC_ACQUIRE);
+            while (next != _NO_ROW && next >= _rows)
+                next = __atomic_load_n(&(_table[next].*link),
+                                       __ATOMIC_ACQUIRE);
+            return next;
+        }
+};
+
+/**
+ * @brief Reusable iterator over the matches of a triple pattern in a
+ *      LinkedIndex
+ *
+ * Each pattern type is evaluated by walking one kind of list (the whole
+ * table, an SP-, OP- or P-list, or the p-group within an SP- or OP-list)
+ * and optionally filtering rows with one kind of check. Both are fixed when
+ * the cursor is opened, so stepping through matches involves no indirect
+ * calls and inlines into the caller. Opening a cursor allocates nothing, so
+ * one cursor can be reused for every probe of a pattern.
+ *
+ * Lists with an up-to-date compressed copy are scanned from that instead,
+ * one decoded block at a time.
+ *
+ * Documentation of Cursor::open provided in implementation file
+ * `a_index.cpp`.
+ */
+class LinkedIndex::Cursor {
+    public:
+        explicit Cursor(const LinkedIndex& index) :
+            _index(&index), _current(_NO_ROW), _postings(nullptr) {}
+        void open(SlotTerm, SlotTerm, SlotTerm);
+
+        /**
+         * @brief Writes the bindings of the next match into a row
+         *
+         * @param row Row of bindings, indexed by slot
+         * @return bool Whether there was a match, false once exhausted
+         */
+        bool next(Resource* row) {
+            if (_postings) return _next_posting(row);
+            while (_current != _NO_ROW) {
+                const _TableRow& match = _index->_table[_current];
+                _current = _step(match);
+                if (!_accepts(match)) continue;
+                if (_slot_s != NO_SLOT) row[_slot_s] = match.s;
+                if (_slot_p != NO_SLOT) row[_slot_p] = match.p;
+                if (_slot_o != NO_SLOT) row[_slot_o] = match.o;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief Writes the bindings of the next matches into columns
+         *
+         * @param columns Column of bindings for each slot, each with space
+         *      for at least \p max rows
+         * @param max Maximum number of matches to write
+         * @return size_t Number of matches written, less than \p max only
+         *      once exhausted
+         */
+        size_t next_batch(Resource* const* columns, size_t max) {
+            if (_postings) return _next_postings(columns, max);
+            size_t n = 0;
+            while (_current != _NO_ROW && n < max) {
+                const _TableRow& match = _index->_table[_current];
+                _current = _step(match);
+                if (!_accepts(match)) continue;
+                if (_slot_s != NO_SLOT) columns[_slot_s][n] = match.s;
+                if (_slot_p != NO_SLOT) columns[_slot_p][n] = match.p;
+                if (_slot_o != NO_SLOT) columns[_slot_o][n] = match.o;
+                n++;
+            }
+            return n;
+        }
+
+    private:
+        // List followed from one candidate row to the next
+        enum _List : uint8_t { _TABLE, _SP, _OP, _P, _SP_GROUP, _OP_GROUP,
+                               _SINGLE, _ROWS, _SUBJECTS };
+        // Check a candidate row must pass to be a match
+        enum _Filter : uint8_t { _ANY, _S_IS_P, _P_IS_O, _S_IS_O, _ALL_SAME,
+                                 _S_IS_VALUE, _O_IS_VALUE };
+
+        const LinkedIndex* _index;
+        // Next candidate row, and the end of the table for table scans
+        _RowId _current, _end;
+        _List _list;
+        _Filter _filter;
+        // Resource the filter or p-group compares against
+        Resource _value;
+        // Slots to write the subject, predicate and object of matches into
+        Slot _slot_s, _slot_p, _slot_o;
+        // Compressed list scanned instead of a linked list, if any, of row
+        // positions for _ROWS or of subjects for _SUBJECTS
+        const PostingList* _postings;
+        // Next block of the compressed list to decode
+        size_t _block;
+        // Values of the last block decoded, and the next of them to return
+        uint32_t _buffer[PostingList::BLOCK];
+        uint32_t _position, _available;
+
+        bool _open_postings(const _Map<uint32_t>&, uint64_t, _List);
+        bool _refill() {
+            if (_block == _postings->blocks()) return false;
+            _available = _postings->decode(_block++, _buffer);
+            _position = 0;
+            return true;
+        }
+        bool _next_posting(Resource* row) {
+            while (_position < _available || _refill()) {
+                uint32_t value = _buffer[_position++];
+                if (_list == _SUBJECTS) {
+                    row[_slot_s] = value;
+                    return true;
+                }
+                const _TableRow& match = _index->_table[value];
+                if (!_accepts(match)) continue;
+                if (_slot_s != NO_SLOT) row[_slot_s] = match.s;
+                if (_slot_p != NO_SLOT) row[_slot_p] = match.p;
+                if (_slot_o != NO_SLOT) row[_slot_o] = match.o;
+                return true;
+            }
+            return false;
+        }
+        size_t _next_postings(Resource* const* columns, size_t max) {
+            size_t n = 0;
+            while (n < max && (_position < _available || _refill())) {
+                if (_list == _SUBJECTS) {
+                    // Subjects are copied a run at a time
+                    size_t k = std::min<size_t>(max - n,
+                                                _available - _position);
+                    std::copy(_buffer + _position, _buffer + _position + k,
+                              columns[_slot_s] + n);
+                    _position += k;
+                    n += k;
+                    continue;
+                }
+                const _TableRow& match = _index->_table[_buffer[_position++]];
+                if (!_accepts(match)) continue;
+                if (_slot_s != NO_SLOT) columns[_slot_s][n] = match.s;
+                if (_slot_p != NO_SLOT) columns[_slot_p][n] = match.p;
+                if (_slot_o != NO_SLOT) columns[_slot_o][n] = match.o;
+                n++;
+            }
+            return n;
+        }
+
+        _RowId _step(const _TableRow& row) const {
+            _RowId next;
+            switch (_list) {
+            case _TABLE:
+                next = _current + 1;
+                return next < _end ? next : _NO_ROW;
+            case _SP: return _index->_next(row, &_TableRow::next_SP);
+            case _OP: return _index->_next(row, &_TableRow::next_OP);
+            case _P: return row.next_P;
+            case _SP_GROUP:
+                next = _index->_next(row, &_TableRow::next_SP);
+                return (next != _NO_ROW && _index->_table[next].p == _value)
+                       ? next : _NO_ROW;
+            case _OP_GROUP:
+                next = _index->_next(row, &_TableRow::next_OP);
+                return (next != _NO_ROW && _index->_table[next].p == _value)
+                       ? next : _NO_ROW;
+            default: return _NO_ROW;
+            }
+        }
+        bool _accepts(const _TableRow& row) const {
+            switch (_filter) {
+            case _S_IS_P: return row.s == row.p;
+            case _P_IS_O: return row.p == row.o;
+            case _S_IS_O: return row.s == row.o;
+            case _ALL_SAME: return row.s == row.p && row.p == row.o;
+            case _S_IS_VALUE: return row.s == _value;
+            case _O_IS_VALUE: return row.o == _value;
+            default: return true;
+            }
+        }
+};
@@ -0,0 +1,87 @@
+/**
+ * @file MappedFile.h
+ * @author Candidate 1034792
+ * @brief Declaration and implementation of the MappedFile class
+ */
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ *
+ * Pages are read from disk on first access only, and since the mapping is
+ * backed by the file they can be dropped again without being written out.
+ */
+class MappedFile {
+    public:
+        /**
+         * @brief Maps the named file into memory
+         *
+         * @param filename Path of the file to map
+         */
+        explicit MappedFile(const std::string& filename) :
+                _data(nullptr), _size(0) {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) throw std::invalid_argument(
+                "File not found. Check the path and try again.");
+            struct stat info;
+            if (fstat(fd, &info) != 0) {
+                close(fd);
+                throw std::invalid_argument("Could not read file " + filename);
+            }
+            _size = info.st_size;
+            if (_size > 0) {
+                void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE,
+                                  fd, 0);
+                if (data == MAP_FAILED) {
+                    close(fd);
+                    throw std::invalid_argument("Could not map file "
+                                                + filename);
+                }
+                _data = static_cast<const char*>(data);
+            }
+            close(fd);
+        }
+        ~MappedFile() {
+            if (_data != nullptr) munmap(const_cast<char*>(_data), _size);
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::string_view contents() const { return {_data, _size}; }
+        size_t size() const { return _size; }
+
+        /**
+         * @brief Hints that the file will be read front to back
+         */
+        void advise_sequential() const {
+            if (_data != nullptr)
+                madvise(const_cast<char*>(_data), _size, MADV_SEQUENTIAL);
+        }
+
+        /**
+         * @brief Releases the pages of the first \p bytes of the file
+         *
+         * Used to keep resident memory bounded while streaming through a
+         * file; the pages are simply read again if accessed later.
+         *
+         * @param bytes Length of the prefix of the file no longer needed
+         */
+        void release(size_t bytes) const {
+            size_t page = sysconf(_SC_PAGESIZE);
+            bytes = bytes / page * page;
+            if (_data != nullptr && bytes > 0)
+                madvise(const_cast<char*>(_data), bytes, MADV_DONTNEED);
+        }
+
+    private:
+        const char* _data;
+        size_t _size;
+};
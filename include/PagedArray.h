@@ -0,0 +1,152 @@
+/**
+ * @file PagedArray.h
+ * @author Candidate 1034792
+ * @brief Declaration and implementation of the PagedArray class template
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Array split into pages that copies of the array share until
+ *      either writes to them
+ *
+ * Copying the array copies only its table of pages, and writing an
+ * element first copies its page if another copy of the array holds it, so
+ * a copy costs memory in proportion to the pages written to since. Copies
+ * never write to a page they share, so each can be read while the others
+ * are written.
+ *
+ * Pages hold 2^PAGE_BITS elements, except that an array shorter than that
+ * is held in a single page of its own length. Reads index a table of page
+ * addresses, then the page.
+ *
+ * @tparam T Element type, must be trivially copyable
+ * @tparam PAGE_BITS Base-2 logarithm of the number of elements per page
+ */
+template <class T, size_t PAGE_BITS = 10>
+class PagedArray {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "PagedArray elements must be trivially copyable");
+
+    public:
+        // Number of elements of a full page
+        static constexpr size_t PAGE = size_t(1) << PAGE_BITS;
+
+        PagedArray() = default;
+
+        /**
+         * @brief Constructs an array of copies of a value
+         *
+         * @param size Number of elements
+         * @param value Value of every element
+         */
+        PagedArray(size_t size, const T& value) { resize(size, value); }
+
+        const T& operator[](size_t i) const {
+            return _data[i >> PAGE_BITS][i & (PAGE - 1)];
+        }
+
+        /**
+         * @brief Gets an element for writing, first copying its page if
+         *      it is shared with another copy of the array
+         *
+         * @param i Position of the element
+         * @return T& The element
+         */
+        T& write(size_t i) {
+            std::shared_ptr<T[]>& page = _pages[i >> PAGE_BITS];
+            if (page.use_count() > 1) {
+                std::shared_ptr<T[]> copy(new T[_page_length]);
+                std::copy(page.get(), page.get() + _page_length, copy.get());
+                page = std::move(copy);
+                _data[i >> PAGE_BITS] = page.get();
+            } else {
+                // Orders the writes after the reads of any copy that has
+                // just released the page
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            return page.get()[i & (PAGE - 1)];
+        }
+
+        /**
+         * @brief Changes the number of elements
+         *
+         * @param size New number of elements
+         * @param value Value of any elements added
+         */
+        void resize(size_t size, const T& value) {
+            // Elements past the old size in pages already held
+            size_t end = std::min(size, capacity());
+            if (size > capacity()) {
+                if (_page_length < PAGE && size <= PAGE) {
+                    _relayout(size, value);
+                    end = _size;
+                } else {
+                    if (_page_length < PAGE) {
+                        _relayout(PAGE, value);
+                        end = _size;
+                    }
+                    while (capacity() < size) {
+                        _pages.push_back(_page(PAGE, value));
+                        _data.push_back(_pages.back().get());
+                    }
+                }
+            }
+            for (size_t i = _size; i < end; i++) write(i) = value;
+            _size = size;
+        }
+
+        /**
+         * @brief Removes all elements, releasing the pages
+         */
+        void clear() {
+            _pages.clear();
+            _data.clear();
+            _page_length = 0;
+            _size = 0;
+        }
+
+        size_t size() const { return _size; }
+        size_t capacity() const { return _pages.size() * _page_length; }
+        size_t memory_usage() const {
+            return capacity() * sizeof(T) +
+                   _pages.capacity() * sizeof(std::shared_ptr<T[]>) +
+                   _data.capacity() * sizeof(T*);
+        }
+
+    private:
+        std::vector<std::shared_ptr<T[]>> _pages;
+        // Address of each page, read without touching the shared pointers
+        std::vector<T*> _data;
+        // Number of elements of every page
+        size_t _page_length = 0;
+        size_t _size = 0;
+
+        // Allocates a page with every element set to a value
+        static std::shared_ptr<T[]> _page(size_t length, const T& value) {
+            std::shared_ptr<T[]> page(new T[length]);
+            std::fill(page.get(), page.get() + length, value);
+            return page;
+        }
+        /**
+         * @brief Helper function to move the elements of an array of at
+         *      most one page into a single page of a new length
+         *
+         * @param length New page length, at least the number of elements
+         * @param value Value of the elements of the page past them
+         */
+        void _relayout(size_t length, const T& value) {
+            std::shared_ptr<T[]> page = _page(length, value);
+            if (!_pages.empty())
+                std::copy(_pages[0].get(), _pages[0].get() + _size,
+                          page.get());
+            _data.assign(1, page.get());
+            _pages.assign(1, std::move(page));
+            _page_length = length;
+        }
+};
@@ -0,0 +1,66 @@
+/**
+ * @file ParallelJoin.h
+ * @author Candidate 1034792
+ * @brief Declaration of the ParallelJoin class
+ */
+#pragma once
+#include <functional>
+#include <vector>
+#include <BatchJoin.h>
+#include <Query.h>
+#include <ThreadPool.h>
+#include <utils.h>
+
+/**
+ * @brief Parallel evaluation of a compiled query
+ *
+ * The ParallelJoin class reads all matches of a query's first pattern, then
+ * splits them into morsels of consecutive rows which several threads run
+ * through the remaining joins of a BatchJoin, each with a copy of its own.
+ * The morsels are the tasks of one job on a ThreadPool, whose threads
+ * steal them from each other once they run out of their own. Morsels are
+ * small enough for there to be many per thread.
+ *
+ * Each thread counts its results, and keeps the selected bindings of each
+ * morsel's results if requested; these are passed on in morsel order once
+ * all threads have finished, so the results are in the same order as if
+ * evaluated by a single BatchJoin.
+ *
+ * Merge joins cannot resume part way through a pattern's matches for each
+ * morsel, so plans for a ParallelJoin must not use them.
+ *
+ * When profiled, each thread profiles its copy with hardware counters of
+ * its own, and the work of each stage is summed over all threads.
+ *
+ * Member function documentation provided in implementation file
+ * `n_parallel_join.cpp`.
+ */
+template <class Index>
+class ParallelJoin {
+    public:
+        ParallelJoin(Index&, const CompiledQuery&, bool, ThreadPool&);
+        void run(const std::function<void(const Batch&)>&);
+        const std::vector<size_t>& produced() const;
+        void profile(const PerfCounters*);
+        const std::vector<StageProfile>& profiles() const {
+            return _profiles;
+        }
+        void set_deadline(Deadline deadline) { _join.set_deadline(deadline); }
+
+    private:
+        // Number of morsels to aim for per thread
+        static constexpr size_t _MORSELS_PER_THREAD = 16;
+
+        const CompiledQuery* _query;
+        BatchJoin<Index> _join;
+        bool _project;
+        ThreadPool* _pool;
+        // Number of rows produced by each stage, over all threads
+        std::vector<size_t> _produced;
+        // Whether to profile the join, the counters of the thread reading
+        // the first pattern's matches if any, and the work done by each
+        // stage and by the output, over all threads
+        bool _profiling = false;
+        const PerfCounters* _counters = nullptr;
+        std::vector<StageProfile> _profiles;
+};
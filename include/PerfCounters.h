@@ -0,0 +1,50 @@
+/**
+ * @file PerfCounters.h
+ * @author Candidate 1034792
+ * @brief Declaration of the PerfCounters class
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Hardware performance counters of the calling thread
+ *
+ * The PerfCounters class counts CPU cycles, instructions retired and
+ * last-level cache misses for the thread that constructs it, using the
+ * Linux `perf_event_open` system call. The counters are opened as one
+ * group, so that all are read together with a single system call, and
+ * count user-space events only, which unprivileged processes are usually
+ * allowed to.
+ *
+ * Where the system call is unavailable or refused, as in many containers
+ * and virtual machines, the counters are simply unavailable, and any event
+ * the processor lacks reads as zero.
+ *
+ * Member function documentation provided in implementation file
+ * `r_perf_counters.cpp`.
+ */
+class PerfCounters {
+    public:
+        // Events counted, in the order they are read
+        enum Event {CYCLES, INSTRUCTIONS, LLC_MISSES, EVENTS};
+
+        PerfCounters();
+        ~PerfCounters();
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        bool available() const { return _fds[CYCLES] >= 0; }
+        const std::string& error() const { return _error; }
+        void read(uint64_t*) const;
+
+    private:
+        // File descriptor of each event's counter, or -1 if not open; the
+        // cycle counter leads the group
+        int _fds[EVENTS];
+        // Position of each event's count within the group's values
+        int _positions[EVENTS];
+        int _open = 0;
+        // Why the counters are unavailable, if they are
+        std::string _error;
+};
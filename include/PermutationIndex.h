@@ -0,0 +1,235 @@
+/**
+ * @file PermutationIndex.h
+ * @author Candidate 1034792
+ * @brief Declaration of the PermutationIndex class
+ */
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <ArrayView.h>
+#include <CharacteristicSets.h>
+#include <MappedFile.h>
+#include <RDFIndex.h>
+#include <Snapshot.h>
+#include <utils.h>
+
+/**
+ * @brief Sorted permutation RDF indexing data structure
+ *
+ * The PermutationIndex class implements the RDFIndex interface using three
+ * sorted permutations of the triples (SPO, POS and OSP), each stored in a
+ * compressed sparse row layout: the leading resource of each triple is
+ * implied by its position, so only the remaining two are stored. Every
+ * pattern type is answered by a binary search followed by a contiguous
+ * range scan.
+ *
+ * Added triples are buffered and merged into the permutations on the next
+ * call to evaluate, in a single pass over each permutation. Versions of the
+ * index made by PermutationIndex::extended share the permutations of the
+ * version they extend until a batch adds a triple. Snapshots hold the
+ * statistics used for planning alongside the permutations, so an index
+ * opened from one only reads the parts of the permutations queries scan.
+ *
+ * Member function documentation provided in implementation file
+ * `g_permutation_index.cpp`.
+ */
+class PermutationIndex : public RDFIndex {
+    public:
+        class Cursor;
+
+        void add(Resource, Resource, Resource) override;
+        void add_bulk(std::vector<ResourceTriple>&, int) override;
+        std::unique_ptr<RDFIndex> extended(std::vector<ResourceTriple>&,
+                                           int) const override;
+        std::function<bool()> evaluate(SlotTerm, SlotTerm, SlotTerm,
+                                       Resource*) override;
+        size_t estimate(SlotTerm, SlotTerm, SlotTerm) override;
+        size_t count(SlotTerm, SlotTerm, SlotTerm) override;
+        TripleStatistics statistics() override;
+        TripleStatistics statistics(Resource) override;
+        double estimate_star(const std::vector<Resource>&) override;
+        void prepare_reads() override;
+        int order(SlotTerm, SlotTerm, SlotTerm) override;
+        void report_memory(std::vector<MemoryUsage>&) const override;
+        void save(SnapshotWriter&) override;
+        void open(const Snapshot&, bool, int) override;
+
+    private:
+        // Trailing two resources of a triple within a permutation
+        struct _Pair {
+            Resource first, second;
+            bool operator<(const _Pair& other) const {
+                return first < other.first ||
+                       (first == other.first && second < other.second); }
+        };
+
+        // One sorted permutation of the triples. The pairs for leading
+        // resource k are pairs[offsets[k]] up to pairs[offsets[k+1]].
+        // These are views of either the storage vectors, which versions of
+        // the index holding the same permutation share, or a snapshot.
+        struct _Permutation {
+            ArrayView<uint32_t> offsets;
+            ArrayView<_Pair> pairs;
+            std::shared_ptr<const std::vector<uint32_t>> offsets_storage;
+            std::shared_ptr<const std::vector<_Pair>> pairs_storage;
+        };
+
+        // Permutations keyed by subject, predicate and object respectively
+        _Permutation _spo, _pos, _osp;
+        // Snapshot file the permutations are mapped from, if any
+        std::shared_ptr<MappedFile> _mapping;
+        // Triples added since the permutations were last built
+        std::vector<std::array<Resource, 3>> _pending;
+        // Number of threads to use when next building the permutations
+        int _threads = 1;
+        // Statistics of all triples and of those with each predicate, and
+        // the characteristic sets of the subjects, computed from the
+        // permutations when first needed or read from a snapshot. The
+        // statistics of the predicates in _stats_predicates, which are in
+        // ascending order, are at the same positions of _stats_P.
+        TripleStatistics _stats;
+        MappableArray<Resource> _stats_predicates;
+        MappableArray<TripleStatistics> _stats_P;
+        CharacteristicSets _sets;
+        bool _stats_valid = false;
+
+        void _flush();
+        void _merge_pending(const PermutationIndex&);
+        bool _contains(Resource, Resource, Resource) const;
+        void _compute_statistics();
+        static _Permutation _merge(const _Permutation&,
+                                   const std::vector<std::array<Resource, 3>>&,
+                                   int, int, int, int);
+        static std::pair<uint32_t, uint32_t> _range(const _Permutation&,
+                                                    Resource);
+        static std::pair<uint32_t, uint32_t> _range(const _Permutation&,
+                                                    Resource, Resource);
+};
+
+/**
+ * @brief Reusable iterator over the matches of a triple pattern in a
+ *      PermutationIndex
+ *
+ * Scans a contiguous range of pairs in one permutation, optionally
+ * filtering them with one kind of check for repeated variables. Both are
+ * fixed when the cursor is opened, so stepping through matches involves no
+ * indirect calls and inlines into the caller. Opening a cursor allocates
+ * nothing, so one cursor can be reused for every probe of a pattern.
+ *
+ * Documentation of Cursor::open provided in implementation file
+ * `g_permutation_index.cpp`.
+ */
+class PermutationIndex::Cursor {
+    public:
+        explicit Cursor(PermutationIndex& index) :
+            _index(&index), _i(0), _end(0) {}
+        void open(SlotTerm, SlotTerm, SlotTerm);
+
+        /**
+         * @brief Gets the number of candidates left to scan
+         */
+        size_t remaining() const { return _end - _i; }
+
+        /**
+         * @brief Writes the bindings of the next match into a row
+         *
+         * @param row Row of bindings, indexed by slot
+         * @return bool Whether there was a match, false once exhausted
+         */
+        bool next(Resource* row) {
+            for (; _i < _end; _i++) {
+                // The leading resource only changes in whole-permutation scans
+                while (_offsets[_key+1] <= _i) _key++;
+                const _Pair& pair = _pairs[_i];
+                if (!_accepts(pair)) continue;
+                _i++;
+                if (_key_slot != NO_SLOT) row[_key_slot] = _key;
+                if (_first_slot != NO_SLOT) row[_first_slot] = pair.first;
+                if (_second_slot != NO_SLOT) row[_second_slot] = pair.second;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief Writes the bindings of the next matches into columns
+         *
+         * Without a filter, the matches are a run of consecutive pairs, so
+         * each column is filled by its own loop.
+         *
+         * @param columns Column of bindings for each slot, each with space
+         *      for at least \p max rows
+         * @param max Maximum number of matches to write
+         * @return size_t Number of matches written, less than \p max only
+         *      once exhausted
+         */
+        size_t next_batch(Resource* const* columns, size_t max) {
+            size_t n = 0;
+            if (_filter != _ANY) {
+                for (; _i < _end && n < max; _i++) {
+                    while (_offsets[_key+1] <= _i) _key++;
+                    const _Pair& pair = _pairs[_i];
+                    if (!_accepts(pair)) continue;
+                    if (_key_slot != NO_SLOT) columns[_key_slot][n] = _key;
+                    if (_first_slot != NO_SLOT)
+                        columns[_first_slot][n] = pair.first;
+                    if (_second_slot != NO_SLOT)
+                        columns[_second_slot][n] = pair.second;
+                    n++;
+                }
+                return n;
+            }
+            n = std::min<size_t>(max, _end - _i);
+            const _Pair* pairs = _pairs + _i;
+            if (_first_slot != NO_SLOT) {
+                Resource* column = columns[_first_slot];
+                for (size_t j = 0; j < n; j++) column[j] = pairs[j].first;
+            }
+            if (_second_slot != NO_SLOT) {
+                Resource* column = columns[_second_slot];
+                for (size_t j = 0; j < n; j++) column[j] = pairs[j].second;
+            }
+            // The leading resource is constant unless it has a slot
+            if (_key_slot != NO_SLOT) {
+                Resource* column = columns[_key_slot];
+                for (size_t j = 0; j < n; j++) {
+                    while (_offsets[_key+1] <= _i+j) _key++;
+                    column[j] = _key;
+                }
+            }
+            _i += n;
+            return n;
+        }
+
+    private:
+        // Check a candidate must pass to be a match
+        enum _Filter : uint8_t { _ANY, _KEY_IS_FIRST, _FIRST_IS_SECOND,
+                                 _KEY_IS_SECOND, _ALL_SAME };
+
+        PermutationIndex* _index;
+        // Permutation being scanned
+        const uint32_t* _offsets;
+        const _Pair* _pairs;
+        // Current position and end of the range, and the leading resource
+        // of the current position
+        uint32_t _i, _end;
+        Resource _key;
+        _Filter _filter;
+        // Slots to write the leading resource and pair of matches into
+        Slot _key_slot, _first_slot, _second_slot;
+
+        bool _accepts(const _Pair& pair) const {
+            switch (_filter) {
+            case _KEY_IS_FIRST: return _key == pair.first;
+            case _FIRST_IS_SECOND: return pair.first == pair.second;
+            case _KEY_IS_SECOND: return _key == pair.second;
+            case _ALL_SAME:
+                return _key == pair.first && pair.first == pair.second;
+            default: return true;
+            }
+        }
+};
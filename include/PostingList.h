@@ -0,0 +1,62 @@
+/**
+ * @file PostingList.h
+ * @author Candidate 1034792
+ * @brief Declaration of the PostingList class
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Compressed, read-only list of ascending integers
+ *
+ * Values are stored in blocks of 128, each split into four interleaved
+ * lanes: value `i` of a block belongs to lane `i % 4`, and is stored as its
+ * difference from value `i - 4`, the values before the block all taken to
+ * be the block's base. The differences of a block are bit-packed at the
+ * width of the largest, each lane's into 32-bit words of its own, with the
+ * words of the four lanes interleaved. A whole block is thus decoded four
+ * values at a time, with one SSE2 vector holding a word of every lane and
+ * the running sums of the lanes, where available.
+ *
+ * Used by LinkedIndex for its longest lists, which it otherwise walks one
+ * linked row at a time.
+ *
+ * Member function documentation provided in implementation file
+ * `s_posting_list.cpp`.
+ */
+class PostingList {
+    public:
+        // Number of values per block
+        static constexpr size_t BLOCK = 128;
+
+        PostingList() = default;
+        explicit PostingList(const std::vector<uint32_t>&);
+        size_t decode(size_t, uint32_t*) const;
+        std::vector<uint32_t> values() const;
+
+        size_t size() const { return _size; }
+        size_t blocks() const { return _blocks.size(); }
+        size_t memory_usage() const {
+            return _blocks.capacity() * sizeof(_Block) +
+                   _words.capacity() * sizeof(uint32_t);
+        }
+
+    private:
+        // Number of interleaved lanes per block
+        static constexpr size_t _LANES = 4;
+
+        struct _Block {
+            // Value taken to precede the block in every lane
+            uint32_t base;
+            // Position of the block's first word
+            size_t offset;
+            // Bits per packed difference, from 0 to 32
+            uint8_t width;
+        };
+
+        std::vector<_Block> _blocks;
+        std::vector<uint32_t> _words;
+        size_t _size = 0;
+};
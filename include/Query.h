@@ -7,14 +7,48 @@
 #include <functional>
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <unordered_set>
+#include <RDFIndex.h>
 #include <utils.h>
 
+/**
+ * @brief One step of a left-deep physical plan
+ * 
+ * The plan's tree joins the rows produced by all earlier steps with the
+ * matches of this step's pattern, using the given operator. The first step
+ * just scans its pattern's matches. Alternatively, every step of a plan may
+ * use GENERIC_JOIN, in which case all patterns are joined at once.
+ */
+struct PlanStep {
+    TriplePattern pattern;
+    JoinMethod join;
+    // Estimated number of rows after this step
+    double rows;
+};
+
+/**
+ * @brief A planned query with its variables numbered by slot
+ * 
+ * Bindings are held in a row of resources indexed by slot, so evaluating the
+ * query needs no lookups by variable name.
+ */
+struct CompiledQuery {
+    // Patterns in evaluation order, with variables replaced by slots
+    std::vector<SlotPattern> patterns;
+    // Operator joining each pattern with those before it
+    std::vector<JoinMethod> joins;
+    // Slot of each selected variable, or NO_SLOT if in no pattern
+    std::vector<Slot> projection;
+    // Variable held in each slot
+    std::vector<Variable> slot_variables;
+};
+
 /**
  * @brief A single parsed SPARQL query
  * 
  * The Query class represents a single parsed BGP SPARQL query, also providing
- * query parsing and join order planning functionality.
+ * query parsing and physical planning functionality.
  * 
  * Member function documentation provided in implementation files
  * `c_query_plan.cpp` and `e_query_parse.cpp`.
@@ -29,10 +63,39 @@ class Query {
         Query(std::vector<Variable> v, std::vector<TriplePattern> p) :
             variables(v), patterns(p) {};
         static Query parse(std::string, std::function<Resource(std::string)>);
-        std::vector<TriplePattern> plan();
+        std::vector<PlanStep> plan(RDFIndex&,
+                                   const std::vector<Resource>& = {});
+        CompiledQuery compile(const std::vector<PlanStep>&) const;
+        static TriplePattern bind(TriplePattern,
+                                  const std::vector<Resource>&);
+        static void bind(CompiledQuery&, const std::vector<Resource>&);
 
     private:
-        static int _get_score(TriplePattern, std::unordered_set<Variable>);
+        // Relative costs of the join operators, per outer row probing the
+        // index, per row inserted into and probed against a hash table, and
+        // per row scanned and outer row stepped past in a merge
+        static constexpr double _PROBE_COST = 8;
+        static constexpr double _BUILD_COST = 2;
+        static constexpr double _HASH_PROBE_COST = 1;
+        static constexpr double _SCAN_COST = 1;
+        static constexpr double _MERGE_STEP_COST = 0.5;
+
+        // Estimated number of rows of a join, and of distinct bindings of
+        // each variable among them
+        struct _Estimate {
+            double rows;
+            std::unordered_map<Variable, double> distinct;
+            // Constant predicates of the patterns joined on each subject
+            // variable
+            std::unordered_map<Variable, std::vector<Resource>> stars;
+        };
+
+        static _Estimate _estimate_join(const _Estimate&,
+                                        const TriplePattern&, RDFIndex&);
+        static void _choose_joins(std::vector<PlanStep>&, RDFIndex&,
+                                  const std::vector<Resource>&);
+        static SlotPattern _constants_only(TriplePattern);
+        static bool _is_cyclic(const std::vector<TriplePattern>&);
         static Variable _parse_variable(std::string);
         static Term _parse_term(std::string,
                                 std::function<Resource(std::string)>);
@@ -1,44 +1,150 @@
 /**
  * @file RDFIndex.h
  * @author Candidate 1034792
- * @brief Declaration of the RDFIndex class
+ * @brief Declaration of the RDFIndex interface
  */
 #pragma once
 #include <functional>
-#include <optional>
-#include <tuple>
-#include <unordered_map>
+#include <memory>
+#include <string>
 #include <vector>
+#include <Snapshot.h>
 #include <utils.h>
 
+/**
+ * @brief Cardinality statistics of a set of triples
+ * 
+ * Kept for the triples with each predicate, and for all triples, for use by
+ * the query planner. The average fan-out from a subject is the number of
+ * triples over the number of distinct subjects, and similarly for objects.
+ */
+struct TripleStatistics {
+    // Number of triples, and of distinct subjects, predicates and objects
+    // among them
+    size_t triples = 0, subjects = 0, predicates = 0, objects = 0;
+};
+
 /**
  * @brief RDF indexing data structure
  * 
- * The RDFIndex class represents the indexing data structure for
- * storage of and access to RDF triples.
+ * The RDFIndex class is the interface to the indexing data structure for
+ * storage of and access to RDF triples. Two implementations are provided:
+ *  - `LinkedIndex`, the linked-list design from the paper (`a_index.cpp`)
+ *  - `PermutationIndex`, sorted SPO/POS/OSP permutation arrays
+ *          (`g_permutation_index.cpp`)
  * 
- * Member function documentation provided in implementation file `a_index.cpp`.
+ * Documentation of the factory and helper functions provided in
+ * implementation file `a_index.cpp`.
  */
 class RDFIndex {
     public:
-        ~RDFIndex();
-        void add(Resource, Resource, Resource);
-        std::function<std::optional<VariableMap>()> evaluate(Term, Term, Term);
-
-    private:
-        // Represents a single row in the triple table
-        struct _TableRow { 
-            Resource s, p, o;
-            _TableRow *next_SP, *next_OP, *next_P;
-        };
-
-        // Triple table
-        std::vector<_TableRow*> _table;
-        // Index structures as specified in the paper this is based on
-        std::unordered_map<Resource, _TableRow*> _index_S, _index_O, _index_P;
-        std::unordered_map<ResourcePair, _TableRow*> _index_SP, _index_OP;
-        std::unordered_map<ResourceTriple, _TableRow*> _index_SPO;
-        // Length counters for SP- and OP-lists
-        std::unordered_map<_TableRow*, size_t> _len_S, _len_O;
-
-};
\ No newline at end of file
+        // Default number of rows from which implementations that compress
+        // long lists compress them
+        static constexpr size_t COMPRESS_THRESHOLD = 1024;
+
+        virtual ~RDFIndex() = default;
+
+        /**
+         * @brief Adds a triple to the index structure, ignoring duplicates
+         */
+        virtual void add(Resource, Resource, Resource) = 0;
+        /**
+         * @brief Adds a batch of triples, ignoring duplicates
+         * 
+         * Implementations may build their structures in bulk, using up to
+         * the given number of threads. The batch may be reordered.
+         */
+        virtual void add_bulk(std::vector<ResourceTriple>& triples, int) {
+            for (auto [s, p, o] : triples) add(s, p, o);
+        }
+        /**
+         * @brief Creates a new index holding the index's triples and a
+         *      batch of triples, leaving the index itself unchanged
+         * 
+         * The batch may be reordered, and the given number of threads used
+         * as by add_bulk.
+         */
+        virtual std::unique_ptr<RDFIndex> extended(
+            std::vector<ResourceTriple>&, int) const = 0;
+        /**
+         * @brief Evaluates a triple pattern over the data in the index
+         * 
+         * Returns an iterator over all matches for the given triple pattern:
+         * each call writes the next match's bindings of the pattern's
+         * variables into their slots of the given row, returning false once
+         * no matches remain.
+         */
+        virtual std::function<bool()> evaluate(SlotTerm, SlotTerm, SlotTerm,
+                                               Resource*) = 0;
+        /**
+         * @brief Estimates the number of matches of a triple pattern
+         * 
+         * Used by the planner to cost joins, so must be cheap; repeated
+         * variables may be ignored.
+         */
+        virtual size_t estimate(SlotTerm, SlotTerm, SlotTerm) = 0;
+        /**
+         * @brief Counts the matches of a triple pattern exactly
+         * 
+         * Answered from stored list lengths where possible, rather than by
+         * enumerating the matches.
+         */
+        virtual size_t count(SlotTerm, SlotTerm, SlotTerm) = 0;
+        /**
+         * @brief Gets the position (0 to 2) of the term by whose bindings
+         *      the matches of a triple pattern are returned in ascending
+         *      order, or -1 if they are in no particular order
+         */
+        virtual int order(SlotTerm, SlotTerm, SlotTerm) { return -1; }
+        /**
+         * @brief Gets the statistics of all triples in the index
+         */
+        virtual TripleStatistics statistics() = 0;
+        /**
+         * @brief Gets the statistics of the triples with a given predicate
+         */
+        virtual TripleStatistics statistics(Resource) = 0;
+        /**
+         * @brief Estimates the number of matches of a subject star: one
+         *      pattern per given predicate, sharing a subject variable and
+         *      each with an object variable of its own
+         */
+        virtual double estimate_star(const std::vector<Resource>&) = 0;
+
+        /**
+         * @brief Brings up to date any structures computed lazily on reads
+         * 
+         * Afterwards, reads (evaluating and estimating patterns, and
+         * getting statistics) do not modify the index until it is next
+         * modified, so can be made from several threads at once.
+         */
+        virtual void prepare_reads() {}
+
+        /**
+         * @brief Reports the memory held by each of the index's structures
+         * 
+         * Appends one entry per structure, with the bytes its containers
+         * have allocated rather than an estimate from its size.
+         */
+        virtual void report_memory(std::vector<MemoryUsage>&) const = 0;
+
+        /**
+         * @brief Writes the index's sections of a snapshot
+         */
+        virtual void save(SnapshotWriter&) = 0;
+        /**
+         * @brief Loads the index from a snapshot, replacing its contents
+         * 
+         * Implementations may use the snapshot's sections in place rather
+         * than copying them, checking their checksums only if asked to.
+         * Afterwards the index can be read from several threads at once,
+         * as after RDFIndex::prepare_reads, which is not called on it.
+         */
+        virtual void open(const Snapshot&, bool verify, int threads) = 0;
+
+        static std::unique_ptr<RDFIndex> create(
+            std::string, size_t compress_threshold = COMPRESS_THRESHOLD);
+
+    protected:
+        static bool _local_slots(SlotTerm&, SlotTerm&, SlotTerm&);
+};
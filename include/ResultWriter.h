@@ -0,0 +1,51 @@
+/**
+ * @file ResultWriter.h
+ * @author Candidate 1034792
+ * @brief Declaration of the ResultWriter class
+ */
+#pragma once
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <BatchJoin.h>
+#include <Dictionary.h>
+#include <utils.h>
+
+/**
+ * @brief Buffered output of the results of a query
+ *
+ * The ResultWriter class prints the bindings of the selected variables of
+ * each row, tab-separated, one row per line. Resources are decoded from the
+ * dictionary straight into a large buffer, which is only written to the
+ * stream once full and when flushed, so that printing many rows costs
+ * neither a string per resource nor a write per row.
+ *
+ * The time spent decoding and writing is kept, so that it can be reported
+ * apart from the time spent on the joins.
+ *
+ * Member function documentation provided in implementation file
+ * `p_result_writer.cpp`.
+ */
+class ResultWriter {
+    public:
+        ResultWriter(std::ostream&, const Dictionary&,
+                     const std::vector<Slot>&);
+        void write(const Batch&);
+        void flush();
+        size_t rows() const { return _rows; }
+        std::chrono::steady_clock::duration time() const { return _time; }
+
+    private:
+        // Bytes buffered before writing to the stream
+        static constexpr size_t _BUFFER_BYTES = 1 << 20;
+
+        std::ostream& _out;
+        const Dictionary& _dictionary;
+        // Slot of each variable to print
+        std::vector<Slot> _projection;
+        std::string _buffer;
+        size_t _rows = 0;
+        // Time spent in write() and flush()
+        std::chrono::steady_clock::duration _time{0};
+};
@@ -0,0 +1,72 @@
+/**
+ * @file Server.h
+ * @author Candidate 1034792
+ * @brief Declaration of the Server class
+ */
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <System.h>
+#include <utils.h>
+
+/**
+ * @brief Local query server sharing one System between many clients
+ *
+ * The Server class listens on a Unix socket or a TCP port on the loopback
+ * interface, and serves each connection on one of a fixed pool of worker
+ * threads until the client closes it or sends `QUIT`. Connections waiting
+ * for a worker are queued; once the queue is full, new connections are
+ * answered `BUSY` and closed straight away, so that an overloaded server
+ * sheds clients rather than letting their latency grow without bound.
+ *
+ * Each request is a single line holding a command exactly as typed into
+ * the command line interface, such as `COUNT ?x WHERE { ... }`. Each response
+ * is a line holding a status, `OK` or `ERROR`, and the length in bytes of
+ * the body that follows, which holds what the command line interface
+ * would have printed, or just the error message if the command failed.
+ * Queries taking longer than the server's timeout are abandoned with an
+ * error, leaving the worker free for the next request, and connections
+ * idle for longer than the idle timeout are closed, so that clients that
+ * stop sending cannot hold on to every worker.
+ *
+ * Member function documentation provided in implementation file
+ * `o_server.cpp`.
+ */
+class Server {
+    public:
+        Server(System&, int, size_t, std::chrono::milliseconds,
+               std::chrono::milliseconds, bool);
+        void serve(const std::string&);
+        static int connect(const std::string&);
+        static std::string request(int, const std::string&, std::string&);
+
+    private:
+        // Longest request line accepted, in bytes
+        static constexpr size_t _MAX_LINE_BYTES = 1 << 20;
+
+        System& _system;
+        int _workers;
+        // Maximum number of connections waiting for a worker
+        size_t _queue_limit;
+        // Time allowed for each query, or zero for no limit
+        std::chrono::milliseconds _timeout;
+        // Time a connection may wait for a request or for the client to
+        // read a response, or zero for no limit
+        std::chrono::milliseconds _idle_timeout;
+        bool _output_join_order;
+        // Accepted connections waiting for a worker
+        std::deque<int> _waiting;
+        std::mutex _lock;
+        std::condition_variable _ready;
+
+        void _work();
+        void _serve_connection(int);
+        std::string _respond(const std::string&, bool&);
+        static int _listen(const std::string&);
+        static int _port(const std::string&);
+        static bool _send(int, const std::string&);
+        static bool _read_line(int, std::string&, std::string&);
+};
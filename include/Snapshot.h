@@ -0,0 +1,102 @@
+/**
+ * @file Snapshot.h
+ * @author Candidate 1034792
+ * @brief Declaration of the Snapshot and SnapshotWriter classes
+ */
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ArrayView.h>
+#include <MappedFile.h>
+
+// Sections of a snapshot file
+enum SnapshotSection : uint32_t {
+    DICTIONARY_OFFSETS, DICTIONARY_STRINGS, DICTIONARY_PREFIX_OFFSETS,
+    DICTIONARY_PREFIXES, DICTIONARY_PREFIX_SLOTS, DICTIONARY_SLOT_OFFSETS,
+    DICTIONARY_SLOTS, DICTIONARY_SHARD_SIZES,
+    SPO_OFFSETS, SPO_PAIRS, POS_OFFSETS, POS_PAIRS, OSP_OFFSETS, OSP_PAIRS,
+    STATISTICS, STATISTICS_PREDICATES, PREDICATE_STATISTICS,
+    CHARACTERISTIC_SETS,
+    NUM_SNAPSHOT_SECTIONS
+};
+
+/**
+ * @brief Binary image of the system's state, mapped from a file
+ *
+ * A snapshot file starts with a header listing its sections, each holding
+ * one array and starting on a page boundary so that it can be used in place
+ * without copying. The header carries a checksum of itself and of every
+ * section. Only the header is read when opening a snapshot; sections are
+ * read from disk as they are accessed.
+ *
+ * Member function documentation provided in implementation file
+ * `i_snapshot.cpp`.
+ */
+class Snapshot {
+    public:
+        Snapshot(std::string);
+
+        /**
+         * @brief Gets the array held in a section
+         *
+         * @tparam T Element type of the array
+         * @param id Section to get
+         * @param verify Whether to check the section's checksum, which
+         *      requires reading all of it
+         * @return ArrayView<T> View of the array within the mapped file
+         */
+        template <class T>
+        ArrayView<T> section(SnapshotSection id, bool verify) const {
+            std::string_view bytes = _section(id, verify);
+            return ArrayView<T>(reinterpret_cast<const T*>(bytes.data()),
+                                bytes.size() / sizeof(T));
+        }
+        // Keeps the file mapped for as long as any views into it are used
+        std::shared_ptr<MappedFile> mapping() const { return _file; }
+
+    private:
+        std::shared_ptr<MappedFile> _file;
+        std::string_view _section(SnapshotSection, bool) const;
+};
+
+/**
+ * @brief Writer for the snapshot file format read by the Snapshot class
+ *
+ * The file is written under a temporary name in the same directory and only
+ * renamed over the target once complete, so that a failed write leaves any
+ * existing file intact, as do the mappings of it still in use.
+ *
+ * Member function documentation provided in implementation file
+ * `i_snapshot.cpp`.
+ */
+class SnapshotWriter {
+    public:
+        SnapshotWriter(std::string);
+        ~SnapshotWriter();
+        SnapshotWriter(const SnapshotWriter&) = delete;
+        SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+        /**
+         * @brief Writes an array as the contents of a section
+         *
+         * @tparam T Element type of the array, must be trivially copyable
+         * @param id Section to write
+         * @param data Array to write
+         */
+        template <class T>
+        void write(SnapshotSection id, ArrayView<T> data) {
+            _write(id, reinterpret_cast<const char*>(data.data()),
+                   data.size() * sizeof(T));
+        }
+        void finish();
+
+    private:
+        std::string _filename, _temporary;
+        std::ofstream _out;
+        bool _finished = false;
+        std::vector<uint64_t> _offsets, _lengths, _checksums;
+        void _write(SnapshotSection, const char*, size_t);
+};
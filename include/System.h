@@ -4,9 +4,21 @@
  * @brief Declaration of the System class
  */
 #pragma once
+#include <chrono>
 #include <functional>
-#include <optional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <BatchJoin.h>
+#include <Dictionary.h>
+#include <MappedFile.h>
+#include <Query.h>
 #include <RDFIndex.h>
+#include <ThreadPool.h>
 #include <utils.h>
 
 /**
@@ -17,28 +29,144 @@
  * providing logic for query evaluation, triple loading
  * and resource encoding/decoding.
  * 
+ * The dictionary and index are kept together in immutable versions. Each
+ * command that changes them (`LOAD` and `OPEN`) builds a new version aside
+ * and publishes it atomically once complete, one such command at a time,
+ * so a failed command leaves the current version as it was. Queries take
+ * the current version when they start and read it throughout, so they can
+ * run on other threads at the same time as each other and as a `LOAD`,
+ * without taking any locks.
+ * 
+ * Parsed and planned queries are kept in a cache keyed by their text with
+ * whitespace normalised, so a query seen before is neither parsed nor
+ * planned again. Plans depend on the contents of the store, so each is
+ * only used with the version it was planned for, and re-planned once a new
+ * version is published. Queries can also be prepared under a name, with
+ * parameters `$1`, `$2` and so on in place of some resources, and then
+ * executed with different resources each time; their plans are cached
+ * too, planned for the resources they were first executed with.
+ * 
+ * Queries evaluated on several threads share one pool of worker threads,
+ * started with the system, so concurrent queries add no threads beyond
+ * their own.
+ * 
  * Member function documentation provided in implementation files
- * `b_query_evaluate.cpp` and `d_turtle_parse.cpp`.
+ * `b_query_evaluate.cpp`, `d_turtle_parse.cpp`, `h_bulk_load.cpp`,
+ * `i_snapshot.cpp`, `o_server.cpp` and `t_memory_report.cpp`.
  */
 class System {
     public:
-        void evaluate_query(std::string, bool, bool);
-        void load_triples(std::string);
+        System(std::string index_type = "linked", int threads = 1,
+               size_t compress_threshold = RDFIndex::COMPRESS_THRESHOLD) :
+            _index_type(index_type), _threads(threads),
+            _compress_threshold(compress_threshold), _pool(threads) {
+            auto version = std::make_shared<_Version>();
+            version->index = RDFIndex::create(index_type,
+                                              compress_threshold);
+            _version = std::move(version);
+        };
+        bool execute(Command, std::string, std::ostream&, bool, Deadline);
+        void evaluate_query(std::string, bool, bool, std::ostream&, Deadline);
+        void prepare_query(std::string, std::ostream&);
+        void execute_query(std::string, bool, std::ostream&, Deadline);
+        void explain_query(std::string, std::ostream&, Deadline);
+        void load_triples(const MappedFile&, std::ostream&);
+        void save_snapshot(std::string, std::ostream&);
+        void open_snapshot(std::string, bool, std::ostream&);
+        void report_memory(std::string, std::ostream&);
+        void redirect_results(std::ostream* results) { _results = results; }
 
     private:
-        // RDF triple storage index
-        RDFIndex _index; 
-        // Counter for use when evaluating queries
-        int _result_counter; 
-        // Int-to-string and string-to-int resource maps
-        std::vector<std::string> _stored_resources;
-        std::unordered_map<std::string, Resource> _resource_ids;
-
-        void _nested_index_loop_join(VariableMap&, int, bool,
-                                     std::vector<TriplePattern>,
-                                     std::vector<Variable>);
-        void _print_mapped_values(VariableMap, std::vector<Variable>);
-        Resource _encode_resource(std::string);
-        std::string _decode_resource(Resource);
-        std::string _term_to_string(Term);
+        // Bytes of input processed between releases of mapped file pages
+        static constexpr size_t _RELEASE_BYTES = 1 << 26;
+        // Bytes of input given to each thread per round of a parallel load
+        static constexpr size_t _PARALLEL_CHUNK_BYTES = 1 << 24;
+        // Number of plans cached before the cache is emptied
+        static constexpr size_t _PLAN_CACHE_SIZE = 4096;
+
+        // Text and partially encoded triples of one thread's share of a
+        // parallel load; see `h_bulk_load.cpp`
+        struct _LoadChunk;
+
+        // One version of the store's contents, never modified once published
+        struct _Version {
+            // Two-way mapping between resource URIs and integer IDs
+            Dictionary dictionary;
+            // RDF triple storage index, prepared for concurrent reads
+            std::unique_ptr<RDFIndex> index;
+            // Number of versions published before this one
+            size_t generation = 0;
+        };
+
+        // Parsed and planned query, valid for one version
+        struct _CachedPlan {
+            // Generation of the version the query was planned for
+            size_t generation;
+            // Number of parameters the query was planned with
+            size_t parameters;
+            Query query;
+            std::vector<PlanStep> plan;
+            CompiledQuery compiled;
+            // Whether the query is evaluated by a ParallelJoin
+            bool parallel;
+        };
+
+        // Query prepared under a name
+        struct _PreparedQuery {
+            // Query text, with whitespace normalised
+            std::string text;
+            // Whether results are printed, as for `SELECT`, or just counted
+            bool print;
+            size_t parameters;
+        };
+
+        // Name of the index implementation
+        std::string _index_type;
+        // Number of threads to use for loading, index building and query
+        // evaluation
+        int _threads;
+        // Number of rows from which the index compresses lists, or 0
+        size_t _compress_threshold;
+        // Worker threads evaluating queries in parallel; each query runs on
+        // at most _threads threads, counting its own
+        ThreadPool _pool;
+        // Current version, only accessed through std::atomic_load and
+        // std::atomic_store
+        std::shared_ptr<const _Version> _version;
+        // Held while building and publishing a new version
+        std::mutex _write_lock;
+        // Cached plans by query text
+        std::unordered_map<std::string,
+                           std::shared_ptr<const _CachedPlan>> _plans;
+        std::unordered_map<std::string, _PreparedQuery> _prepared;
+        // Number of cache lookups, and of those finding a valid plan
+        size_t _plan_lookups = 0, _plan_hits = 0;
+        // Held while accessing the plan cache and prepared queries
+        std::mutex _cache_lock;
+        // Stream to print the results of queries to instead of their
+        // output stream, if any
+        std::ostream* _results = nullptr;
+
+        void _publish(std::shared_ptr<_Version>);
+        std::shared_ptr<const _CachedPlan> _find_plan(
+            const _Version&, const std::string&,
+            const std::vector<Resource>&, bool&);
+        void _run_plan(const _Version&, const _CachedPlan&,
+                       const std::vector<Resource>&, bool, bool, bool,
+                       std::ostream&, Deadline,
+                       std::chrono::high_resolution_clock::time_point);
+        void _load_sequential(const MappedFile&, Dictionary&,
+                              std::vector<ResourceTriple>&);
+        void _load_parallel(const MappedFile&, Dictionary&,
+                            std::vector<ResourceTriple>&);
+        void _encode_chunks(std::vector<_LoadChunk>&, Dictionary&);
+        static Resource _encode_resource(Dictionary&, std::string_view);
+        static void _check_resource(std::string_view);
+        static std::string_view _next_word(std::string_view, size_t&);
+        static std::string _decode_resource(const Dictionary&, Resource);
+        static std::string _term_to_string(const Dictionary&, Term);
+        static std::string _pattern_to_string(const Dictionary&,
+                                              TriplePattern);
+        static std::string _normalise(const std::string&);
+        static size_t _parameter_number(const std::string&);
 };
\ No newline at end of file
@@ -0,0 +1,83 @@
+/**
+ * @file ThreadPool.h
+ * @author Candidate 1034792
+ * @brief Declaration of the ThreadPool class
+ */
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed pool of worker threads running jobs made of many tasks
+ *
+ * A job is a number of tasks identified by their index, run by the thread
+ * submitting it together with as many idle workers as it asks for. Each
+ * thread taking part in a job starts with an equal share of its tasks and
+ * takes them in order, then steals the last tasks of others once it runs
+ * out, so that threads stay busy however unevenly the work is spread.
+ *
+ * Several threads can submit jobs at once, and idle workers join the
+ * oldest job still short of threads. Since the submitting thread takes
+ * part in its own job, every job finishes even while all workers are busy
+ * with others, and no more threads run than the workers and the threads
+ * submitting jobs.
+ *
+ * Member function documentation provided in implementation file
+ * `u_thread_pool.cpp`.
+ */
+class ThreadPool {
+    public:
+        // Function running one task of a job, given the number of the
+        // thread running it within the job and the index of the task
+        using Task = std::function<void(size_t, size_t)>;
+
+        explicit ThreadPool(int);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Gets the number of threads a job can run on, counting the
+         *      thread submitting it
+         */
+        int size() const { return _workers.size() + 1; }
+        void run(size_t, int, const Task&);
+
+    private:
+        // Tasks left to one thread of a job, taken from the front by the
+        // thread itself and from the back by others
+        struct _Queue {
+            std::mutex lock;
+            size_t front = 0, back = 0;
+        };
+
+        // Job submitted by a call to ThreadPool::run, which owns it
+        struct _Job {
+            const Task* task;
+            std::vector<_Queue> queues;
+            // Number of threads that have joined the job and of those that
+            // have finished their part, and the first exception thrown by
+            // a task; all guarded by the pool's lock
+            size_t joined = 0, finished = 0;
+            std::exception_ptr error;
+        };
+
+        std::vector<std::thread> _workers;
+        // Jobs more threads can still join, oldest first
+        std::deque<_Job*> _jobs;
+        bool _stopping = false;
+        std::mutex _lock;
+        // Notified when a job is submitted, and when a worker finishes its
+        // part of a job
+        std::condition_variable _submitted, _finished;
+
+        void _work();
+        static std::exception_ptr _take_part(_Job&, size_t);
+        static bool _next(_Job&, size_t, size_t&);
+};
@@ -9,11 +9,15 @@
  * Utility function documentation provided in implementation file `utils.cpp`.
  */
 #pragma once
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <string>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>
+#include <vector>
 
 // Types
 using Resource = int;
@@ -22,31 +26,110 @@ using Term = std::variant<Variable, Resource>;
 using ResourcePair = std::tuple<Resource, Resource>;
 using ResourceTriple = std::tuple<Resource, Resource, Resource>;
 using TriplePattern = std::tuple<Term, Term, Term>;
-using VariableMap = std::unordered_map<Variable, Resource>;
+// Position of a variable's binding within a row of bindings
+using Slot = int;
+// Term with its variable, if any, replaced by a slot: the slot of a
+// variable, or NO_SLOT alongside a resource
+struct SlotTerm {
+    Slot slot;
+    Resource resource;
+};
+using SlotPattern = std::tuple<SlotTerm, SlotTerm, SlotTerm>;
+// Time by which a query must finish
+using Deadline = std::chrono::steady_clock::time_point;
+// Memory held by one of the store's structures, as reported by `MEMORY`
+struct MemoryUsage {
+    std::string name;
+    // Number of entries, such as rows, resources or hash-map keys
+    size_t entries;
+    // Bytes allocated, including spare capacity and empty hash-map slots
+    size_t bytes;
+    // Bytes used in place from a mapped snapshot file instead
+    size_t mapped_bytes;
+};
 
 // Special constants
 const Resource INVALID_RESOURCE = -1;
 const Term INVALID_TERM = Term{INVALID_RESOURCE};
+const Slot NO_SLOT = -1;
+// Resource standing for the first parameter of a prepared query, with each
+// further parameter numbered one lower
+const Resource FIRST_PARAMETER = -2;
+const Deadline NO_DEADLINE = Deadline::max();
 const TriplePattern INVALID_PATTERN = std::make_tuple(INVALID_TERM,
                                                       INVALID_TERM,
                                                       INVALID_TERM);
 
 // Enumerations
 enum PatternType {XYZ, SYZ, XPZ, XYO, SPZ, SYO, XPO, SPO};
-enum Command {LOAD, SELECT, COUNT, QUIT};
+enum JoinMethod {NESTED_LOOP, HASH_JOIN, MERGE_JOIN, GENERIC_JOIN};
+enum Command {LOAD, SELECT, COUNT, SAVE, OPEN, PREPARE, EXECUTE, EXPLAIN,
+              MEMORY, QUIT};
 const std::unordered_map<std::string,Command> which_command({
     {"LOAD", Command::LOAD}, {"SELECT", Command::SELECT},
-    {"COUNT", Command::COUNT}, {"QUIT", Command::QUIT}
+    {"COUNT", Command::COUNT}, {"SAVE", Command::SAVE},
+    {"OPEN", Command::OPEN}, {"PREPARE", Command::PREPARE},
+    {"EXECUTE", Command::EXECUTE}, {"EXPLAIN", Command::EXPLAIN},
+    {"MEMORY", Command::MEMORY}, {"QUIT", Command::QUIT}
 });
 
 // Utility functions - see implementation file `utils.cpp`
 namespace utils {
 
 PatternType get_pattern_type(TriplePattern);
-Term apply_map(VariableMap, Term);
+PatternType get_pattern_type(SlotPattern);
 std::unordered_set<Variable> get_variables(TriplePattern);
 template <class T> std::unordered_set<T> intersect(std::unordered_set<T>,
                                                    std::unordered_set<T>);
+void parallel_for(size_t, int, std::function<void(size_t)>);
+void check_deadline(Deadline);
+
+/**
+ * @brief Gets the bytes allocated by a node-based hash-map
+ * 
+ * Counts the bucket array and one node per entry, each node holding the
+ * entry, a link to the next node and the entry's hash; libstdc++ only
+ * caches the hash for some hash functions, so this may overcount by a word
+ * per entry. Heap memory owned by the entries themselves is not included.
+ * 
+ * @param map Hash-map to measure
+ * @return size_t Bytes allocated by the hash-map
+ */
+template <class Map>
+size_t node_map_bytes(const Map& map) {
+    size_t node = sizeof(typename Map::value_type) + 2 * sizeof(void*);
+    return map.bucket_count() * sizeof(void*) + map.size() * node;
+}
+
+/**
+ * @brief Sorts a vector using several threads
+ * 
+ * Sorts equal slices of the vector in parallel, then merges them pairwise.
+ * Defined here rather than in `utils.cpp` as it is a template over the
+ * comparison function.
+ * 
+ * @param v Vector to sort
+ * @param threads Maximum number of threads to use
+ * @param less Strict weak ordering on the elements
+ */
+template <class T, class Compare>
+void parallel_sort(std::vector<T>& v, int threads, Compare less) {
+    size_t slices = std::max(1, std::min<int>(threads, v.size() / 4096 + 1));
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= slices; i++) bounds.push_back(v.size()*i/slices);
+    parallel_for(slices, threads, [&](size_t i) {
+        std::sort(v.begin()+bounds[i], v.begin()+bounds[i+1], less); });
+    for (size_t width = 1; width < slices; width *= 2) {
+        parallel_for((slices + 2*width - 1) / (2*width), threads,
+                     [&](size_t k) {
+            size_t lo = 2*width*k, mid = lo+width;
+            size_t hi = std::min(mid+width, slices);
+            if (mid < slices)
+                std::inplace_merge(v.begin()+bounds[lo], v.begin()+bounds[mid],
+                                   v.begin()+bounds[hi], less);
+        });
+    }
+}
 
 }
 
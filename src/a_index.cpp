@@ -4,14 +4,62 @@
  * @brief Implementation component (a)
  * 
  * RDF indexing data structure that implements Add and Evaluate functions.
- * Full implementation of the RDFIndex class.
+ * Full implementation of the LinkedIndex class, and the RDFIndex factory.
  */
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <LinkedIndex.h>
+#include <PermutationIndex.h>
+#include <PostingList.h>
 #include <RDFIndex.h>
 #include <utils.h>
 
+/**
+ * @brief Constructs an empty index using the named implementation
+ * 
+ * @param type Either `linked` (the linked-list index from the paper) or
+ *      `permutation` (sorted SPO/POS/OSP permutation arrays)
+ * @param compress_threshold Number of rows from which the linked index
+ *      keeps compressed copies of its lists, or 0 for none
+ * @return std::unique_ptr<RDFIndex> The new index
+ */
+std::unique_ptr<RDFIndex> RDFIndex::create(std::string type,
+                                           size_t compress_threshold) {
+    if (type == "linked")
+        return std::make_unique<LinkedIndex>(compress_threshold);
+    if (type == "permutation") return std::make_unique<PermutationIndex>();
+    throw std::invalid_argument("Unknown index type " + type);
+}
+
+/**
+ * @brief Helper function to number the variables of a pattern by position
+ *      of first occurrence, so that a row of three bindings can hold them
+ * 
+ * @param a Subject term, modified in place
+ * @param b Predicate term, modified in place
+ * @param c Object term, modified in place
+ * @return bool Whether a variable occurs more than once
+ */
+bool RDFIndex::_local_slots(SlotTerm& a, SlotTerm& b, SlotTerm& c) {
+    Slot slots[] = {a.slot, b.slot, c.slot};
+    bool repeated = false;
+    SlotTerm* terms[] = {&a, &b, &c};
+    for (int k = 0; k < 3; k++) {
+        if (slots[k] == NO_SLOT) continue;
+        Slot first = std::find(slots, slots+3, slots[k]) - slots;
+        repeated |= first < k;
+        terms[k]->slot = first;
+    }
+    return repeated;
+}
+
 /**
  * @brief Adds a triple to the index structure
  * 
@@ -22,213 +70,858 @@
  * @param p Predicate resource
  * @param o Object resource
  */
-void RDFIndex::add(Resource s, Resource p, Resource o) {
-    // Only proceed if not already present
-    try {_index_SPO.at(std::make_tuple(s, p, o));}
-    catch (std::out_of_range _) {
-        // Add new table row and update _index_SPO
-        _TableRow* new_row = new _TableRow{s, p, o};
-        _table.push_back(new_row);
-        _index_SPO[std::make_tuple(s, p, o)] = new_row;
-        
-        // Update SP-list and _index_SP, _index_S
-        try {
-            // Insert new_row just after first p-item in SP-list
-            _TableRow* row = _index_SP.at(std::make_tuple(s, p));
-            new_row->next_SP = row->next_SP;
-            row->next_SP = new_row;
-        } catch (std::out_of_range _) {
-            // Insert new_row at head of SP-list
-            new_row->next_SP = _index_S[s]; // Potentially null
-            _index_S[s] = new_row;
-            _index_SP[std::make_tuple(s,p)] = new_row;
-        }
-        _len_S[_index_S.at(s)]++;
-
-        // Update OP-list and _index_OP, _index_O
-        try {
-            // Insert new_row just after first p-item in OP-list
-            _TableRow* row = _index_OP.at(std::make_tuple(o, p));
-            new_row->next_OP = row->next_OP;
-            row->next_OP = new_row;
-        } catch (std::out_of_range _) {
-            // Insert new_row at head of OP-list
-            new_row->next_OP = _index_O[o]; // Potentially null
-            _index_O[o] = new_row;
-            _index_OP[std::make_tuple(o,p)] = new_row;
+void LinkedIndex::add(Resource s, Resource p, Resource o) {
+    // Only proceed if not already present, otherwise update _index_SPO
+    _RowId new_id = _rows;
+    if (new_id == _NO_ROW)
+        throw std::invalid_argument("Too many triples for the index");
+    if (!_index_SPO.insert(pack_key(s, p, o), new_id).second)
+        return;
+    // Add new table row
+    _append(_TableRow{s, p, o, _NO_ROW, _NO_ROW, _NO_ROW});
+    _TableRow& new_row = _table[new_id];
+
+    // Update SP-list and _index_SP, _index_S
+    auto [sp, new_sp] = _index_SP.insert(pack_key(s, p), new_id);
+    if (!new_sp) {
+        // Insert new_row just after first p-item in SP-list, which earlier
+        // versions sharing the row may be walking
+        _TableRow& row = _table[*sp];
+        new_row.next_SP = row.next_SP;
+        __atomic_store_n(&row.next_SP, new_id, __ATOMIC_RELEASE);
+    } else {
+        // Insert new_row at head of SP-list
+        _RowId& head = *_index_S.try_emplace(pack_key(s), _NO_ROW).first;
+        new_row.next_SP = head; // Potentially _NO_ROW
+        head = new_id;
+    }
+    _len_S[pack_key(s)]++;
+    _len_SP[pack_key(s, p)]++;
+    TripleStatistics& stats = _stats_P[pack_key(p)];
+    stats.subjects += new_sp;
+
+    // Move the subject to its new characteristic set if p is new to it,
+    // taking its other triples with each predicate of its current set from
+    // the p-group lengths
+    if (new_sp) {
+        CharacteristicSets::Counts counts;
+        for (Resource q : _sets.predicates(s))
+            counts.emplace_back(q, *_len_SP.find(pack_key(s, q)));
+        _sets.extend(s, p, counts);
+    } else {
+        _sets.add(s, p);
+    }
+
+    // Update OP-list and _index_OP, _index_O
+    auto [op, new_op] = _index_OP.insert(pack_key(o, p), new_id);
+    if (!new_op) {
+        // Insert new_row just after first p-item in OP-list
+        _TableRow& row = _table[*op];
+        new_row.next_OP = row.next_OP;
+        __atomic_store_n(&row.next_OP, new_id, __ATOMIC_RELEASE);
+    } else {
+        // Insert new_row at head of OP-list
+        _RowId& head = *_index_O.try_emplace(pack_key(o), _NO_ROW).first;
+        new_row.next_OP = head; // Potentially _NO_ROW
+        head = new_id;
+    }
+    size_t length_O = ++_len_O[pack_key(o)];
+    size_t length_OP = ++_len_OP[pack_key(o, p)];
+    stats.objects += new_op;
+
+    // Insert new row at head of P-list and update _index_P
+    _RowId& head = *_index_P.try_emplace(pack_key(p), _NO_ROW).first;
+    new_row.next_P = head; // Potentially _NO_ROW
+    head = new_id;
+    stats.triples++;
+
+    // Compressed copies of the lists the new row joined are now out of date
+    _outdate(_postings_P, pack_key(p), stats.triples);
+    _outdate(_postings_O, pack_key(o), length_O);
+    _outdate(_postings_OP, pack_key(o, p), length_OP);
+}
+
+/**
+ * @brief Adds a batch of triples to the index structure
+ * 
+ * If the batch is at least as large as the existing contents of the index,
+ * the whole index is rebuilt from scratch by LinkedIndex::_build, which is
+ * much faster than adding the triples one at a time. Otherwise the triples
+ * are added one at a time by LinkedIndex::add.
+ * 
+ * @param triples Triples to add, possibly including duplicates; may be
+ *      reordered
+ * @param threads Number of threads to use
+ */
+void LinkedIndex::add_bulk(std::vector<ResourceTriple>& triples, int threads) {
+    if (triples.size() < _rows) {
+        for (auto [s, p, o] : triples) add(s, p, o);
+        return;
+    }
+    triples.reserve(triples.size() + _rows);
+    for (size_t i = 0; i < _rows; i++)
+        triples.emplace_back(_table[i].s, _table[i].p, _table[i].o);
+    _build(triples, threads);
+}
+
+/**
+ * @brief Creates a new index holding the index's triples and a batch of
+ *      triples, leaving the index itself unchanged
+ * 
+ * As for LinkedIndex::add_bulk, the new index is built from scratch if the
+ * batch is at least as large as the index. Otherwise the new index shares
+ * the triple table, the hash-map pages and the compressed lists with the
+ * index, and the triples are added to it one at a time, copying only the
+ * pages they change. Rows are appended to the shared table past those of
+ * the index, which skips them; see LinkedIndex::_reserve_rows.
+ * 
+ * @param triples Triples to add, possibly including duplicates; may be
+ *      reordered
+ * @param threads Number of threads to use
+ * @return std::unique_ptr<RDFIndex> The new index
+ */
+std::unique_ptr<RDFIndex> LinkedIndex::extended(
+        std::vector<ResourceTriple>& triples, int threads) const {
+    auto next = std::make_unique<LinkedIndex>(_compress_threshold);
+    if (triples.size() < _rows) {
+        next->_arena = _arena;
+        next->_table = _table;
+        next->_rows = _rows;
+        next->_reserve_rows(_rows + triples.size());
+        next->_index_S = _index_S;
+        next->_index_O = _index_O;
+        next->_index_P = _index_P;
+        next->_index_SP = _index_SP;
+        next->_index_OP = _index_OP;
+        next->_index_SPO = _index_SPO;
+        next->_len_S = _len_S;
+        next->_len_O = _len_O;
+        next->_len_SP = _len_SP;
+        next->_len_OP = _len_OP;
+        next->_stats_P = _stats_P;
+        next->_sets = _sets;
+        next->_postings = _postings;
+        next->_postings_P = _postings_P;
+        next->_postings_O = _postings_O;
+        next->_postings_OP = _postings_OP;
+        next->_compressed_rows = _compressed_rows;
+        for (auto [s, p, o] : triples) next->add(s, p, o);
+    } else {
+        triples.reserve(triples.size() + _rows);
+        for (size_t i = 0; i < _rows; i++)
+            triples.emplace_back(_table[i].s, _table[i].p, _table[i].o);
+        next->_build(triples, threads);
+    }
+    return next;
+}
+
+/**
+ * @brief Helper function to append a row to the triple table
+ * 
+ * @param row Row to append, whose position is `_rows`
+ */
+void LinkedIndex::_append(const _TableRow& row) {
+    if (_arena->size() != _rows ||
+        (_arena.use_count() > 1 && _rows == _arena->capacity()))
+        _reserve_rows(_rows + 1);
+    _arena->push_back(row);
+    _table = _arena->data();
+    _rows++;
+}
+
+/**
+ * @brief Helper function to make space for a number of rows in the triple
+ *      table, without moving a table other versions share
+ * 
+ * The table is appended to in place while this version holds all of its
+ * rows, so long as it has space or no other version shares it, since
+ * growing moves it. Otherwise this version's rows are copied into a table
+ * of its own with twice the space, so that copies are rare, following
+ * links past the rows of other versions as LinkedIndex::_next does.
+ * 
+ * @param rows Number of rows to make space for
+ */
+void LinkedIndex::_reserve_rows(size_t rows) {
+    if (_arena->size() == _rows &&
+        (rows <= _arena->capacity() || _arena.use_count() == 1)) {
+        _arena->reserve(rows);
+        _table = _arena->data();
+        return;
+    }
+    auto arena = std::make_shared<Arena<_TableRow>>(
+        std::max(rows, 2 * (size_t) _rows));
+    for (_RowId i = 0; i < _rows; i++) {
+        _TableRow row = _table[i];
+        row.next_SP = _next(_table[i], &_TableRow::next_SP);
+        row.next_OP = _next(_table[i], &_TableRow::next_OP);
+        arena->push_back(row);
+    }
+    _arena = std::move(arena);
+    _table = _arena->data();
+}
+
+/**
+ * @brief Reports the memory held by each of the index's structures
+ * 
+ * The triple table's bytes are those of the arena's committed pages, and
+ * each hash-map's those of its slot and control arrays, including empty
+ * slots. The compressed lists include the hash-maps locating them. Pages
+ * and lists shared with other versions are counted in full.
+ * 
+ * @param usage Vector to append one entry per structure to
+ */
+void LinkedIndex::report_memory(std::vector<MemoryUsage>& usage) const {
+    usage.push_back(MemoryUsage{"index.table", _rows,
+                                _arena->committed_bytes(), 0});
+    auto add = [&](const char* name, const auto& map) {
+        usage.push_back(MemoryUsage{name, map.size(), map.memory_usage(),
+                                    0}); };
+    add("index.index_S", _index_S);
+    add("index.index_O", _index_O);
+    add("index.index_P", _index_P);
+    add("index.index_SP", _index_SP);
+    add("index.index_OP", _index_OP);
+    add("index.index_SPO", _index_SPO);
+    add("index.len_S", _len_S);
+    add("index.len_O", _len_O);
+    add("index.len_SP", _len_SP);
+    add("index.len_OP", _len_OP);
+    add("index.stats_P", _stats_P);
+    usage.push_back(MemoryUsage{"index.characteristic_sets", _sets.size(),
+                                _sets.memory_usage(), 0});
+    size_t bytes = _postings.capacity() * sizeof(_Postings) +
+                   _postings_P.memory_usage() + _postings_O.memory_usage() +
+                   _postings_OP.memory_usage();
+    for (const _Postings& postings : _postings)
+        bytes += postings.list->memory_usage();
+    usage.push_back(MemoryUsage{"index.compressed_lists", _postings.size(),
+                                bytes, 0});
+}
+
+/**
+ * @brief Writes the index's sections of a snapshot
+ * 
+ * Snapshots store triples as sorted permutations, so that they can be used
+ * in place by PermutationIndex; these are built from the triple table.
+ * 
+ * @param writer Snapshot being written
+ */
+void LinkedIndex::save(SnapshotWriter& writer) {
+    std::vector<ResourceTriple> triples;
+    triples.reserve(_rows);
+    for (size_t i = 0; i < _rows; i++)
+        triples.emplace_back(_table[i].s, _table[i].p, _table[i].o);
+    PermutationIndex permutations;
+    permutations.add_bulk(triples, 1);
+    permutations.save(writer);
+}
+
+/**
+ * @brief Replaces the contents of the index with the triples in a snapshot
+ * 
+ * The index is rebuilt in bulk from the snapshot's SPO permutation, and
+ * its long lists compressed.
+ * 
+ * @param snapshot Snapshot to open
+ * @param verify Unused: the checksums of the sections read are always
+ *      checked since they are read in full anyway
+ * @param threads Number of threads to use
+ */
+void LinkedIndex::open(const Snapshot& snapshot, bool, int threads) {
+    auto offsets = snapshot.section<uint32_t>(SPO_OFFSETS, true);
+    auto pairs = snapshot.section<std::array<Resource, 2>>(SPO_PAIRS, true);
+    std::vector<ResourceTriple> triples;
+    triples.reserve(pairs.size());
+    for (size_t s = 0; s+1 < offsets.size(); s++) {
+        if (offsets[s+1] < offsets[s] || offsets[s+1] > pairs.size())
+            throw std::invalid_argument("Snapshot index is corrupt");
+        for (uint32_t i = offsets[s]; i < offsets[s+1]; i++)
+            triples.emplace_back(s, pairs[i][0], pairs[i][1]);
+    }
+    _build(triples, threads);
+    prepare_reads();
+}
+
+/**
+ * @brief Rebuilds the index structure to hold exactly the given triples
+ * 
+ * Sorts and deduplicates the triples, then lays them out in the triple table
+ * in SPO order so that every SP-list is already contiguous. The OP- and
+ * P-lists are threaded through the table by sorting row positions, and each
+ * list and its part of the hash-map indexes is built by its own thread in a
+ * single sequential pass. The resulting lists satisfy the same invariants as
+ * those built by LinkedIndex::add, which may be used afterwards. Lists long
+ * enough to compress are registered for LinkedIndex::prepare_reads to
+ * compress.
+ * 
+ * @param triples Triples to store, possibly including duplicates; will be
+ *      reordered
+ * @param threads Number of threads to use for sorting
+ */
+void LinkedIndex::_build(std::vector<ResourceTriple>& triples, int threads) {
+    utils::parallel_sort(triples, threads, std::less<ResourceTriple>());
+    triples.erase(std::unique(triples.begin(), triples.end()), triples.end());
+    if (triples.size() >= _NO_ROW)
+        throw std::invalid_argument("Too many triples for the index");
+
+    // Lay out the triple table in SPO order, in a table of its own with
+    // address space for as many rows again, so that the versions extended
+    // from this one can share it
+    _arena = std::make_shared<Arena<_TableRow>>(2 * triples.size());
+    for (auto [s, p, o] : triples)
+        _arena->push_back(_TableRow{s, p, o, _NO_ROW, _NO_ROW, _NO_ROW});
+    _table = _arena->data();
+    _RowId n = _rows = triples.size();
+    triples.clear();
+    triples.shrink_to_fit();
+    for (auto* index : {&_index_S, &_index_O, &_index_P}) index->clear();
+    _index_SP.clear();
+    _index_OP.clear();
+    _index_SPO.clear();
+    _len_S.clear();
+    _len_O.clear();
+    _len_SP.clear();
+    _len_OP.clear();
+    _stats_P.clear();
+    _sets.clear();
+    _postings.clear();
+    for (auto* postings : {&_postings_P, &_postings_O, &_postings_OP})
+        postings->clear();
+    _compressed_rows = 0;
+
+    // Row positions in OP- and P-list order
+    std::vector<_RowId> by_OP(n), by_P(n);
+    for (_RowId i = 0; i < n; i++) by_OP[i] = by_P[i] = i;
+
+    // Number of distinct objects with each predicate
+    std::unordered_map<Resource, size_t> objects_P;
+    // Keys of the lists long enough to compress
+    std::vector<uint64_t> long_P, long_O, long_OP;
+
+    // Build each list and its hash-maps in parallel; each task writes its
+    // own link field of the rows
+    std::function<void()> tasks[] = {
+        [&]() {
+            _index_SPO.reserve(n);
+            for (_RowId i = 0; i < n; i++) {
+                const _TableRow& row = _table[i];
+                _index_SPO.insert(pack_key(row.s, row.p, row.o), i);
+            }
+        },
+        [&]() {
+            CharacteristicSets::Counts counts;
+            for (_RowId i = 0; i < n; i++) {
+                _TableRow& row = _table[i];
+                if (i+1 < n && _table[i+1].s == row.s) row.next_SP = i+1;
+                if (i == 0 || _table[i-1].s != row.s)
+                    _index_S[pack_key(row.s)] = i;
+                if (i == 0 || _table[i-1].s != row.s ||
+                    _table[i-1].p != row.p) {
+                    _index_SP[pack_key(row.s, row.p)] = i;
+                    counts.emplace_back(row.p, 0);
+                }
+                counts.back().second++;
+                _len_S[pack_key(row.s)]++;
+                _len_SP[pack_key(row.s, row.p)]++;
+                // Each SP-list is in predicate order
+                if (i+1 == n || _table[i+1].s != row.s) {
+                    _sets.add_subject(row.s, counts);
+                    counts.clear();
+                }
+            }
+        },
+        [&]() {
+            utils::parallel_sort(by_OP, std::max(1, threads/2),
+                [this](_RowId i, _RowId j) {
+                    return std::tie(_table[i].o, _table[i].p) <
+                           std::tie(_table[j].o, _table[j].p); });
+            _link(by_OP, &_TableRow::o, &_TableRow::next_OP, _index_O);
+            for (_RowId k = 0; k < n; k++) {
+                const _TableRow& row = _table[by_OP[k]];
+                if (k == 0 || _table[by_OP[k-1]].o != row.o ||
+                    _table[by_OP[k-1]].p != row.p) {
+                    _index_OP[pack_key(row.o, row.p)] = by_OP[k];
+                    objects_P[row.p]++;
+                }
+                size_t length_O = ++_len_O[pack_key(row.o)];
+                size_t length_OP = ++_len_OP[pack_key(row.o, row.p)];
+                bool last_O = k+1 == n || _table[by_OP[k+1]].o != row.o;
+                if (last_O && _compressed(length_O))
+                    long_O.push_back(pack_key(row.o));
+                if ((last_O || _table[by_OP[k+1]].p != row.p) &&
+                    _compressed(length_OP))
+                    long_OP.push_back(pack_key(row.o, row.p));
+            }
+        },
+        [&]() {
+            // Rows with the same predicate stay in table order
+            utils::parallel_sort(by_P, std::max(1, threads/2),
+                [this](_RowId i, _RowId j) {
+                    return std::tie(_table[i].p, i) <
+                           std::tie(_table[j].p, j); });
+            _link(by_P, &_TableRow::p, &_TableRow::next_P, _index_P);
+            // Each P-list is in subject order
+            for (_RowId k = 0; k < n; k++) {
+                const _TableRow& row = _table[by_P[k]];
+                TripleStatistics& stats = _stats_P[pack_key(row.p)];
+                stats.triples++;
+                stats.subjects += k == 0 || _table[by_P[k-1]].p != row.p ||
+                                  _table[by_P[k-1]].s != row.s;
+                if ((k+1 == n || _table[by_P[k+1]].p != row.p) &&
+                    _compressed(stats.triples))
+                    long_P.push_back(pack_key(row.p));
+            }
         }
-        _len_O[_index_O.at(o)]++;
+    };
+    utils::parallel_for(4, threads, [&](size_t t) { tasks[t](); });
+    for (auto [p, objects] : objects_P)
+        _stats_P[pack_key(p)].objects = objects;
+    for (uint64_t key : long_P) _register(_postings_P, key);
+    for (uint64_t key : long_O) _register(_postings_O, key);
+    for (uint64_t key : long_OP) _register(_postings_OP, key);
+}
 
-        // Insert new row at head of P-list and update _index_P
-        new_row->next_P = _index_P[p]; // Potentially null
-        _index_P[p] = new_row;
+/**
+ * @brief Helper function to thread one kind of list through the triple table
+ * 
+ * @param order Row positions, sorted so that each list is contiguous
+ * @param key Field of a row identifying the list it belongs to
+ * @param next Field of a row linking to the next row in its list
+ * @param heads Hash-map to fill with the head of each list
+ */
+void LinkedIndex::_link(const std::vector<_RowId>& order,
+                        Resource _TableRow::*key, _RowId _TableRow::*next,
+                        _Map<_RowId>& heads) {
+    for (size_t k = 0; k < order.size(); k++) {
+        _TableRow& row = _table[order[k]];
+        if (k+1 < order.size() && _table[order[k+1]].*key == row.*key)
+            row.*next = order[k+1];
+        if (k == 0 || _table[order[k-1]].*key != row.*key)
+            heads[pack_key(row.*key)] = order[k];
     }
 }
 
+/**
+ * @brief Values added to the lists of one kind since they were last
+ *      compressed, grouped by list
+ */
+struct LinkedIndex::_Additions {
+    // Position in `values` of each list's additions, by key
+    _Map<uint32_t> lists;
+    std::vector<std::pair<uint64_t, std::vector<uint32_t>>> values;
+
+    void add(uint64_t key, uint32_t value) {
+        auto [position, added] = lists.try_emplace(key, values.size());
+        if (added) values.emplace_back(key, std::vector<uint32_t>());
+        values[*position].second.push_back(value);
+    }
+};
+
+/**
+ * @brief Brings the compressed lists up to date with the triple table
+ * 
+ * Makes one pass over the rows added since the last call, or over the
+ * whole table after a rebuild, collecting the rows joining each P-list and
+ * OP-list registered for compression and the subjects joining each such
+ * OP-list p-group. Rows are added at the end of the table, so are collected
+ * in ascending order after those already compressed. Lists registered
+ * since the last call are collected in full from their linked lists
+ * instead, unless the whole table was passed over.
+ */
+void LinkedIndex::prepare_reads() {
+    _RowId n = _rows;
+    if (_compress_threshold == 0 || _compressed_rows == n) return;
+    _Additions added_P, added_O, added_OP;
+    for (_RowId i = _compressed_rows; i < n; i++) {
+        const _TableRow& row = _table[i];
+        if (_postings_P.count(pack_key(row.p)))
+            added_P.add(pack_key(row.p), i);
+        if (_postings_O.count(pack_key(row.o)))
+            added_O.add(pack_key(row.o), i);
+        if (_postings_OP.count(pack_key(row.o, row.p)))
+            added_OP.add(pack_key(row.o, row.p), row.s);
+    }
+    _compress(_postings_P, added_P, &LinkedIndex::_rows_P);
+    _compress(_postings_O, added_O, &LinkedIndex::_rows_O);
+    _compress(_postings_OP, added_OP, &LinkedIndex::_subjects_OP);
+    _compressed_rows = n;
+}
+
+/**
+ * @brief Helper function to check whether lists of a given length are kept
+ *      compressed
+ * 
+ * @param length Number of rows in the list
+ * @return bool Whether the list is long enough to compress
+ */
+bool LinkedIndex::_compressed(size_t length) const {
+    return _compress_threshold > 0 && length >= _compress_threshold;
+}
+
+/**
+ * @brief Helper function to mark the compressed copy of a list as out of
+ *      date after a row has joined the list, registering the list for
+ *      compression if it has only now reached the threshold
+ * 
+ * @param postings Positions of the compressed copies of this kind of list
+ * @param key Key of the list
+ * @param length Number of rows in the list, including the new one
+ */
+void LinkedIndex::_outdate(_Map<uint32_t>& postings, uint64_t key,
+                           size_t length) {
+    if (!_compressed(length)) return;
+    const uint32_t* position = postings.find(key);
+    if (position) _postings[*position].current = false;
+    else _register(postings, key);
+}
+
+/**
+ * @brief Helper function to register a list for compression by the next
+ *      call to LinkedIndex::prepare_reads, with an empty, out-of-date copy
+ * 
+ * @param postings Positions of the compressed copies of this kind of list
+ * @param key Key of the list
+ */
+void LinkedIndex::_register(_Map<uint32_t>& postings, uint64_t key) {
+    postings[key] = _postings.size();
+    _postings.push_back(_Postings{std::make_shared<const PostingList>(),
+                                  false});
+}
+
+/**
+ * @brief Helper function to merge the values added to lists of one kind
+ *      into their compressed copies
+ * 
+ * @param postings Positions of the compressed copies of this kind of list
+ * @param added Values added to each registered list since the last call
+ *      to LinkedIndex::prepare_reads
+ * @param values Gets all values of the list with a given key, in ascending
+ *      order, for lists registered since then
+ */
+void LinkedIndex::_compress(
+        const _Map<uint32_t>& postings, _Additions& added,
+        std::vector<uint32_t>(LinkedIndex::*values)(uint64_t) const) {
+    for (auto& [key, additions] : added.values) {
+        _Postings& compressed = _postings[*postings.find(key)];
+        std::sort(additions.begin(), additions.end());
+        std::vector<uint32_t> merged;
+        if (compressed.list->size() > 0) {
+            merged = compressed.list->values();
+            size_t old = merged.size();
+            merged.insert(merged.end(), additions.begin(), additions.end());
+            std::inplace_merge(merged.begin(), merged.begin() + old,
+                               merged.end());
+        } else if (_compressed_rows > 0) {
+            merged = (this->*values)(key);
+        } else {
+            merged = std::move(additions);
+        }
+        compressed = _Postings{std::make_shared<const PostingList>(merged),
+                               true};
+    }
+}
+
+/**
+ * @brief Helper functions to get the contents of a list to compress
+ * 
+ * @param key Packed predicate of a P-list, object of an OP-list, or object
+ *      and predicate of an OP-list p-group
+ * @return std::vector<uint32_t> Ascending row positions of the list, or
+ *      subjects of the p-group
+ */
+std::vector<uint32_t> LinkedIndex::_rows_P(uint64_t key) const {
+    std::vector<uint32_t> rows;
+    for (_RowId i = _find(_index_P, key); i != _NO_ROW; i = _table[i].next_P)
+        rows.push_back(i);
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+std::vector<uint32_t> LinkedIndex::_rows_O(uint64_t key) const {
+    std::vector<uint32_t> rows;
+    for (_RowId i = _find(_index_O, key); i != _NO_ROW;
+         i = _next(_table[i], &_TableRow::next_OP))
+        rows.push_back(i);
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+std::vector<uint32_t> LinkedIndex::_subjects_OP(uint64_t key) const {
+    Resource p = (uint32_t) key;
+    std::vector<uint32_t> subjects;
+    for (_RowId i = _find(_index_OP, key);
+         i != _NO_ROW && _table[i].p == p;
+         i = _next(_table[i], &_TableRow::next_OP))
+        subjects.push_back(_table[i].s);
+    std::sort(subjects.begin(), subjects.end());
+    return subjects;
+}
+
 /**
  * @brief Evaluates a triple pattern over the data in the index structure
  * 
- * Returns an iterator over all variable mappings resulting in a match for the
- * given triple pattern. Specifically, a stateful lambda function is returned
- * which, when called, returns an optional type holding the next matching 
- * ariable mapping if one exists, and holding nothing otherwise.
- * 
- * @param a Subject term (holding a variable or resource)
- * @param b Predicate term (holding a variable or resource)
- * @param c Object term (holding a variable or resource)
- * @return std::function<std::optional<VariableMap>()> Call this repeatedly to
- *      iterate over all matching variable mappings.
- */
-std::function<std::optional<VariableMap>()> RDFIndex::evaluate(Term a, Term b,
-                                                               Term c) {
-    // We declare four quantities and define them separately for each query type
-
-    // Predicate for a row to be a valid match
-    std::function<bool(_TableRow*)> condition = [](_TableRow* row) {
-        return true; };
-    // Returns the variable mapping matching a row
-    std::function<VariableMap(_TableRow*)> implied_map;
-    // The first row to consider
-    _TableRow* head;
-    // Gets the next matching row given the current one
-    std::function<_TableRow*(_TableRow*)> next;
-
-    // Exhaust the 8 possible query types, defining the above 4
-    // quantities on a case-by-case basis
+ * Returns an iterator over all matches for the given triple pattern.
+ * Specifically, a stateful lambda function is returned which, when called,
+ * writes the bindings of the pattern's variables for the next match into
+ * their slots of \p row and returns true if a match remains, and returns
+ * false otherwise. This wraps a LinkedIndex::Cursor for callers not
+ * specialised to this implementation.
+ * 
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ * @param row Row of bindings to write matches into
+ * @return std::function<bool()> Call this repeatedly to iterate over all
+ *      matches.
+ */
+std::function<bool()> LinkedIndex::evaluate(SlotTerm a, SlotTerm b,
+                                            SlotTerm c, Resource* row) {
+    Cursor cursor(*this);
+    cursor.open(a, b, c);
+    return [=]() mutable { return cursor.next(row); };
+}
+
+/**
+ * @brief Estimates the number of matches of a triple pattern
+ * 
+ * Uses the lengths of the lists the pattern's constants select, taking the
+ * shortest where several apply. Repeated variables are ignored.
+ * 
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ * @return size_t Upper bound on the number of matches
+ */
+size_t LinkedIndex::estimate(SlotTerm a, SlotTerm b, SlotTerm c) {
+    auto length = [](const _Map<size_t>& lengths, Resource key) {
+        const size_t* length = lengths.find(pack_key(key));
+        return length ? *length : 0; };
+    size_t length_P = statistics(b.resource).triples;
+    switch (utils::get_pattern_type(std::make_tuple(a, b, c))) {
+    case XYZ: return _rows;
+    case SYZ: return length(_len_S, a.resource);
+    case XYO: return length(_len_O, c.resource);
+    case XPZ: return length_P;
+    case SPZ: return std::min(length(_len_S, a.resource),
+                              length_P);
+    case XPO: return std::min(length(_len_O, c.resource),
+                              length_P);
+    case SYO: return std::min(length(_len_S, a.resource),
+                              length(_len_O, c.resource));
+    default: return _index_SPO.count(pack_key(
+        a.resource, b.resource, c.resource));
+    }
+}
+
+/**
+ * @brief Counts the matches of a triple pattern exactly
+ * 
+ * Patterns without repeated variables are answered from the list length
+ * counters, except for those with only their predicate a variable, which
+ * like patterns with repeated variables are counted by walking a list.
+ * 
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ * @return size_t Number of matches
+ */
+size_t LinkedIndex::count(SlotTerm a, SlotTerm b, SlotTerm c) {
+    auto length = [](const _Map<size_t>& lengths, uint64_t key) {
+        const size_t* length = lengths.find(key);
+        return length ? *length : 0; };
+    if (!_local_slots(a, b, c)) {
+        Resource s = a.resource, p = b.resource, o = c.resource;
+        switch (utils::get_pattern_type(std::make_tuple(a, b, c))) {
+        case XYZ: return _rows;
+        case SYZ: return length(_len_S, pack_key(s));
+        case XYO: return length(_len_O, pack_key(o));
+        case XPZ: return statistics(p).triples;
+        case SPZ: return length(_len_SP, pack_key(s, p));
+        case XPO: return length(_len_OP, pack_key(o, p));
+        case SPO: return _index_SPO.count(pack_key(s, p, o));
+        default: break;
+        }
+    }
+    Cursor cursor(*this);
+    cursor.open(a, b, c);
+    Resource row[3];
+    size_t n = 0;
+    while (cursor.next(row)) n++;
+    return n;
+}
+
+/**
+ * @brief Gets the statistics of all triples in the index
+ * 
+ * @return TripleStatistics Numbers of triples, and of distinct subjects,
+ *      predicates and objects
+ */
+TripleStatistics LinkedIndex::statistics() {
+    return TripleStatistics{_rows, _index_S.size(), _index_P.size(),
+                            _index_O.size()};
+}
+
+/**
+ * @brief Gets the statistics of the triples with a given predicate
+ * 
+ * These are maintained by LinkedIndex::add and LinkedIndex::_build.
+ * 
+ * @param p Predicate resource
+ * @return TripleStatistics Numbers of triples, and of distinct subjects,
+ *      predicates and objects
+ */
+TripleStatistics LinkedIndex::statistics(Resource p) {
+    const TripleStatistics* found = _stats_P.find(pack_key(p));
+    if (!found) return TripleStatistics{};
+    TripleStatistics stats = *found;
+    stats.predicates = 1;
+    return stats;
+}
+
+/**
+ * @brief Estimates the number of matches of a subject star
+ * 
+ * Uses the characteristic sets maintained by LinkedIndex::add and
+ * LinkedIndex::_build.
+ * 
+ * @param predicates Predicates of the star's patterns
+ * @return double Estimated number of matches
+ */
+double LinkedIndex::estimate_star(const std::vector<Resource>& predicates) {
+    return _sets.estimate_star(predicates);
+}
+
+/**
+ * @brief Positions the cursor at the first candidate for a triple pattern
+ * 
+ * Chooses the list to walk and the filter to apply for the pattern's type,
+ * discarding any previous position.
+ * 
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ */
+void LinkedIndex::Cursor::open(SlotTerm a, SlotTerm b, SlotTerm c) {
+    const LinkedIndex& index = *_index;
+    _slot_s = a.slot, _slot_p = b.slot, _slot_o = c.slot;
+    _filter = _ANY;
+    _postings = nullptr;
+
+    // Exhaust the 8 possible query types, choosing the first row and the
+    // list to follow from it on a case-by-case basis
     switch (utils::get_pattern_type(std::make_tuple(a, b, c))) {
     case XYZ: {
-        Variable x = std::get<Variable>(a);
-        Variable y = std::get<Variable>(b);
-        Variable z = std::get<Variable>(c);
+        Slot x = a.slot, y = b.slot, z = c.slot;
         // Enable filtering if we have repeated variables
-        if (x == y && y == z) condition = [](_TableRow* row) {
-                return row->s == row->p && row->p == row->o; };
-        else if (x == y) condition = [](_TableRow* row) {
-                return row->s == row->p; };
-        else if (y == z) condition = [](_TableRow* row) {
-                return row->p == row->o; };
-        else if (x == z) condition = [](_TableRow* row) {
-                return row->s == row->o; };
+        if (x == y && y == z) _filter = _ALL_SAME;
+        else if (x == y) _filter = _S_IS_P;
+        else if (y == z) _filter = _P_IS_O;
+        else if (x == z) _filter = _S_IS_O;
         // Start at top of triple table and traverse in order
-        head = _table[0];
-        int i = 0;
-        next = [=](_TableRow* row) mutable {
-            do { row = _table[i++]; } while (row != nullptr && !condition(row));
-            return (i <= _table.size()) ? row : nullptr; };
-        implied_map = [=](_TableRow* row) {
-            return VariableMap{{x,row->s},{y,row->p},{z,row->o}}; };
+        _end = index._rows;
+        _current = (_end > 0) ? 0 : _NO_ROW;
+        _list = _TABLE;
         break; }
 
-    case SYZ: { // Similar for the remaining cases
-        Resource s = std::get<Resource>(a);
-        Variable y = std::get<Variable>(b);
-        Variable z = std::get<Variable>(c);
-        if (y == z) condition = [](_TableRow* row) { return row->p == row->o; };
+    case SYZ: // Similar for the remaining cases
+        if (b.slot == c.slot) _filter = _P_IS_O;
         // Scan from head of SP-list
-        head = _index_S[s];
-        next = [=](_TableRow* row) {
-            do { row = row->next_SP; } while (row != nullptr
-                                              && !condition(row));
-            return row; };
-        implied_map = [=](_TableRow* row) { 
-            return VariableMap{{y,row->p},{z,row->o}}; };
-        break; }
-    case XYO: {
-        Variable x = std::get<Variable>(a);
-        Variable y = std::get<Variable>(b);
-        Resource o = std::get<Resource>(c);
-        if (x == y) condition = [](_TableRow* row) { return row->s == row->p; };
-        // Scan from head of OP-list
-        head = _index_O[o];
-        next = [=](_TableRow* row) {
-            do { row = row->next_OP; } while (row != nullptr
-                                              && !condition(row));
-            return row; };
-        implied_map = [=](_TableRow* row) {
-            return VariableMap{{x,row->s},{y,row->p}}; };
-        break; }
-    case XPZ: {
-        Variable x = std::get<Variable>(a);
-        Resource p = std::get<Resource>(b);
-        Variable z = std::get<Variable>(c);
-        if (x == z) condition = [](_TableRow* row) { return row->s == row->o; };
-        // Scan from head of P-list
-        head = _index_P[p];
-        next = [=](_TableRow* row) {
-            do { row = row->next_P; } while (row != nullptr && !condition(row));
-            return row; };
-        implied_map = [=](_TableRow* row) {
-            return VariableMap{{x,row->s},{z,row->o}}; };
-        break; }
-    case SPZ: {
-        Resource s = std::get<Resource>(a);
-        Resource p = std::get<Resource>(b);
-        Variable z = std::get<Variable>(c);
+        _current = _find(index._index_S, pack_key(a.resource));
+        _list = _SP;
+        break;
+    case XYO:
+        if (a.slot == b.slot) _filter = _S_IS_P;
+        // Scan compressed OP-list, or from head of OP-list
+        if (_open_postings(index._postings_O, pack_key(c.resource), _ROWS))
+            break;
+        _current = _find(index._index_O, pack_key(c.resource));
+        _list = _OP;
+        break;
+    case XPZ:
+        if (a.slot == c.slot) _filter = _S_IS_O;
+        // Scan compressed P-list, or from head of P-list
+        if (_open_postings(index._postings_P, pack_key(b.resource), _ROWS))
+            break;
+        _current = _find(index._index_P, pack_key(b.resource));
+        _list = _P;
+        break;
+    case SPZ:
         // Scan p-group within SP-list
-        head = _index_SP[std::make_tuple(s,p)];
-        next = [=](_TableRow* row) {
-            row = row->next_SP;
-            return (row != nullptr && row->p == p) ? row : nullptr; };
-        implied_map = [=](_TableRow* row) { return VariableMap{{z,row->o}}; };
-        break; }
-    case XPO: {
-        Variable x = std::get<Variable>(a);
-        Resource p = std::get<Resource>(b);
-        Resource o = std::get<Resource>(c);
-        // Scan p-group within OP-list
-        head = _index_OP[std::make_tuple(o,p)];
-        next = [=](_TableRow* row) {
-            row = row->next_OP;
-            return (row != nullptr && row->p == p) ? row : nullptr; };
-        implied_map = [=](_TableRow* row) { return VariableMap{{x,row->s}}; };
-        break; }
+        _current = _find(index._index_SP,
+                         pack_key(a.resource, b.resource));
+        _list = _SP_GROUP;
+        _value = b.resource;
+        break;
+    case XPO:
+        // Scan compressed subjects of p-group, or p-group within OP-list
+        if (_open_postings(index._postings_OP,
+                           pack_key(c.resource, b.resource), _SUBJECTS))
+            break;
+        _current = _find(index._index_OP,
+                         pack_key(c.resource, b.resource));
+        _list = _OP_GROUP;
+        _value = b.resource;
+        break;
     case SYO: {
-        Resource s = std::get<Resource>(a);
-        Variable y = std::get<Variable>(b);
-        Resource o = std::get<Resource>(c);
+        Resource s = a.resource, o = c.resource;
         // Scan from head of shorter of SP- and OP-lists
-        if (_len_S[_index_S[s]] >= _len_O[_index_O[o]]) {
-            condition = [=](_TableRow* row) { return row->o == o; };
-            head = _index_S[s];
-            next = [=](_TableRow* row) {
-                do { row = row->next_SP; } while (row != nullptr
-                                                  && !condition(row));
-                return row; };
+        const size_t* len_S = index._len_S.find(pack_key(s));
+        const size_t* len_O = index._len_O.find(pack_key(o));
+        if (!len_S || !len_O) {
+            _current = _NO_ROW;
+        } else if (*len_S >= *len_O) {
+            _filter = _O_IS_VALUE;
+            _value = o;
+            _current = _find(index._index_S, pack_key(s));
+            _list = _SP;
         } else {
-            condition = [=](_TableRow* row) { return row->s == s; };
-            head = _index_O[o];
-            next = [=](_TableRow* row) {
-                do { row = row->next_OP; } while (row != nullptr
-                                                  && !condition(row));
-                return row; };
+            _filter = _S_IS_VALUE;
+            _value = s;
+            _current = _find(index._index_O, pack_key(o));
+            _list = _OP;
         }
-        implied_map = [=](_TableRow* row) { return VariableMap{{y,row->p}}; };
         break; }
-    case SPO: {
-        Resource s = std::get<Resource>(a);
-        Resource p = std::get<Resource>(b);
-        Resource o = std::get<Resource>(c);
+    case SPO:
         // Direct look-up
-        head = _index_SPO[std::make_tuple(s,p,o)];
-        next = [](_TableRow* row) { return nullptr; };
-        implied_map = [=](_TableRow* row) { return VariableMap{}; };
-        break; }
+        _current = _find(index._index_SPO, pack_key(
+            a.resource, b.resource, c.resource));
+        _list = _SINGLE;
+        break;
     }
+}
 
-    // Advance to first valid match if necessary
-    _TableRow* current = (head == nullptr || condition(head)) ? head
-                                                              : next(head);
-    // Return iterating function that repeatedly calls `next` on the
-    // current row and returns the implied variable mapping
-    return [=]() mutable {
-        if (current == nullptr) return std::optional<VariableMap>();
-        else {
-            VariableMap map = implied_map(current);
-            current = next(current);
-            return std::make_optional<VariableMap>(map); } };
+/**
+ * @brief Positions the cursor at the start of a compressed list, if the
+ *      list has an up-to-date one
+ * 
+ * @param postings Positions of the compressed copies of one kind of list
+ * @param key Key of the list
+ * @param list Kind of values the compressed list holds
+ * @return bool Whether the compressed list is to be scanned
+ */
+bool LinkedIndex::Cursor::_open_postings(const _Map<uint32_t>& postings,
+                                         uint64_t key, _List list) {
+    const uint32_t* position = postings.find(key);
+    if (!position || !_index->_postings[*position].current) return false;
+    _postings = _index->_postings[*position].list.get();
+    _list = list;
+    _block = 0;
+    _position = _available = 0;
+    return true;
 }
 
-RDFIndex::~RDFIndex() {
-    int n = _table.size();
-    for (int i=0; i<n; i++) delete _table[i];
-}
\ No newline at end of file
+/**
+ * @brief Looks up the head of a list in one of the index hash-maps
+ * 
+ * Unlike `operator[]`, this never inserts into the map, so evaluating a
+ * pattern leaves the index unchanged.
+ * 
+ * @tparam Map Type of the hash-map
+ * @tparam K Packed key type of the hash-map
+ * @param index Hash-map from keys to list heads
+ * @param key Key to look up
+ * @return _RowId Head of the list, or _NO_ROW if there is none
+ */
+template <class Map, class K>
+LinkedIndex::_RowId LinkedIndex::_find(const Map& index, const K& key) {
+    const _RowId* head = index.find(key);
+    return head ? *head : _NO_ROW;
+}
@@ -6,11 +6,26 @@
  * The engine for evaluating BGP SPARQL queries.
  * Partial implementation of the System class, alongside `d_turtle_parse.cpp`.
  */
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <exception>
-#include <iostream>
+#include <iomanip>
+#include <ostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
 #include <tuple>
+#include <type_traits>
+#include <BatchJoin.h>
+#include <CountJoin.h>
+#include <GenericJoin.h>
+#include <LinkedIndex.h>
+#include <ParallelJoin.h>
+#include <PerfCounters.h>
+#include <PermutationIndex.h>
+#include <ResultWriter.h>
 #include <System.h>
 #include <Query.h>
 #include <utils.h>
@@ -19,119 +34,575 @@
  * 
  * @brief Evaluates a BGP SPARQL query string over currently stored triples
  * 
- * Prints number of results and time taken to stdout, optionally also printing
+ * Prints number of results and time taken, optionally also printing
  * the query results themselves. (This is optional to facilitate timing.)
  * Implements the query evaluation algorithm suggested in Question 1
  * of the paper.
  * 
+ * The query is evaluated over the current version of the store's contents
+ * throughout, even if another thread publishes a new one meanwhile.
+ * Resources in the query that are not in the dictionary are given an ID
+ * that no triple uses rather than being added, so that queries only ever
+ * read the version.
+ * 
  * @param query_string BGP SPARQL query string to be evalauted
  * @param print Whether to print individual results (as opposed to just
  *      the result count and time taken)
- * @param output_join_order Whether to print the join order used
+ * @param output_join_order Whether to print the join order and operators
+ *      used, with the estimated and actual number of rows after each
+ *      pattern
+ * @param out Stream to print to
+ * @param deadline Time by which evaluation must finish, after which it is
+ *      abandoned with a `std::runtime_error`
  */
-void System::evaluate_query(std::string query_string,
-                            bool print, bool output_join_order) {
+void System::evaluate_query(std::string query_string, bool print,
+                            bool output_join_order, std::ostream& out,
+                            Deadline deadline) {
     auto start = std::chrono::high_resolution_clock::now();
+    std::shared_ptr<const _Version> version = std::atomic_load(&_version);
+    bool hit;
+    std::shared_ptr<const _CachedPlan> cached =
+        _find_plan(*version, _normalise(query_string), {}, hit);
+    _run_plan(*version, *cached, {}, hit, print, output_join_order, out,
+              deadline, start);
+}
 
-    // Parse query and run join order optimizer
-    Query query = Query::parse(query_string, [=] (std::string name) {
-        return _encode_resource(name); });
-    std::vector<TriplePattern> patterns = query.plan();
-    std::vector<Variable> variables = query.variables;
-    VariableMap map;
+/**
+ * @brief Prepares a query for executing with different resources
+ * 
+ * The query is checked for syntax errors straight away, but only planned
+ * when first executed. Preparing a query under a name already in use
+ * replaces the query prepared before.
+ * 
+ * @param details Name of the query, followed by `AS`, then `SELECT` or
+ *      `COUNT` and the rest of a BGP SPARQL query with parameters `$1`,
+ *      `$2` and so on in place of some resources
+ * @param out Stream to print to
+ */
+void System::prepare_query(std::string details, std::ostream& out) {
+    std::stringstream ss(details);
+    std::string name, as, keyword, query_string;
+    ss >> name >> as >> keyword;
+    std::getline(ss, query_string);
+    if (name.empty() || as != "AS" ||
+        (keyword != "SELECT" && keyword != "COUNT"))
+        throw std::invalid_argument("Expected PREPARE [name] AS SELECT or "
+                                    "COUNT [rest_of_query]");
 
-    // Print pattern evaluation order if enabled - useful for debugging
-    if (output_join_order) {
-        std::cout << std::endl << "Pattern evaluation order:" << std::endl;
-        std::cout << "=========================" << std::endl;
-        for (auto [a,b,c] : patterns) {
-            std::cout << _term_to_string(a) << " " << _term_to_string(b)
-                    << " " << _term_to_string(c) << std::endl;
+    // Check the syntax, and count the parameters
+    _PreparedQuery prepared{_normalise(query_string), keyword == "SELECT", 0};
+    Query::parse(prepared.text, [&] (std::string term) {
+        if (term[0] == '$') {
+            prepared.parameters = std::max(prepared.parameters,
+                                           _parameter_number(term));
+            return FIRST_PARAMETER;
+        }
+        _check_resource(term);
+        return INVALID_RESOURCE;
+    });
+    {
+        std::lock_guard<std::mutex> guard(_cache_lock);
+        _prepared[name] = prepared;
+    }
+    out << "Query " << name << " prepared with " << prepared.parameters
+        << " parameters." << std::endl;
+}
+
+/**
+ * @brief Executes a prepared query with the given resources
+ * 
+ * Prints the same as evaluating the query with its parameters replaced by
+ * the resources would, as a `SELECT` or `COUNT` query as prepared.
+ * 
+ * @param details Name of the query, followed by a resource for each of its
+ *      parameters in order, such as `(<a>, <b>)`
+ * @param output_join_order Whether to print the join order and operators
+ *      used, with the estimated and actual number of rows after each
+ *      pattern
+ * @param out Stream to print to
+ * @param deadline Time by which evaluation must finish, after which it is
+ *      abandoned with a `std::runtime_error`
+ */
+void System::execute_query(std::string details, bool output_join_order,
+                           std::ostream& out, Deadline deadline) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::shared_ptr<const _Version> version = std::atomic_load(&_version);
+    const Dictionary& dictionary = version->dictionary;
+    std::stringstream ss(details);
+    std::string name, list;
+    ss >> name;
+    std::getline(ss, list);
+    _PreparedQuery prepared;
+    {
+        std::lock_guard<std::mutex> guard(_cache_lock);
+        auto it = _prepared.find(name);
+        if (it == _prepared.end())
+            throw std::invalid_argument("No query prepared as " + name);
+        prepared = it->second;
+    }
+
+    // Encode the resources, skipping the brackets and commas between them
+    std::vector<Resource> parameters;
+    for (size_t pos = 0; pos < list.size();) {
+        char c = list[pos];
+        if (std::isspace((unsigned char) c) || c == '(' || c == ')' ||
+            c == ',') {
+            pos++;
+            continue;
+        }
+        size_t end = (c == '<' || c == '"')
+            ? list.find(c == '<' ? '>' : '"', pos+1)
+            : list.find_first_of(" \t,()", pos) - 1;
+        end = (end >= list.size()) ? list.size() : end + 1;
+        std::string resource = list.substr(pos, end - pos);
+        _check_resource(resource);
+        Resource id = dictionary.find(resource);
+        parameters.push_back(
+            (id != INVALID_RESOURCE) ? id : (Resource) dictionary.size());
+        pos = end;
+    }
+    if (parameters.size() != prepared.parameters)
+        throw std::invalid_argument("Query " + name + " needs " +
+            std::to_string(prepared.parameters) + " parameters");
+
+    bool hit;
+    std::shared_ptr<const _CachedPlan> cached =
+        _find_plan(*version, prepared.text, parameters, hit);
+    _run_plan(*version, *cached, parameters, hit, prepared.print,
+              output_join_order, out, deadline, start);
+}
+
+/**
+ * @brief Prints the plan of a query, and optionally runs it and prints the
+ *      work done by each of its patterns
+ * 
+ * The engine the query is evaluated by is printed too, chosen as by
+ * System::_run_plan. With `ANALYZE`, the query is evaluated by that engine,
+ * with its results counted but not printed. For queries joined by a
+ * BatchJoin or ParallelJoin, the cursors opened on the index, the matches
+ * read from them, the matches rejected by checks for variables repeated in
+ * the pattern, the rows passed on and the time spent are printed for each
+ * pattern, summed over all threads for a ParallelJoin. For queries counted
+ * by a CountJoin, only the cursors opened and counts taken, and the
+ * matches and counts read from them, are printed for each pattern. Cyclic
+ * queries are joined by a GenericJoin, which does not work pattern by
+ * pattern, so only their totals are printed. Where the hardware
+ * performance counters can be read, the cycles, instructions and
+ * last-level cache misses are printed too.
+ * 
+ * @param details Optionally `ANALYZE`, then `SELECT` or `COUNT` and the
+ *      rest of a BGP SPARQL query
+ * @param out Stream to print to
+ * @param deadline Time by which evaluation must finish, after which it is
+ *      abandoned with a `std::runtime_error`
+ */
+void System::explain_query(std::string details, std::ostream& out,
+                           Deadline deadline) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::stringstream ss(details);
+    std::string keyword, query_string;
+    ss >> keyword;
+    bool analyze = keyword == "ANALYZE";
+    if (analyze) ss >> keyword;
+    std::getline(ss, query_string);
+    if (keyword != "SELECT" && keyword != "COUNT")
+        throw std::invalid_argument("Expected EXPLAIN [ANALYZE] SELECT or "
+                                    "COUNT [rest_of_query]");
+    std::shared_ptr<const _Version> version = std::atomic_load(&_version);
+    const Dictionary& dictionary = version->dictionary;
+    bool hit;
+    std::shared_ptr<const _CachedPlan> cached =
+        _find_plan(*version, _normalise(query_string), {}, hit);
+    const std::vector<PlanStep>& plan = cached->plan;
+    bool generic = !plan.empty() && plan[0].join == GENERIC_JOIN;
+    bool project = keyword == "SELECT";
+    // Whether the engine charges time to each pattern
+    bool timed = !generic && project;
+    std::string threads = " on " + std::to_string(_threads) + " threads";
+    std::string engine = generic ? "generic join"
+                         : !project ? "count join"
+                                      + (cached->parallel ? threads : "")
+                         : cached->parallel ? "parallel join" + threads
+                         : "batch join";
+
+    // Evaluate, charging the work to the patterns
+    size_t results = 0;
+    std::vector<size_t> produced;
+    std::vector<StageProfile> profiles;
+    std::unique_ptr<PerfCounters> counters;
+    uint64_t events[PerfCounters::EVENTS] = {};
+    std::chrono::steady_clock::duration elapsed{0};
+    if (analyze) {
+        counters = std::make_unique<PerfCounters>();
+        auto sink = [&](const Batch& batch) { results += batch.size; };
+        auto join = [&](auto& index) {
+            using Index = std::decay_t<decltype(index)>;
+            if (generic) {
+                GenericJoin<Index> generic_join(index, cached->compiled,
+                                                project);
+                generic_join.set_deadline(deadline);
+                generic_join.run(sink);
+                return;
+            }
+            if (!project) {
+                CountJoin<Index> count_join(index, cached->compiled,
+                                            &_pool);
+                count_join.set_deadline(deadline);
+                results = count_join.run();
+                profiles = count_join.profiles();
+                return;
+            }
+            if (cached->parallel) {
+                ParallelJoin<Index> parallel_join(index, cached->compiled,
+                                                  project, _pool);
+                parallel_join.set_deadline(deadline);
+                parallel_join.profile(counters->available() ? counters.get()
+                                                            : nullptr);
+                parallel_join.run(sink);
+                produced = parallel_join.produced();
+                profiles = parallel_join.profiles();
+                return;
+            }
+            BatchJoin<Index> batch_join(index, cached->compiled, project);
+            batch_join.set_deadline(deadline);
+            batch_join.profile(counters.get());
+            batch_join.run(sink);
+            produced = batch_join.produced();
+            profiles = batch_join.profiles();
+        };
+        uint64_t before[PerfCounters::EVENTS];
+        counters->read(before);
+        auto join_start = std::chrono::steady_clock::now();
+        if (auto linked = dynamic_cast<LinkedIndex*>(version->index.get()))
+            join(*linked);
+        else join(dynamic_cast<PermutationIndex&>(*version->index));
+        elapsed = std::chrono::steady_clock::now() - join_start;
+        counters->read(events);
+        for (int e = 0; e < PerfCounters::EVENTS; e++) events[e] -= before[e];
+    }
+
+    // Print the work of each pattern, then in total
+    auto print_work = [&](std::chrono::steady_clock::duration time,
+                          const uint64_t* counts) {
+        std::ostringstream work;
+        work << std::fixed << std::setprecision(3)
+             << std::chrono::duration<double, std::milli>(time).count()
+             << " ms";
+        if (counters->available()) {
+            work << ", " << counts[PerfCounters::CYCLES] << " cycles, "
+                 << counts[PerfCounters::INSTRUCTIONS] << " instructions, "
+                 << counts[PerfCounters::LLC_MISSES] << " LLC misses";
+        }
+        out << work.str();
+    };
+    out << std::endl << (analyze ? "Query plan and profile:" : "Query plan:")
+        << std::endl << "=========================" << std::endl;
+    const char* join_names[] = {"nested loop", "hash join",
+                                "merge join", "generic join"};
+    for (size_t i = 0; i < plan.size(); i++) {
+        JoinMethod join = plan[i].join;
+        out << _pattern_to_string(dictionary, plan[i].pattern);
+        if (i > 0 || join == GENERIC_JOIN)
+            out << "\t(" << join_names[join] << ")";
+        out << "\testimated " << (long long) plan[i].rows << " rows";
+        if (timed && i < profiles.size() && i < produced.size()) {
+            const StageProfile& profile = profiles[i];
+            out << ", actual " << produced[i] << " rows, " << profile.probes
+                << " probes, " << profile.matches << " matches, "
+                << profile.rejected << " rejected, ";
+            print_work(profile.time, profile.events);
+        } else if (i < profiles.size()) {
+            out << ", " << profiles[i].probes << " probes, "
+                << profiles[i].matches << " matches";
+        }
+        out << std::endl;
+    }
+    out << "=========================" << std::endl;
+    out << "Engine: " << engine << std::endl;
+    if (analyze) {
+        if (timed && !profiles.empty()) {
+            out << "Output: ";
+            print_work(profiles.back().time, profiles.back().events);
+            out << std::endl;
+        }
+        out << "Total: ";
+        print_work(elapsed, events);
+        if (counters->available() && events[PerfCounters::CYCLES] > 0) {
+            std::ostringstream ipc;
+            ipc << std::fixed << std::setprecision(2)
+                << (double) events[PerfCounters::INSTRUCTIONS] /
+                   events[PerfCounters::CYCLES];
+            out << " (" << ipc.str() << " instructions per cycle)";
+        }
+        out << std::endl;
+        if (!counters->available()) {
+            out << "Hardware counters unavailable: " << counters->error()
+                << std::endl;
+        }
+        out << std::endl;
+        int elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>
+            (std::chrono::high_resolution_clock::now() - start).count();
+        out << results << " results returned in " << elapsed_ms << " ms."
+            << std::endl;
+    }
+}
+
+/**
+ * @brief Helper function to get a query's plan from the cache, or to parse
+ *      and plan it if not cached for the given version
+ * 
+ * Given several threads, acyclic queries of more than one pattern are
+ * planned for a ParallelJoin, with any merge joins in the plan replaced by
+ * hash joins.
+ * 
+ * @param version Version the query will be evaluated over
+ * @param query_string Query text, with whitespace normalised
+ * @param parameters Values of the query's parameters, if prepared, used
+ *      to plan it if not cached
+ * @param hit Set to whether the plan was cached
+ * @return std::shared_ptr<const _CachedPlan> Plan of the query, with its
+ *      parameters left unbound
+ */
+std::shared_ptr<const System::_CachedPlan> System::_find_plan(
+        const _Version& version, const std::string& query_string,
+        const std::vector<Resource>& parameters, bool& hit) {
+    {
+        std::lock_guard<std::mutex> guard(_cache_lock);
+        _plan_lookups++;
+        auto it = _plans.find(query_string);
+        hit = it != _plans.end() &&
+              it->second->generation == version.generation &&
+              it->second->parameters == parameters.size();
+        if (hit) {
+            _plan_hits++;
+            return it->second;
         }
-        std::cout << "=========================" << std::endl << std::endl;
     }
-    
-    // Initiate recursive join
+
+    // Parse query and run join order optimizer
+    const Dictionary& dictionary = version.dictionary;
+    Query query = Query::parse(query_string, [&] (std::string name) {
+        if (name[0] == '$') {
+            size_t k = _parameter_number(name);
+            if (k > parameters.size())
+                throw std::invalid_argument("No value for parameter " + name);
+            return FIRST_PARAMETER - (Resource) (k-1);
+        }
+        _check_resource(name);
+        Resource id = dictionary.find(name);
+        return (id != INVALID_RESOURCE) ? id : (Resource) dictionary.size();
+    });
+    std::vector<PlanStep> plan = query.plan(*version.index, parameters);
+    bool parallel = _threads > 1 && plan.size() > 1 &&
+                    plan[0].join != GENERIC_JOIN;
+    for (PlanStep& step : plan) {
+        if (parallel && step.join == MERGE_JOIN) step.join = HASH_JOIN;
+    }
+    CompiledQuery compiled = query.compile(plan);
+    auto cached = std::make_shared<const _CachedPlan>(_CachedPlan{
+        version.generation, parameters.size(), std::move(query),
+        std::move(plan), std::move(compiled), parallel});
+
+    // Keep the plan unless one for a later version was cached meanwhile
+    std::lock_guard<std::mutex> guard(_cache_lock);
+    if (_plans.size() >= _PLAN_CACHE_SIZE) _plans.clear();
+    std::shared_ptr<const _CachedPlan>& entry = _plans[query_string];
+    if (!entry || entry->generation <= version.generation) entry = cached;
+    return cached;
+}
+
+/**
+ * @brief Helper function to evaluate a planned query
+ * 
+ * Cyclic queries are evaluated by a GenericJoin. The results of acyclic
+ * queries are counted by a CountJoin if not printed, without enumerating
+ * them, and otherwise joined by a ParallelJoin or BatchJoin as planned.
+ * Both the CountJoin and the ParallelJoin run on the system's pool of
+ * threads.
+ * 
+ * @param version Version to evaluate the query over, the one it was
+ *      planned for
+ * @param cached Plan of the query
+ * @param parameters Values of the query's parameters, if prepared
+ * @param hit Whether the plan was cached
+ * @param print Whether to print individual results (as opposed to just
+ *      the result count and time taken), to the stream set by
+ *      System::redirect_results if any; the time taken is then split into
+ *      time spent on the joins and the rate at which rows were output
+ * @param output_join_order Whether to print the join order and operators
+ *      used, with the estimated and actual number of rows after each
+ *      pattern, and the plan cache's hit rate
+ * @param out Stream to print to
+ * @param deadline Time by which evaluation must finish, after which it is
+ *      abandoned with a `std::runtime_error`
+ * @param start Time the query was received, for the time taken
+ */
+void System::_run_plan(const _Version& version, const _CachedPlan& cached,
+                       const std::vector<Resource>& parameters, bool hit,
+                       bool print, bool output_join_order, std::ostream& out,
+                       Deadline deadline,
+                       std::chrono::high_resolution_clock::time_point start) {
+    const Dictionary& dictionary = version.dictionary;
+    RDFIndex& index = *version.index;
+    const std::vector<PlanStep>& plan = cached.plan;
+    const std::vector<Variable>& variables = cached.query.variables;
+    bool parallel = cached.parallel;
+    CompiledQuery compiled = cached.compiled;
+    if (!parameters.empty()) Query::bind(compiled, parameters);
+
+    // Initiate join
+    std::ostream& result_out = _results ? *_results : out;
+    ResultWriter writer(result_out, dictionary, compiled.projection);
     if (print) {
-        std::cout << "----------" << std::endl;
+        result_out << "----------" << std::endl;
         for (Variable var : variables)
-            std::cout << "?" << var << "\t";
-        std::cout << std::endl;
+            result_out << "?" << var << "\t";
+        result_out << std::endl;
+    }
+    size_t results = 0;
+    // Rows produced by each pattern, if known
+    std::vector<size_t> actual;
+    // Join in batches, using the cursors of the index in use directly
+    auto join = [&](auto& index) {
+        using Index = std::decay_t<decltype(index)>;
+        auto sink = [&](const Batch& batch) {
+            results += batch.size;
+            if (print) writer.write(batch);
+        };
+        if (!plan.empty() && plan[0].join == GENERIC_JOIN) {
+            GenericJoin<Index> generic_join(index, compiled, print);
+            generic_join.set_deadline(deadline);
+            generic_join.run(sink);
+        } else if (!print) {
+            CountJoin<Index> count_join(index, compiled, &_pool);
+            count_join.set_deadline(deadline);
+            Batch total;
+            total.size = count_join.run();
+            if (total.size > 0) sink(total);
+        } else if (parallel) {
+            ParallelJoin<Index> parallel_join(index, compiled, print,
+                                              _pool);
+            parallel_join.set_deadline(deadline);
+            parallel_join.run(sink);
+            actual = parallel_join.produced();
+        } else {
+            BatchJoin<Index> batch_join(index, compiled, print);
+            batch_join.set_deadline(deadline);
+            batch_join.run(sink);
+            actual = batch_join.produced();
+        }
+    };
+    if (auto linked = dynamic_cast<LinkedIndex*>(&index)) join(*linked);
+    else join(dynamic_cast<PermutationIndex&>(index));
+    if (print) {
+        writer.flush();
+        result_out << "----------" << std::endl;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // Print pattern evaluation order if enabled - useful for debugging
+    if (output_join_order) {
+        out << std::endl << "Pattern evaluation order:" << std::endl;
+        out << "=========================" << std::endl;
+        const char* join_names[] = {"nested loop", "hash join",
+                                    "merge join", "generic join"};
+        for (size_t i = 0; i < plan.size(); i++) {
+            JoinMethod join = plan[i].join;
+            out << _pattern_to_string(dictionary,
+                Query::bind(plan[i].pattern, parameters));
+            if (i > 0 || join == GENERIC_JOIN)
+                out << "\t(" << join_names[join] << ")";
+            out << "\testimated " << (long long) plan[i].rows
+                << " rows, actual ";
+            if (i < actual.size()) out << actual[i];
+            else if (i+1 == plan.size()) out << results;
+            else out << "-";
+            out << std::endl;
+        }
+        out << "=========================" << std::endl;
+        std::lock_guard<std::mutex> guard(_cache_lock);
+        out << "Plan cache " << (hit ? "hit" : "miss") << ", "
+            << _plan_hits << " hits in " << _plan_lookups << " lookups ("
+            << (int) (100.0 * _plan_hits / _plan_lookups) << "%)"
+            << std::endl << std::endl;
     }
-    _result_counter = 0;
-    _nested_index_loop_join(map, 0, print, patterns, variables);
-    if (print) std::cout << "----------" << std::endl;
 
     // Summarize output
-    auto end = std::chrono::high_resolution_clock::now();
     int elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>
         (end-start).count();
-    std::cout << _result_counter << " results returned in "
-              << elapsed_ms << " ms." << std::endl;
+    out << results << " results returned in " << elapsed_ms << " ms";
+    if (print) {
+        double output_s = std::chrono::duration<double>(writer.time()).count();
+        out << " (join " << elapsed_ms - (int) (output_s * 1000) << " ms, "
+            << "output " << (long) (results / std::max(output_s, 1e-6))
+            << " rows/s)";
+    }
+    out << "." << std::endl;
 }
 
 /**
- * @brief Recursive helper function for System::evaluate_query
- * 
- * Performs a recursive nested index loop join on patterns \p i onwards
- * with currently assigned variable bindings \p map. Implements the algorithm
- * described in Question 1 of the paper.
- * 
- * @param map Already-determined variable mappings to join with
- * @param i Index of first pattern to join with current bindings
- * @param print Whether to print the results (if no patterns left to join)
- * @param patterns Full list of patterns to evaluate, including ones
- *      already processed
- * @param variables List of variables we wish to map to resources
+ * @brief Helper function to collapse each run of whitespace in a query into
+ *      a single space, so that queries differing only in whitespace share
+ *      a cached plan
+ * 
+ * @param query_string Query text
+ * @return std::string Query text with whitespace normalised
  */
-void System::_nested_index_loop_join(VariableMap& map, int i, bool print,
-                                     std::vector<TriplePattern> patterns,
-                                     std::vector<Variable> variables) {
-    if (i == patterns.size()) {
-        _result_counter++;
-        if (print) _print_mapped_values(map, variables);
-    } else {
-        auto [a,b,c] = patterns[i];
-        // Get iterator over variable mappings matching this pattern
-        std::function<std::optional<VariableMap>()> generate = _index.evaluate(
-            utils::apply_map(map, a), utils::apply_map(map, b),
-            utils::apply_map(map, c));
-        // Make recursive call for each map in the iterator
-        std::optional<VariableMap> rho;
-        while ((rho = generate()).has_value()) {
-            for (auto [var, res] : *rho) map[var] = res; // Add to map
-            _nested_index_loop_join(map, i+1, print, patterns, variables);
-            for (auto [var, res] : *rho) map.erase(var); // Remove from map
-        }
+std::string System::_normalise(const std::string& query_string) {
+    std::string normalised;
+    for (char c : query_string) {
+        if (!std::isspace((unsigned char) c)) normalised += c;
+        else if (!normalised.empty() && normalised.back() != ' ')
+            normalised += ' ';
     }
+    if (!normalised.empty() && normalised.back() == ' ')
+        normalised.pop_back();
+    return normalised;
 }
 
 /**
- * @brief Helper function to apply a mapping to variables and print the results
- * 
- * Requires access to the underlying System object so that Resource integer
- * representations can be decoded into URI strings.
+ * @brief Helper function to get the number of a prepared query's parameter
  * 
- * @param map 
- * @param variables 
+ * @param term Parameter, `$` followed by a positive number
+ * @return size_t Number of the parameter, from 1
  */
-void System::_print_mapped_values(VariableMap map,
-                                  std::vector<Variable> variables) {
-    for (Variable var : variables) {
-        if (map.count(var) == 0)
-            throw std::invalid_argument("Map doesn't contain all variables");
-        std::cout << _decode_resource(map[var]) << "\t";
-    }
-    std::cout << std::endl;
+size_t System::_parameter_number(const std::string& term) {
+    bool valid = term.size() > 1 && term.size() < 8 &&
+        std::all_of(term.begin()+1, term.end(), [](unsigned char c) {
+            return std::isdigit(c); });
+    size_t k = valid ? std::stoul(term.substr(1)) : 0;
+    if (k == 0) throw std::invalid_argument("Invalid parameter " + term);
+    return k;
 }
 
 /**
  * @brief Gets the string representation of a given term.
  * 
+ * Resources in the query that are not in the dictionary are shown as
+ * `[unknown]`.
+ * 
+ * @param dictionary Dictionary to decode resources with
  * @param term 
  * @return std::string 
  */
-std::string System::_term_to_string(Term term) {
+std::string System::_term_to_string(const Dictionary& dictionary, Term term) {
     if (term.index() == 0) return "?" + std::get<Variable>(term);
-    else return _decode_resource(std::get<Resource>(term));
-}
\ No newline at end of file
+    Resource id = std::get<Resource>(term);
+    if ((size_t) id >= dictionary.size()) return "[unknown]";
+    return _decode_resource(dictionary, id);
+}
+
+/**
+ * @brief Gets the string representation of a given triple pattern
+ * 
+ * @param dictionary Dictionary to decode resources with
+ * @param pattern Pattern to represent
+ * @return std::string Terms of the pattern, separated by spaces
+ */
+std::string System::_pattern_to_string(const Dictionary& dictionary,
+                                       TriplePattern pattern) {
+    auto [a,b,c] = pattern;
+    return _term_to_string(dictionary, a) + " " +
+           _term_to_string(dictionary, b) + " " +
+           _term_to_string(dictionary, c);
+}
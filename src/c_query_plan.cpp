@@ -3,7 +3,8 @@
  * @author Candidate 1034792
  * @brief Implementation component (c)
  * 
- * The greedy join order optimisation query planner.
+ * The greedy join order optimisation query planner, and the choice of
+ * physical join operators.
  * Partial implementation of the Query class, alongside `e_query_parse.cpp`.
  */
 #include <algorithm>
@@ -12,32 +13,46 @@
 #include <iterator>
 #include <list>
 #include <sstream>
+#include <unordered_map>
 #include <unordered_set>
 #include <Query.h>
 #include <utils.h>
 
 /**
- * @brief Plans execution ordern of the query according to a greedy heuristic
+ * @brief Plans execution order of the query using the index's statistics
  * 
  * Applies the greedy join order optimisation algorithm suggested in Question
- * 1 of the paper based on the heuristic from the paper
- * 'Heuristics-based query optimisation for SPARQL'. This uses an approximate
- * ordering of triple pattern types to repeatedly pick a pattern with the
- * least expected join cost until all patterns have been processed.
+ * 1 of the paper, repeatedly picking the pattern that gives the fewest
+ * estimated rows when joined with the patterns picked so far, as estimated
+ * by Query::_estimate_join, until all patterns have been processed.
  * 
  * Note a slight modification has been made from the pseudocode given in the
  * exam paper; this implementation eliminates triple patterns that result in a
- * cross product *before* comparing scores. Additionally, note that ties are
- * broken in reverse order of appearance in the query. These decisions are
- * discussed further in the accompanying report. 
+ * cross product *before* comparing estimates. Additionally, note that ties
+ * are broken in reverse order of appearance in the query. These decisions
+ * are discussed further in the accompanying report. 
  * 
- * @return std::vector<TriplePattern>
+ * The resulting order is then made into a physical plan. If the query's
+ * graph has a cycle, pairwise joins can produce far more intermediate rows
+ * than results, so all patterns are joined at once by a worst-case optimal
+ * join, binding variables in order of first appearance. Otherwise the
+ * operator for each pattern is chosen by Query::_choose_joins.
+ * 
+ * The patterns of a prepared query are estimated with its parameters bound
+ * to the given values, but keep their parameters in the plan, so that the
+ * plan can be reused with other values.
+ * 
+ * @param index Index the query will be evaluated over
+ * @param parameters Values of the query's parameters, if any
+ * @return std::vector<PlanStep>
  */
-std::vector<TriplePattern> Query::plan() {
+std::vector<PlanStep> Query::plan(RDFIndex& index,
+                                  const std::vector<Resource>& parameters) {
     // Maintain processed & unprocessed pattern lists and set of bound variables
     std::vector<TriplePattern> unprocessed(patterns);
-    std::vector<TriplePattern> processed;
+    std::vector<PlanStep> processed;
     std::unordered_set<Variable> bound;
+    _Estimate estimate{1, {}, {}};
 
     // First reverse the unprocessed patterns
     std::reverse(unprocessed.begin(), unprocessed.end());
@@ -57,50 +72,297 @@ std::vector<TriplePattern> Query::plan() {
         // If none left we'll have to put up with a cross product
         if (candidates.empty()) candidates = unprocessed;
 
-        // Now pick the pattern with the lowest heuristic score
-        int best_score = 100;
+        // Now pick the pattern giving the fewest estimated rows
+        _Estimate best_estimate;
         TriplePattern best_pattern = INVALID_PATTERN;
         for (TriplePattern pattern : candidates) {
-            int score = _get_score(pattern, bound);
-            std::unordered_set<Variable> vars = utils::get_variables(pattern);
-            if (best_pattern == INVALID_PATTERN || score < best_score) {
+            _Estimate joined = _estimate_join(estimate,
+                                              bind(pattern, parameters),
+                                              index);
+            if (best_pattern == INVALID_PATTERN ||
+                joined.rows < best_estimate.rows) {
                 best_pattern = pattern;
-                best_score = score;
+                best_estimate = joined;
             }
         }
 
         // Process the chosen pattern and track the newly-bound variables
-        processed.push_back(best_pattern);
+        processed.push_back(PlanStep{best_pattern, NESTED_LOOP,
+                                     best_estimate.rows});
+        estimate = best_estimate;
         std::unordered_set<Variable> vars = utils::get_variables(best_pattern);
         for (Variable var : vars) bound.insert(var);
         unprocessed.erase(
             std::remove(unprocessed.begin(), unprocessed.end(), best_pattern),
             unprocessed.end());
     }
+
+    std::vector<TriplePattern> order;
+    for (const PlanStep& step : processed) order.push_back(step.pattern);
+    if (_is_cyclic(order)) {
+        for (PlanStep& step : processed) step.join = GENERIC_JOIN;
+    } else {
+        _choose_joins(processed, index, parameters);
+    }
     return processed;
 }
 
 /**
- * @brief Calculates the heuristic score of a triple pattern
+ * @brief Estimates the result of joining rows with a pattern's matches
  * 
- * Assigns score based on position in the pattern type ordering suggested in
- * the paper Heuristics-based query optimisation for SPARQL'.
+ * The pattern's matches are counted by the index. The number of distinct
+ * bindings of each of its variables is taken from the statistics of its
+ * predicate, or of all triples if its predicate is a variable, and is at
+ * most the number of matches. Assuming bindings are spread uniformly, each
+ * variable shared with the rows then divides the size of their cross
+ * product by the larger of its numbers of distinct bindings on either side.
  * 
- * @param pattern Triple pattern to score
- * @param bound List of currently-bound variables; these will be treated as
- * resources if they occur in \p pattern
- * @return int Position in the query type ordering
+ * Predicates of the same subject are often far from independent, so a
+ * pattern extending a star of patterns with constant predicates on the
+ * same subject variable is instead estimated from the characteristic sets
+ * of the index: each row is taken to gain as many matches as a subject of
+ * the star gains on average from the extra predicate.
+ * 
+ * @param rows Estimate for the rows to join with
+ * @param pattern Pattern to join with
+ * @param index Index the query will be evaluated over
+ * @return _Estimate Estimate for the joined rows
  */
-int Query::_get_score(TriplePattern pattern,
-                      std::unordered_set<Variable> bound) {
-    auto is_bound = [=] (auto t) {
-        return t.index() == 1 || bound.count(std::get<Variable>(t)); };
-    auto [a,b,c] = pattern;
-    if (is_bound(a)) {
-        if (is_bound(b)) return (is_bound(c)) ? 1 : 4;
-        else return (is_bound(c)) ? 2 : 6;
+Query::_Estimate Query::_estimate_join(const _Estimate& rows,
+                                       const TriplePattern& pattern,
+                                       RDFIndex& index) {
+    auto [a,b,c] = _constants_only(pattern);
+    double matches = index.estimate(a, b, c);
+    TripleStatistics stats = (b.slot == NO_SLOT)
+        ? index.statistics(b.resource) : index.statistics();
+    double distinct[] = {(double) stats.subjects, (double) stats.predicates,
+                         (double) stats.objects};
+    Term terms[] = {std::get<0>(pattern), std::get<1>(pattern),
+                    std::get<2>(pattern)};
+
+    // Subject variable of a star of constant predicates, if any
+    bool star = terms[0].index() == 0 && b.slot == NO_SLOT &&
+                terms[2] != terms[0];
+    auto extended = star ? rows.stars.find(std::get<Variable>(terms[0]))
+                         : rows.stars.end();
+
+    _Estimate joined = rows;
+    int first = 0;
+    if (extended != rows.stars.end()) {
+        std::vector<Resource> predicates = extended->second;
+        double before = index.estimate_star(predicates);
+        predicates.push_back(b.resource);
+        double after = index.estimate_star(predicates);
+        joined.rows *= (before > 0) ? after / before : 0;
+        // A constant object keeps its share of the predicate's triples
+        if (c.slot == NO_SLOT && stats.triples > 0)
+            joined.rows *= matches / stats.triples;
+        first = 1;
     } else {
-        if (is_bound(b)) return (is_bound(c)) ? 3 : 7;
-        else return (is_bound(c)) ? 5 : 8;
+        joined.rows *= matches;
+    }
+    for (int k = first; k < 3; k++) {
+        if (terms[k].index() == 1 || std::find(terms, terms+k, terms[k])
+                                     != terms+k) continue;
+        const Variable& var = std::get<Variable>(terms[k]);
+        double values = std::max(1.0, std::min(distinct[k], matches));
+        auto it = joined.distinct.find(var);
+        if (it == joined.distinct.end()) {
+            joined.distinct[var] = values;
+        } else {
+            joined.rows /= std::max(it->second, values);
+            it->second = std::min(it->second, values);
+        }
+    }
+    for (auto& [var, values] : joined.distinct)
+        values = std::min(values, std::max(1.0, joined.rows));
+    if (star) joined.stars[std::get<Variable>(terms[0])].push_back(b.resource);
+    return joined;
+}
+
+/**
+ * @brief Picks the operator joining each pattern of an ordering with the
+ *      rows of the patterns before it
+ * 
+ * Compares the cost of an index nested loop join, which probes the index
+ * once per outer row, with that of a hash join, which reads the pattern's
+ * matches once into a hash table and probes that instead, and, where
+ * possible, a merge join, which steps through the pattern's matches in
+ * sorted order alongside the outer rows. The number of outer rows is that
+ * estimated by Query::plan.
+ * 
+ * A merge join needs the outer rows to be sorted on the only variable they
+ * share with the pattern, and the index to return the pattern's matches
+ * sorted on it too. Every operator preserves the order of its outer rows,
+ * so the outer rows are sorted on whichever variable the first pattern's
+ * matches are sorted on.
+ * 
+ * @param steps Patterns in evaluation order with their estimated rows, as
+ *      found by Query::plan; their operators are set
+ * @param index Index the query will be evaluated over
+ * @param parameters Values of the query's parameters, if any
+ */
+void Query::_choose_joins(std::vector<PlanStep>& steps, RDFIndex& index,
+                          const std::vector<Resource>& parameters) {
+    std::unordered_set<Variable> bound;
+    // Variable the rows so far are sorted on, if any
+    Term sorted = INVALID_TERM;
+
+    for (size_t i = 0; i < steps.size(); i++) {
+        TriplePattern pattern = bind(steps[i].pattern, parameters);
+        auto [a,b,c] = _constants_only(pattern);
+        double matches = index.estimate(a, b, c);
+        int position = index.order(a, b, c);
+        Term terms[] = {std::get<0>(pattern), std::get<1>(pattern),
+                        std::get<2>(pattern)};
+        Term key = (position >= 0) ? terms[position] : INVALID_TERM;
+        std::unordered_set<Variable> vars = utils::get_variables(pattern);
+        std::unordered_set<Variable> shared =
+            utils::intersect<Variable>(vars, bound);
+
+        JoinMethod join = NESTED_LOOP;
+        if (i == 0) {
+            if (key.index() == 0) sorted = key;
+        } else {
+            double rows = steps[i-1].rows;
+            double best = rows * _PROBE_COST;
+            double hash = matches * _BUILD_COST + rows * _HASH_PROBE_COST;
+            if (hash < best) best = hash, join = HASH_JOIN;
+            bool mergeable = key.index() == 0 && key == sorted &&
+                shared.size() == 1 && std::count(terms, terms+3, key) == 1;
+            double merge = matches * _SCAN_COST + rows * _MERGE_STEP_COST;
+            if (mergeable && merge < best) join = MERGE_JOIN;
+        }
+        steps[i].join = join;
+        for (Variable var : vars) bound.insert(var);
+    }
+}
+
+/**
+ * @brief Gives the variables of a pattern slots of their own, for
+ *      evaluating it without any bindings
+ * 
+ * @param pattern Pattern to convert
+ * @return SlotPattern The pattern, with slots numbered by position of first
+ *      occurrence, so that repeated variables share a slot
+ */
+SlotPattern Query::_constants_only(TriplePattern pattern) {
+    Term terms[] = {std::get<0>(pattern), std::get<1>(pattern),
+                    std::get<2>(pattern)};
+    SlotTerm slot_terms[3];
+    for (int k = 0; k < 3; k++) {
+        if (terms[k].index() == 1) {
+            slot_terms[k] = SlotTerm{NO_SLOT, std::get<Resource>(terms[k])};
+        } else {
+            Slot slot = std::find(terms, terms+3, terms[k]) - terms;
+            slot_terms[k] = SlotTerm{slot, INVALID_RESOURCE};
+        }
     }
-}
\ No newline at end of file
+    return std::make_tuple(slot_terms[0], slot_terms[1], slot_terms[2]);
+}
+
+/**
+ * @brief Numbers the variables of a planned query by slot
+ * 
+ * Slots are numbered in order of first appearance in the plan.
+ * 
+ * @param plan Physical plan of this query, as returned by Query::plan
+ * @return CompiledQuery The plan with its variables replaced by slots
+ */
+CompiledQuery Query::compile(const std::vector<PlanStep>& plan) const {
+    CompiledQuery compiled;
+    auto slot_of = [&](const Variable& var) {
+        auto& vars = compiled.slot_variables;
+        return (Slot) (std::find(vars.begin(), vars.end(), var)
+                       - vars.begin()); };
+    auto to_slot_term = [&](const Term& term) {
+        if (term.index() == 1)
+            return SlotTerm{NO_SLOT, std::get<Resource>(term)};
+        const Variable& var = std::get<Variable>(term);
+        Slot slot = slot_of(var);
+        if (slot == (Slot) compiled.slot_variables.size())
+            compiled.slot_variables.push_back(var);
+        return SlotTerm{slot, INVALID_RESOURCE}; };
+
+    for (const PlanStep& step : plan) {
+        auto& [a,b,c] = step.pattern;
+        SlotTerm s = to_slot_term(a), p = to_slot_term(b),
+                 o = to_slot_term(c);
+        compiled.patterns.emplace_back(s, p, o);
+        compiled.joins.push_back(step.join);
+    }
+    for (const Variable& var : variables) {
+        Slot slot = slot_of(var);
+        compiled.projection.push_back(
+            slot < (Slot) compiled.slot_variables.size() ? slot : NO_SLOT);
+    }
+    return compiled;
+}
+
+/**
+ * @brief Replaces the parameters of a pattern with their values
+ * 
+ * @param pattern Pattern of a prepared query
+ * @param parameters Value of each parameter
+ * @return TriplePattern The pattern with its parameters bound
+ */
+TriplePattern Query::bind(TriplePattern pattern,
+                          const std::vector<Resource>& parameters) {
+    auto bind_term = [&](Term& term) {
+        if (term.index() == 1 && std::get<Resource>(term) <= FIRST_PARAMETER)
+            term = parameters.at(FIRST_PARAMETER - std::get<Resource>(term));
+    };
+    auto& [a,b,c] = pattern;
+    bind_term(a);
+    bind_term(b);
+    bind_term(c);
+    return pattern;
+}
+
+/**
+ * @brief Replaces the parameters of a compiled query with their values
+ * 
+ * @param compiled Compiled prepared query, modified in place
+ * @param parameters Value of each parameter
+ */
+void Query::bind(CompiledQuery& compiled,
+                 const std::vector<Resource>& parameters) {
+    for (SlotPattern& pattern : compiled.patterns) {
+        auto& [a,b,c] = pattern;
+        for (SlotTerm* term : {&a, &b, &c}) {
+            if (term->slot == NO_SLOT && term->resource <= FIRST_PARAMETER)
+                term->resource = parameters.at(FIRST_PARAMETER
+                                               - term->resource);
+        }
+    }
+}
+
+/**
+ * @brief Checks whether the graph of a query has a cycle
+ * 
+ * The graph has a node for each variable, and each pattern connects the
+ * distinct variables it contains. It has a cycle if a pattern connects
+ * variables already connected by other patterns, for example two patterns
+ * sharing two variables, or three forming a triangle.
+ * 
+ * @param patterns Patterns of the query
+ * @return bool Whether there is a cycle
+ */
+bool Query::_is_cyclic(const std::vector<TriplePattern>& patterns) {
+    // Union-find forest of the variables connected so far
+    std::unordered_map<Variable, Variable> parent;
+    std::function<Variable(const Variable&)> root = [&](const Variable& var) {
+        auto it = parent.find(var);
+        if (it == parent.end() || it->second == var) return var;
+        return it->second = root(it->second); };
+
+    for (const TriplePattern& pattern : patterns) {
+        std::unordered_set<Variable> vars = utils::get_variables(pattern);
+        std::unordered_set<Variable> roots;
+        for (const Variable& var : vars) {
+            if (!roots.insert(root(var)).second) return true;
+        }
+        for (const Variable& var : roots) parent[var] = *roots.begin();
+    }
+    return false;
+}
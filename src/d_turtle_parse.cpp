@@ -6,84 +6,172 @@
  * The component for parsing and importing Turtle files.
  * Partial implementation of the System class, alongside `b_query_evaluate.cpp`.
  */
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <exception>
-#include <iostream>
-#include <sstream>
+#include <ostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
 #include <tuple>
+#include <MappedFile.h>
 #include <System.h>
 #include <utils.h>
 
 /**
- * @brief Load triples from a string in N-Triples format into the system
+ * @brief Load triples from a file in N-Triples format into the system
  * 
- * Prints number of triples loaded and time taken to stdout.
+ * The memory-mapped file is streamed through once, splitting it into
+ * words in place and encoding each triple as soon as it has been read.
+ * Pages of the file that have been processed are released as loading
+ * progresses. The encoded triples are then added to the index as a single
+ * batch, letting it build its structures in bulk.
  * 
- * @param str N-Triples-formatted string (likely loaded from a file)
+ * This is done on a copy of the current dictionary and a new index, which
+ * are only published once the whole file has been loaded, so if the file
+ * has an error no triples from it are added. The index's lazily computed
+ * structures, such as its statistics, are brought up to date before it is
+ * published. Queries meanwhile read the current version.
+ * 
+ * Prints number of triples loaded, time taken and throughput.
+ * 
+ * @param file Memory-mapped N-Triples file
+ * @param out Stream to print to
  */
-void System::load_triples(std::string str) {
+void System::load_triples(const MappedFile& file, std::ostream& out) {
     auto start = std::chrono::high_resolution_clock::now();
+    std::lock_guard<std::mutex> guard(_write_lock);
+    std::shared_ptr<const _Version> current = std::atomic_load(&_version);
+    auto next = std::make_shared<_Version>();
+    next->dictionary = current->dictionary;
 
-    // Split by whitespace
-    std::stringstream stream(str);
-    std::vector<std::string> words;
-    for (std::string word; stream>>word;) words.push_back(word);
+    // Encode the triples first, then add them to the index as one batch
+    file.advise_sequential();
+    std::vector<ResourceTriple> batch;
+    if (_threads > 1) _load_parallel(file, next->dictionary, batch);
+    else _load_sequential(file, next->dictionary, batch);
+    size_t triples = batch.size();
+    next->index = current->index->extended(batch, _threads);
+    next->index->prepare_reads();
+    _publish(next);
+
+    // Print summary
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+        (end-start).count();
+    out << triples << " triples loaded in " << elapsed/1000 << " ms ("
+        << (long) (triples * 1e6 / std::max<long>(elapsed, 1))
+        << " triples/s)." << std::endl;
+}
 
-    // Check it's the right length
-    if (words.size() % 4 != 0)
-        throw std::invalid_argument("Invalid N-Triples syntax");
+/**
+ * @brief Helper function to make a new version of the store's contents the
+ *      current one
+ * 
+ * The version's index must already be ready for concurrent reads. Queries
+ * already running carry on reading the version they started with, which
+ * is freed once the last of them finishes. The version is numbered one
+ * after the current one, which makes cached plans for earlier versions
+ * out of date.
+ * 
+ * @param version Version to publish
+ */
+void System::_publish(std::shared_ptr<_Version> version) {
+    version->generation = std::atomic_load(&_version)->generation + 1;
+    std::atomic_store(&_version,
+                      std::shared_ptr<const _Version>(std::move(version)));
+}
+
+/**
+ * @brief Single-threaded implementation of System::load_triples
+ * 
+ * @param file Memory-mapped N-Triples file
+ * @param dictionary Dictionary to encode resources with, adding new ones
+ * @param batch Vector to append the encoded triples to
+ */
+void System::_load_sequential(const MappedFile& file, Dictionary& dictionary,
+                              std::vector<ResourceTriple>& batch) {
+    std::string_view contents = file.contents();
 
-    // Parse each resource
-    for (int i=0; i < words.size(); i += 4) {
-        if (words[i+3] != ".")
+    // Read whitespace-separated words four at a time
+    size_t pos = 0, released = 0;
+    std::string_view words[4];
+    while (true) {
+        int n = 0;
+        while (n < 4 && !(words[n] = _next_word(contents, pos)).empty()) n++;
+        if (n == 0) break;
+        if (n < 4) throw std::invalid_argument("Invalid N-Triples syntax");
+        if (words[3] != ".")
             throw std::invalid_argument("Triples must be separated by periods");
-        Resource s = _encode_resource(words[i]);
-        Resource p = _encode_resource(words[i+1]);
-        Resource o = _encode_resource(words[i+2]);
-        _index.add(s, p, o);
+        Resource s = _encode_resource(dictionary, words[0]);
+        Resource p = _encode_resource(dictionary, words[1]);
+        Resource o = _encode_resource(dictionary, words[2]);
+        batch.emplace_back(s, p, o);
+
+        // Drop pages we have finished with
+        if (pos - released >= _RELEASE_BYTES) {
+            file.release(pos);
+            released = pos;
+        }
     }
+}
 
-    // Print summary
-    auto end = std::chrono::high_resolution_clock::now();
-    int elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>
-        (end-start).count();
-    std::cout << words.size()/4 << " triples loaded in "
-              << elapsed_ms <<" ms." << std::endl;
+/**
+ * @brief Helper function to read the next whitespace-separated word
+ * 
+ * @param str String to read from
+ * @param pos Position to start reading at; updated to just after the word
+ * @return std::string_view The word, or an empty view if none remain
+ */
+std::string_view System::_next_word(std::string_view str, size_t& pos) {
+    while (pos < str.size() && std::isspace((unsigned char) str[pos])) pos++;
+    size_t begin = pos;
+    while (pos < str.size() && !std::isspace((unsigned char) str[pos])) pos++;
+    return str.substr(begin, pos-begin);
 }
 
 /**
  * @brief Helper function to encode a URI-specified resource into an integer
  * 
- * Looks up the URI in the existing hash-map, or creates a new entry if it
- * doesn't exist.
+ * Looks up the URI in the dictionary, or adds it if it doesn't exist.
  * 
- * @param name URI of the resource
+ * @param dictionary Dictionary to encode with
+ * @param view URI of the resource
  * @return Resource Integer ID to be used internally for this resource
  */
-Resource System::_encode_resource(std::string name) {
-    int n = name.length();
-    bool valid = (name[0] == '<' && name[n-1] == '>') ||
-                 (name[0] == '"' && name[n-1] == '"');
+Resource System::_encode_resource(Dictionary& dictionary,
+                                  std::string_view view) {
+    _check_resource(view);
+    return dictionary.encode(view);
+}
+
+/**
+ * @brief Helper function to check the syntax of a resource
+ * 
+ * @param view URI or literal, which must be enclosed in angle brackets or
+ *      quotes respectively
+ */
+void System::_check_resource(std::string_view view) {
+    int n = view.length();
+    bool valid = n >= 2 && ((view[0] == '<' && view[n-1] == '>') ||
+                            (view[0] == '"' && view[n-1] == '"'));
     if (!valid) throw std::invalid_argument(
             "Resources must be enclosed in quotes or angle brackets");
-    // Add this resource to our hash map if we haven't seen it before
-    if (_resource_ids.count(name) == 0) {
-        _stored_resources.push_back(name);
-        _resource_ids[name] = _stored_resources.size()-1;
-    }
-    return _resource_ids[name];
 }
 
 /**
  * @brief Gets the URI of an integer-encoded resource
  * 
- * Looks up the ID in hash-map.
+ * Looks up the ID in the dictionary.
  * 
+ * @param dictionary Dictionary to decode with
  * @param id Integer ID representing the resource
  * @return std::string URI of the resource
  */
-std::string System::_decode_resource(Resource id) {
-    if (id >= _stored_resources.size())
+std::string System::_decode_resource(const Dictionary& dictionary,
+                                     Resource id) {
+    if (id < 0 || (size_t) id >= dictionary.size())
         throw std::invalid_argument("Resource ID does not exist");
-    return _stored_resources[id];
+    return dictionary.decode(id);
 }
\ No newline at end of file
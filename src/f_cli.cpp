@@ -7,10 +7,14 @@
  * Contains the main() function called upon execution of the program.
  */
 #include <algorithm>
-#include <iostream>
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
-#include <sstream>
+#include <iostream>
+#include <memory>
 #include <string>
+#include <RDFIndex.h>
+#include <Server.h>
 #include <System.h>
 #include <utils.h>
 
@@ -18,30 +22,138 @@
  * @brief Main function, called by executable. Invokes CLI.
  * 
  * Immediately displays a command prompt and repeatedly listens for one of
- * four commands:
+ * the following commands:
  *  - `LOAD [file_name]`: Load triples from a Turtle file names `file_name`.
  *          Path should be relative to the directory containing the executable.
- *          Not guaranteed to be atomic.
+ *          Atomic: if the file has an error, none of its triples are added.
  *  - `SELECT [rest_of_query]`: Evaluate the supplied BGP SPARQL query,
  *          printing results to stdout.
  *  - `COUNT [rest_of_query]`: Evaluate the supplied BGP SPARQL query,
  *          printing only the *number* of results to stdout.
+ *  - `SAVE [file_name]`: Save all stored resources and triples to a binary
+ *          snapshot file.
+ *  - `OPEN [file_name]`: Replace all stored resources and triples with
+ *          those in a snapshot file. Add `VERIFY` after the file name to
+ *          check the whole file against its checksums first.
+ *  - `PREPARE [name] AS [query]`: Prepare a `SELECT` or `COUNT` query for
+ *          executing many times, with parameters `$1`, `$2` and so on in
+ *          place of some resources.
+ *  - `EXECUTE [name] ([resource], ...)`: Execute a prepared query with the
+ *          given resources in place of its parameters.
+ *  - `EXPLAIN [ANALYZE] SELECT|COUNT [rest_of_query]`: Print the plan of a
+ *          query and the engine evaluating it. With `ANALYZE`, also run it
+ *          with that engine without printing its results and print the
+ *          index probes, matches, rejected matches, rows and time of each
+ *          pattern as far as the engine tracks them, with hardware event
+ *          counts where available.
+ *  - `MEMORY [JSON]`: Print the entries and bytes held by each structure
+ *          of the index and dictionary, the bytes per triple and the
+ *          resident set size, as a table or as a single JSON object.
  *  - `QUIT`: Exit the command line interface and terminate the program.
  * 
- * The `SELECT` and `COUNT` commands support multi-line queries as long as the
- * opening brace occurs on the first line. It should thus be possible to paste
- * a multi-line query from a file into the command line and have it executed.
+ * Queries are only parsed and planned the first time they are seen after
+ * each `LOAD` or `OPEN`; with `-v`, the plan cache's hit rate is printed.
+ * 
+ * The `SELECT`, `COUNT`, `PREPARE` and `EXPLAIN` commands support
+ * multi-line queries as long as the opening brace occurs on the first
+ * line. It should thus be possible to paste a multi-line query from a file
+ * into the command line and have it executed.
  * 
  * If the executable is invoked with flag `-v` then all `SELECT` and `COUNT`
- * commands will also print the join order used to stdout.
+ * commands will also print the join order and join operators used to stdout.
+ * 
+ * The flag `--index=[type]` selects the index implementation: `linked` (the
+ * default) for the linked-list index from the paper, or `permutation` for
+ * sorted permutation arrays. The flag `--threads=[n]` makes `LOAD` use `n`
+ * threads, which requires each triple in the file to be on a single line,
+ * and `SELECT` and `COUNT` evaluate acyclic queries on `n` threads. The
+ * flag `--compress=[n]` makes the linked index keep lists of at least `n`
+ * rows compressed for faster scans (1024 by default, or 0 for none).
+ * 
+ * The flag `--output=[path]` makes `SELECT` print its results to the given
+ * file or named pipe instead of stdout, for results too many to display.
+ * 
+ * The flag `--serve=[address]` starts a query server instead of the prompt,
+ * listening on the given port of `127.0.0.1` if the address is a number, or
+ * on a Unix socket at the given path otherwise. Each request is one of the
+ * commands above on a single line, and each response is a line holding
+ * `OK` or `ERROR` and the length of the output that follows; see `Server.h`.
+ * The flag `--workers=[n]` sets the number of connections served at once
+ * (4 by default), `--queue=[n]` the number of further connections allowed
+ * to wait before others are turned away (64 by default), and
+ * `--timeout=[ms]` the time allowed for each query (10000 by default, or 0
+ * for no limit), and `--idle-timeout=[ms]` the time after which a
+ * connection waiting for its client is closed (30000 by default, or 0 for
+ * no limit).
  * 
  * @return int 0 on successful termination
  */
 int main(int argc, char** argv) {
-    System system;
-    bool output_join_order = (argc > 1 && std::string(argv[1]) == "-v");
+    bool output_join_order = false;
+    std::string index_type = "linked";
+    int threads = 1;
+    size_t compress_threshold = RDFIndex::COMPRESS_THRESHOLD;
+    std::string output_path, serve_address;
+    int workers = 4, queue_limit = 64, timeout_ms = 10000;
+    int idle_timeout_ms = 30000;
+    for (int i=1; i<argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-v") output_join_order = true;
+        else if (arg.rfind("--index=", 0) == 0) index_type = arg.substr(8);
+        else if (arg.rfind("--threads=", 0) == 0)
+            threads = std::max(1, std::atoi(arg.c_str() + 10));
+        else if (arg.rfind("--compress=", 0) == 0)
+            compress_threshold = std::max(0, std::atoi(arg.c_str() + 11));
+        else if (arg.rfind("--output=", 0) == 0) output_path = arg.substr(9);
+        else if (arg.rfind("--serve=", 0) == 0) serve_address = arg.substr(8);
+        else if (arg.rfind("--workers=", 0) == 0)
+            workers = std::max(1, std::atoi(arg.c_str() + 10));
+        else if (arg.rfind("--queue=", 0) == 0)
+            queue_limit = std::max(1, std::atoi(arg.c_str() + 8));
+        else if (arg.rfind("--timeout=", 0) == 0)
+            timeout_ms = std::max(0, std::atoi(arg.c_str() + 10));
+        else if (arg.rfind("--idle-timeout=", 0) == 0)
+            idle_timeout_ms = std::max(0, std::atoi(arg.c_str() + 15));
+        else {
+            std::cout << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    std::unique_ptr<System> system_ptr;
+    try {
+        system_ptr = std::make_unique<System>(index_type, threads,
+                                              compress_threshold);
+    } catch (std::invalid_argument e) {
+        std::cout << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    System& system = *system_ptr;
+    std::ofstream results;
+    if (!output_path.empty()) {
+        if (!serve_address.empty()) {
+            std::cout << "Error: --output cannot be used with --serve"
+                      << std::endl;
+            return 1;
+        }
+        results.open(output_path, std::ios::binary);
+        if (!results) {
+            std::cout << "Error: Could not open " << output_path << std::endl;
+            return 1;
+        }
+        system.redirect_results(&results);
+    }
+    if (!serve_address.empty()) {
+        try {
+            Server(system, workers, queue_limit,
+                   std::chrono::milliseconds(timeout_ms),
+                   std::chrono::milliseconds(idle_timeout_ms),
+                   output_join_order).serve(serve_address);
+        } catch (std::invalid_argument e) {
+            std::cout << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
     bool ready = true;
-    bool loading_triples = false;
 
     while (ready) {
         // Wait for command
@@ -71,52 +183,10 @@ int main(int argc, char** argv) {
 
         // Execute the correct command
         try {
-            switch (command) {
-                case Command::LOAD: {
-                    // Strip whitespace
-                    std::stringstream ss;
-                    ss << details;
-                    std::string filename;
-                    ss >> filename;
-
-                    // Load from file
-                    std::ifstream file(filename);
-                    if (!file.is_open())
-                        throw std::invalid_argument(
-                            "File not found. Check the path and try again.");
-                    std::stringstream stream;
-                    stream << file.rdbuf();
-
-                    // Process triples
-                    loading_triples = true;
-                    system.load_triples(stream.str());
-                    file.close();
-                    loading_triples = false;
-                    break;
-                }
-                case Command::SELECT: {
-                    // Print enabled
-                    system.evaluate_query(details, true, output_join_order);
-                    break;
-                }
-                case Command::COUNT: {
-                    // Print disabled
-                    system.evaluate_query(details, false, output_join_order);
-                    break;
-                } 
-                case Command::QUIT: {
-                    ready = false;
-                    break;
-                }
-            }
+            ready = system.execute(command, details, std::cout,
+                                   output_join_order, NO_DEADLINE);
         } catch (std::invalid_argument e) {
             std::cout << "Error: " << e.what() << std::endl;
-            if (loading_triples) {
-                std::cout << "Input file processing terminated due to error. "
-                          << "Please note that any triples already processed "
-                          << "may be retained." << std::endl;
-                loading_triples = false;
-            }
         }
     }
     return 0;
@@ -0,0 +1,602 @@
+/**
+ * @file g_permutation_index.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (g)
+ *
+ * Alternative RDF indexing data structure based on sorted permutations.
+ * Full implementation of the PermutationIndex class.
+ */
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include <PermutationIndex.h>
+#include <utils.h>
+
+/**
+ * @brief Adds a triple to the index structure
+ *
+ * The triple is buffered, and only becomes part of the permutations (with
+ * any duplicates removed) on the next call to PermutationIndex::evaluate.
+ *
+ * @param s Subject resource
+ * @param p Predicate resource
+ * @param o Object resource
+ */
+void PermutationIndex::add(Resource s, Resource p, Resource o) {
+    _pending.push_back({s, p, o});
+}
+
+/**
+ * @brief Adds a batch of triples to the index structure
+ *
+ * The triples are buffered as by PermutationIndex::add, and the given
+ * number of threads is used to sort them into the permutations.
+ *
+ * @param triples Triples to add, possibly including duplicates
+ * @param threads Number of threads to use
+ */
+void PermutationIndex::add_bulk(std::vector<ResourceTriple>& triples,
+                                int threads) {
+    _pending.reserve(_pending.size() + triples.size());
+    for (auto [s, p, o] : triples) _pending.push_back({s, p, o});
+    _threads = threads;
+}
+
+/**
+ * @brief Creates a new index holding the index's triples and a batch of
+ *      triples, leaving the index itself unchanged
+ *
+ * The new index reads the index's permutations in place while merging the
+ * triples into permutations of its own, and shares them instead if the
+ * triples are all present already.
+ *
+ * @param triples Triples to add, possibly including duplicates
+ * @param threads Number of threads to use
+ * @return std::unique_ptr<RDFIndex> The new index
+ */
+std::unique_ptr<RDFIndex> PermutationIndex::extended(
+        std::vector<ResourceTriple>& triples, int threads) const {
+    auto next = std::make_unique<PermutationIndex>();
+    next->_pending = _pending;
+    next->add_bulk(triples, threads);
+    next->_merge_pending(*this);
+    return next;
+}
+
+/**
+ * @brief Evaluates a triple pattern over the data in the index structure
+ *
+ * Returns an iterator over all matches for the given triple pattern, with
+ * the same contract as LinkedIndex::evaluate. This wraps a
+ * PermutationIndex::Cursor for callers not specialised to this
+ * implementation.
+ *
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ * @param row Row of bindings to write matches into
+ * @return std::function<bool()> Call this repeatedly to iterate over all
+ *      matches.
+ */
+std::function<bool()> PermutationIndex::evaluate(SlotTerm a, SlotTerm b,
+                                                 SlotTerm c, Resource* row) {
+    Cursor cursor(*this);
+    cursor.open(a, b, c);
+    return [=]() mutable { return cursor.next(row); };
+}
+
+/**
+ * @brief Counts the candidates for a triple pattern
+ *
+ * This is the size of the range the pattern's cursor would scan, so is
+ * exact unless the pattern repeats a variable.
+ *
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ * @return size_t Upper bound on the number of matches
+ */
+size_t PermutationIndex::estimate(SlotTerm a, SlotTerm b, SlotTerm c) {
+    Cursor cursor(*this);
+    cursor.open(a, b, c);
+    return cursor.remaining();
+}
+
+/**
+ * @brief Counts the matches of a triple pattern exactly
+ *
+ * Unless the pattern repeats a variable, this is the size of the range its
+ * cursor would scan, so no matches are read.
+ *
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ * @return size_t Number of matches
+ */
+size_t PermutationIndex::count(SlotTerm a, SlotTerm b, SlotTerm c) {
+    bool repeated = _local_slots(a, b, c);
+    Cursor cursor(*this);
+    cursor.open(a, b, c);
+    if (!repeated) return cursor.remaining();
+    Resource row[3];
+    size_t n = 0;
+    while (cursor.next(row)) n++;
+    return n;
+}
+
+/**
+ * @brief Gets the statistics of all triples in the index
+ *
+ * @return TripleStatistics Numbers of triples, and of distinct subjects,
+ *      predicates and objects
+ */
+TripleStatistics PermutationIndex::statistics() {
+    _compute_statistics();
+    return _stats;
+}
+
+/**
+ * @brief Gets the statistics of the triples with a given predicate
+ *
+ * @param p Predicate resource
+ * @return TripleStatistics Numbers of triples, and of distinct subjects,
+ *      predicates and objects
+ */
+TripleStatistics PermutationIndex::statistics(Resource p) {
+    _compute_statistics();
+    ArrayView<Resource> predicates = _stats_predicates.view();
+    auto it = std::lower_bound(predicates.begin(), predicates.end(), p);
+    if (it == predicates.end() || *it != p) return TripleStatistics{};
+    return _stats_P[it - predicates.begin()];
+}
+
+/**
+ * @brief Estimates the number of matches of a subject star
+ *
+ * Uses the characteristic sets of the subjects, computed from the SPO
+ * permutation when first needed or read from a snapshot.
+ *
+ * @param predicates Predicates of the star's patterns
+ * @return double Estimated number of matches
+ */
+double PermutationIndex::estimate_star(
+        const std::vector<Resource>& predicates) {
+    _compute_statistics();
+    return _sets.estimate_star(predicates);
+}
+
+/**
+ * @brief Merges any buffered triples and computes the statistics, which
+ *      reads would otherwise do when first needed
+ */
+void PermutationIndex::prepare_reads() {
+    _compute_statistics();
+}
+
+/**
+ * @brief Gets the position of the term matches of a pattern are sorted by
+ *
+ * Within the range scanned for a pattern, pairs are sorted by their first
+ * resource, and by their second if the first is fixed too. A whole
+ * permutation is sorted by its leading resource.
+ *
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ * @return int Position (0 to 2) of the term in the pattern, or -1 for a
+ *      pattern with at most one match
+ */
+int PermutationIndex::order(SlotTerm a, SlotTerm b, SlotTerm c) {
+    switch (utils::get_pattern_type(std::make_tuple(a, b, c))) {
+    case XYZ: return 0;    // SPO, by subject
+    case SYZ: return 1;    // SPO, by predicate
+    case XYO: return 0;    // OSP, by subject
+    case XPZ: return 2;    // POS, by object
+    case SPZ: return 2;    // SPO, by object
+    case XPO: return 0;    // POS, by subject
+    case SYO: return 1;    // OSP, by predicate
+    default: return -1;
+    }
+}
+
+/**
+ * @brief Positions the cursor at the first candidate for a triple pattern
+ *
+ * Each pattern type is resolved to a contiguous range of one permutation
+ * by looking up the leading resource and, where a second resource is
+ * bound, a binary search within its range. Any triples added since the
+ * permutations were last built are merged in first.
+ *
+ * @param a Subject term (holding a variable slot or resource)
+ * @param b Predicate term (holding a variable slot or resource)
+ * @param c Object term (holding a variable slot or resource)
+ */
+void PermutationIndex::Cursor::open(SlotTerm a, SlotTerm b, SlotTerm c) {
+    PermutationIndex& index = *_index;
+    index._flush();
+    _filter = _ANY;
+
+    // The permutation to scan, and the range of pairs to scan within it
+    const _Permutation* perm = &index._spo;
+    std::pair<uint32_t, uint32_t> range = {0, 0};
+
+    switch (utils::get_pattern_type(std::make_tuple(a, b, c))) {
+    case XYZ: {
+        Slot x = a.slot, y = b.slot, z = c.slot;
+        // Enable filtering if we have repeated variables
+        if (x == y && y == z) _filter = _ALL_SAME;
+        else if (x == y) _filter = _KEY_IS_FIRST;
+        else if (y == z) _filter = _FIRST_IS_SECOND;
+        else if (x == z) _filter = _KEY_IS_SECOND;
+        // Scan the whole SPO permutation
+        perm = &index._spo;
+        range = {0, (uint32_t) index._spo.pairs.size()};
+        break; }
+    case SYZ: // Similar for the remaining cases
+        if (b.slot == c.slot) _filter = _FIRST_IS_SECOND;
+        perm = &index._spo;
+        range = _range(index._spo, a.resource);
+        break;
+    case XYO:
+        if (a.slot == b.slot) _filter = _FIRST_IS_SECOND;
+        perm = &index._osp;
+        range = _range(index._osp, c.resource);
+        break;
+    case XPZ:
+        if (a.slot == c.slot) _filter = _FIRST_IS_SECOND;
+        perm = &index._pos;
+        range = _range(index._pos, b.resource);
+        break;
+    case SPZ:
+        perm = &index._spo;
+        range = _range(index._spo, a.resource, b.resource);
+        break;
+    case XPO:
+        perm = &index._pos;
+        range = _range(index._pos, b.resource, c.resource);
+        break;
+    case SYO:
+        perm = &index._osp;
+        range = _range(index._osp, c.resource, a.resource);
+        break;
+    case SPO: {
+        Resource s = a.resource, p = b.resource, o = c.resource;
+        perm = &index._spo;
+        range = _range(index._spo, s, p);
+        // Narrow the p-group down to the single matching object, if any
+        auto first = index._spo.pairs.begin() + range.first;
+        auto last = index._spo.pairs.begin() + range.second;
+        auto it = std::lower_bound(first, last, _Pair{p, o});
+        range.first = it - index._spo.pairs.begin();
+        range.second = (it != last && it->second == o) ? range.first+1
+                                                        : range.first;
+        break; }
+    }
+
+    // Terms giving the leading resource and pair of each candidate
+    SlotTerm key, first, second;
+    if (perm == &index._spo) std::tie(key, first, second) = std::tie(a, b, c);
+    else if (perm == &index._pos) std::tie(key, first, second) =
+        std::tie(b, c, a);
+    else std::tie(key, first, second) = std::tie(c, a, b);
+    _key_slot = key.slot, _first_slot = first.slot, _second_slot = second.slot;
+
+    _offsets = perm->offsets.data();
+    _pairs = perm->pairs.data();
+    _i = range.first, _end = range.second;
+    // Whole-permutation scans find their leading resource as they go
+    _key = (key.slot == NO_SLOT) ? key.resource : 0;
+}
+
+/**
+ * @brief Reports the memory held by each of the index's structures
+ *
+ * Permutations used in place from a snapshot are reported as mapped, and
+ * statistics as they were last computed.
+ *
+ * @param usage Vector to append one entry per structure to
+ */
+void PermutationIndex::report_memory(std::vector<MemoryUsage>& usage) const {
+    const char* names[] = {"index.spo", "index.pos", "index.osp"};
+    const _Permutation* perms[] = {&_spo, &_pos, &_osp};
+    for (int k = 0; k < 3; k++) {
+        const _Permutation& perm = *perms[k];
+        bool mapped = !perm.pairs_storage;
+        size_t bytes = mapped ? 0 :
+            perm.offsets_storage->capacity() * sizeof(uint32_t) +
+            perm.pairs_storage->capacity() * sizeof(_Pair);
+        size_t mapped_bytes = !mapped ? 0 :
+            perm.offsets.size() * sizeof(uint32_t) +
+            perm.pairs.size() * sizeof(_Pair);
+        usage.push_back(MemoryUsage{names[k], perm.pairs.size(), bytes,
+                                    mapped_bytes});
+    }
+    usage.push_back(MemoryUsage{"index.pending", _pending.size(),
+        _pending.capacity() * sizeof(_pending[0]), 0});
+    usage.push_back(MemoryUsage{"index.stats_P", _stats_P.size(),
+        _stats_P.memory_usage() + _stats_predicates.memory_usage(),
+        _stats_P.mapped_bytes() + _stats_predicates.mapped_bytes()});
+    usage.push_back(MemoryUsage{"index.characteristic_sets", _sets.size(),
+                                _sets.memory_usage(), 0});
+}
+
+/**
+ * @brief Writes the permutations and their statistics to a snapshot
+ *
+ * @param writer Snapshot being written
+ */
+void PermutationIndex::save(SnapshotWriter& writer) {
+    _compute_statistics();
+    writer.write(SPO_OFFSETS, _spo.offsets);
+    writer.write(SPO_PAIRS, _spo.pairs);
+    writer.write(POS_OFFSETS, _pos.offsets);
+    writer.write(POS_PAIRS, _pos.pairs);
+    writer.write(OSP_OFFSETS, _osp.offsets);
+    writer.write(OSP_PAIRS, _osp.pairs);
+    writer.write(STATISTICS, ArrayView<TripleStatistics>(&_stats, 1));
+    writer.write(STATISTICS_PREDICATES, _stats_predicates.view());
+    writer.write(PREDICATE_STATISTICS, _stats_P.view());
+    _sets.save(writer);
+}
+
+/**
+ * @brief Replaces the contents of the index with the triples in a snapshot
+ *
+ * The permutations and the statistics of each predicate are used in place
+ * within the mapped snapshot file. They are only copied into memory if
+ * more triples are added later. The characteristic sets are read in full,
+ * but nothing else is read until queries need it.
+ *
+ * @param snapshot Snapshot to open
+ * @param verify Whether to check the checksums of the permutations and
+ *      statistics
+ * @param threads Unused
+ */
+void PermutationIndex::open(const Snapshot& snapshot, bool verify, int) {
+    _Permutation* perms[] = {&_spo, &_pos, &_osp};
+    SnapshotSection sections[] = {SPO_OFFSETS, POS_OFFSETS, OSP_OFFSETS};
+    for (int k = 0; k < 3; k++) {
+        _Permutation& perm = *perms[k];
+        perm.offsets = snapshot.section<uint32_t>(sections[k], verify);
+        perm.pairs = snapshot.section<_Pair>(
+            (SnapshotSection) (sections[k]+1), verify);
+        size_t size = perm.offsets.empty()
+                      ? 0 : perm.offsets[perm.offsets.size()-1];
+        if (size != perm.pairs.size())
+            throw std::invalid_argument("Snapshot index is corrupt");
+        perm.offsets_storage.reset();
+        perm.pairs_storage.reset();
+    }
+    auto stats = snapshot.section<TripleStatistics>(STATISTICS, verify);
+    _stats_predicates.map(
+        snapshot.section<Resource>(STATISTICS_PREDICATES, verify));
+    _stats_P.map(
+        snapshot.section<TripleStatistics>(PREDICATE_STATISTICS, verify));
+    if (stats.size() != 1 || _stats_P.size() != _stats_predicates.size())
+        throw std::invalid_argument("Snapshot index is corrupt");
+    _stats = stats[0];
+    _sets.open(snapshot);
+    _pending.clear();
+    _mapping = snapshot.mapping();
+    _stats_valid = true;
+}
+
+/**
+ * @brief Merges buffered triples into the permutations
+ */
+void PermutationIndex::_flush() {
+    if (!_pending.empty()) _merge_pending(*this);
+}
+
+/**
+ * @brief Helper function to make the permutations those of an index with
+ *      the buffered triples merged in
+ *
+ * The buffered triples are sorted and those already present dropped, so
+ * only the new triples are sorted into the order of each permutation, and
+ * each permutation is then merged with them in one pass. The existing
+ * permutations are only read, whether in memory or mapped from a snapshot,
+ * and are shared rather than merged if no triple is new.
+ *
+ * @param base Index holding the existing triples, possibly this one
+ */
+void PermutationIndex::_merge_pending(const PermutationIndex& base) {
+    std::vector<std::array<Resource, 3>> added;
+    added.swap(_pending);
+    utils::parallel_sort(added, _threads,
+                         std::less<std::array<Resource, 3>>());
+    added.erase(std::unique(added.begin(), added.end()), added.end());
+    added.erase(std::remove_if(added.begin(), added.end(),
+        [&](const std::array<Resource, 3>& t) {
+            return base._contains(t[0], t[1], t[2]); }), added.end());
+    if (&base != this) {
+        _spo = base._spo;
+        _pos = base._pos;
+        _osp = base._osp;
+        _mapping = base._mapping;
+    }
+    if (added.empty()) return;
+
+    _Permutation* perms[] = {&_spo, &_pos, &_osp};
+    const int orders[3][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}};
+    for (int k = 0; k < 3; k++) {
+        int a = orders[k][0], b = orders[k][1], c = orders[k][2];
+        // The triples are already in SPO order
+        if (k > 0) {
+            utils::parallel_sort(added, _threads, [=](auto& t1, auto& t2) {
+                return std::tie(t1[a], t1[b], t1[c]) <
+                       std::tie(t2[a], t2[b], t2[c]); });
+        }
+        *perms[k] = _merge(*perms[k], added, a, b, c, _threads);
+    }
+    _mapping.reset();
+    _stats_valid = false;
+}
+
+/**
+ * @brief Helper function to check whether the permutations hold a triple
+ *
+ * @param s Subject resource
+ * @param p Predicate resource
+ * @param o Object resource
+ * @return bool Whether the triple is present
+ */
+bool PermutationIndex::_contains(Resource s, Resource p, Resource o) const {
+    auto [first, last] = _range(_spo, s, p);
+    auto begin = _spo.pairs.begin();
+    auto it = std::lower_bound(begin + first, begin + last, _Pair{p, o});
+    return it != begin + last && it->second == o;
+}
+
+/**
+ * @brief Computes the statistics of the triples, if not already up to date
+ *
+ * Each predicate's triples are a range of the POS permutation, sorted by
+ * object, and the triples with each subject a range of the SPO
+ * permutation, sorted by predicate, so every count takes one pass. The
+ * characteristic sets of the subjects are gathered in the same pass.
+ */
+void PermutationIndex::_compute_statistics() {
+    _flush();
+    if (_stats_valid) return;
+    _stats = TripleStatistics{_spo.pairs.size(), 0, 0, 0};
+    std::vector<Resource> predicates;
+    std::vector<TripleStatistics> stats_P;
+    // Position of each predicate within the above
+    std::vector<uint32_t> positions(_pos.offsets.size());
+    for (size_t p = 0; p+1 < _pos.offsets.size(); p++) {
+        uint32_t first = _pos.offsets[p], last = _pos.offsets[p+1];
+        if (first == last) continue;
+        positions[p] = predicates.size();
+        predicates.push_back(p);
+        TripleStatistics stats{last - first, 0, 1, 0};
+        for (uint32_t i = first; i < last; i++)
+            stats.objects += i == first ||
+                             _pos.pairs[i].first != _pos.pairs[i-1].first;
+        stats_P.push_back(stats);
+    }
+    _stats.predicates = predicates.size();
+    _sets.clear();
+    CharacteristicSets::Counts counts;
+    for (size_t s = 0; s+1 < _spo.offsets.size(); s++) {
+        uint32_t first = _spo.offsets[s], last = _spo.offsets[s+1];
+        if (first == last) continue;
+        _stats.subjects++;
+        for (uint32_t i = first; i < last; i++) {
+            if (i == first || _spo.pairs[i].first != _spo.pairs[i-1].first) {
+                stats_P[positions[_spo.pairs[i].first]].subjects++;
+                counts.emplace_back(_spo.pairs[i].first, 0);
+            }
+            counts.back().second++;
+        }
+        _sets.add_subject(s, counts);
+        counts.clear();
+    }
+    for (size_t o = 0; o+1 < _osp.offsets.size(); o++)
+        _stats.objects += _osp.offsets[o] != _osp.offsets[o+1];
+    _stats_predicates.assign(std::move(predicates));
+    _stats_P.assign(std::move(stats_P));
+    _stats_valid = true;
+}
+
+/**
+ * @brief Merges triples into a permutation
+ *
+ * The offsets are laid out from the number of existing and new pairs of
+ * each leading resource. The existing pairs of each leading resource are
+ * then merged with its new ones, with blocks of leading resources merged
+ * in parallel.
+ *
+ * @param perm Existing permutation, which is only read
+ * @param triples Triples not in the permutation, distinct and sorted by
+ *      the resources at positions \p a, \p b and \p c
+ * @param a Position of the leading resource within each triple
+ * @param b Position of the second resource within each triple
+ * @param c Position of the third resource within each triple
+ * @param threads Number of threads to use
+ * @return _Permutation Merged permutation, with storage of its own
+ */
+PermutationIndex::_Permutation PermutationIndex::_merge(
+        const _Permutation& perm,
+        const std::vector<std::array<Resource, 3>>& triples,
+        int a, int b, int c, int threads) {
+    size_t old_keys = perm.offsets.empty() ? 0 : perm.offsets.size() - 1;
+    size_t keys = triples.empty() ? old_keys
+        : std::max<size_t>(old_keys, triples.back()[a] + 1);
+    auto offsets = std::make_shared<std::vector<uint32_t>>(keys + 1, 0);
+    for (size_t k = 0; k < old_keys; k++)
+        (*offsets)[k+1] = perm.offsets[k+1] - perm.offsets[k];
+    for (auto& t : triples) (*offsets)[t[a] + 1]++;
+    for (size_t k = 1; k <= keys; k++) (*offsets)[k] += (*offsets)[k-1];
+    auto pairs = std::make_shared<std::vector<_Pair>>(offsets->back());
+
+    const size_t block_keys = 4096;
+    size_t blocks = (keys + block_keys - 1) / block_keys;
+    utils::parallel_for(blocks, threads, [&](size_t block) {
+        size_t first = block * block_keys;
+        size_t last = std::min(keys, first + block_keys);
+        // First new triple of the block
+        size_t j = std::lower_bound(triples.begin(), triples.end(), first,
+            [a](const std::array<Resource, 3>& t, size_t key) {
+                return (size_t) t[a] < key; }) - triples.begin();
+        for (size_t key = first; key < last; key++) {
+            const _Pair* old = perm.pairs.data();
+            const _Pair *i = old, *end = old;
+            if (key < old_keys) {
+                i += perm.offsets[key];
+                end += perm.offsets[key+1];
+            }
+            _Pair* out = pairs->data() + (*offsets)[key];
+            for (; j < triples.size() && (size_t) triples[j][a] == key; j++) {
+                _Pair pair{triples[j][b], triples[j][c]};
+                while (i < end && *i < pair) *out++ = *i++;
+                *out++ = pair;
+            }
+            std::copy(i, end, out);
+        }
+    });
+
+    _Permutation merged;
+    merged.offsets = *offsets;
+    merged.pairs = *pairs;
+    merged.offsets_storage = std::move(offsets);
+    merged.pairs_storage = std::move(pairs);
+    return merged;
+}
+
+/**
+ * @brief Gets the range of pairs in a permutation with a given leading resource
+ *
+ * @param perm Permutation to look in
+ * @param key Leading resource
+ * @return std::pair<uint32_t, uint32_t> Start and end positions of the range
+ */
+std::pair<uint32_t, uint32_t> PermutationIndex::_range(
+        const _Permutation& perm, Resource key) {
+    if (key < 0 || (size_t) key+1 >= perm.offsets.size()) return {0, 0};
+    return {perm.offsets[key], perm.offsets[key+1]};
+}
+
+/**
+ * @brief Gets the range of pairs in a permutation with given leading resources
+ *
+ * @param perm Permutation to look in
+ * @param key Leading resource
+ * @param second Second resource, found by binary search within the range
+ *      for \p key
+ * @return std::pair<uint32_t, uint32_t> Start and end positions of the range
+ */
+std::pair<uint32_t, uint32_t> PermutationIndex::_range(
+        const _Permutation& perm, Resource key, Resource second) {
+    auto [first, last] = _range(perm, key);
+    auto begin = perm.pairs.begin();
+    auto group = std::equal_range(begin + first, begin + last,
+        _Pair{second, 0}, [](const _Pair& p1, const _Pair& p2) {
+            return p1.first < p2.first; });
+    return {(uint32_t) (group.first - begin),
+            (uint32_t) (group.second - begin)};
+}
@@ -0,0 +1,180 @@
+/**
+ * @file h_bulk_load.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (h)
+ * 
+ * The multi-threaded bulk loader for N-Triples files.
+ * Partial implementation of the System class, alongside `d_turtle_parse.cpp`.
+ */
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <Dictionary.h>
+#include <MappedFile.h>
+#include <System.h>
+#include <utils.h>
+
+struct System::_LoadChunk {
+    // Text of this chunk, made up of whole lines
+    std::string_view text;
+    // Distinct resources in order of first appearance, and their IDs
+    std::vector<std::string_view> strings;
+    std::vector<Resource> ids;
+    // Whether each resource is new to the system, seen here for the first time
+    std::vector<char> is_new;
+    // Positions in `strings` of the resources belonging to each shard
+    std::vector<uint32_t> by_shard[Dictionary::SHARDS];
+    // Triples read, as positions in `strings`, three per triple
+    std::vector<uint32_t> triples;
+    // Message of the syntax error ending this chunk, if any
+    std::string error;
+};
+
+/**
+ * @brief Multi-threaded implementation of System::load_triples
+ * 
+ * Processes the file in rounds, each splitting the next part of the file
+ * on line boundaries into one chunk per thread. Chunks are tokenised and
+ * their resources collected in parallel, then looked up in the sharded
+ * dictionary with one thread per shard at a time. Resources are
+ * numbered in order of first appearance in the file and triples are
+ * encoded in file order, so the resulting IDs and index are exactly those
+ * of a single-threaded load.
+ * 
+ * Unlike the single-threaded loader, this requires every triple to be on
+ * a single line, as N-Triples specifies.
+ * 
+ * @param file Memory-mapped N-Triples file
+ * @param dictionary Dictionary to encode resources with, adding new ones
+ * @param batch Vector to append the encoded triples to
+ */
+void System::_load_parallel(const MappedFile& file, Dictionary& dictionary,
+                            std::vector<ResourceTriple>& batch) {
+    std::string_view contents = file.contents();
+    size_t pos = 0;
+
+    while (pos < contents.size()) {
+        // Give each thread a chunk ending at a line boundary
+        std::vector<_LoadChunk> chunks(_threads);
+        for (_LoadChunk& chunk : chunks) {
+            size_t end = std::min(pos + _PARALLEL_CHUNK_BYTES,
+                                  contents.size());
+            while (end < contents.size() && contents[end-1] != '\n') end++;
+            chunk.text = contents.substr(pos, end-pos);
+            pos = end;
+        }
+
+        // Tokenise chunks and collect their distinct resources
+        utils::parallel_for(chunks.size(), _threads, [&](size_t i) {
+            _LoadChunk& chunk = chunks[i];
+            std::unordered_map<std::string_view, uint32_t> positions;
+            size_t at = 0;
+            std::string_view words[4];
+            try {
+                while (true) {
+                    int n = 0;
+                    while (n < 4 && !(words[n] = _next_word(chunk.text, at))
+                                        .empty()) n++;
+                    if (n == 0) break;
+                    if (n < 4) throw std::invalid_argument(
+                        "Invalid N-Triples syntax");
+                    if (words[3] != ".") throw std::invalid_argument(
+                        "Triples must be separated by periods");
+                    for (int j = 0; j < 3; j++) _check_resource(words[j]);
+                    for (int j = 0; j < 3; j++) {
+                        auto [it, added] = positions.try_emplace(
+                            words[j], chunk.strings.size());
+                        if (added) {
+                            chunk.by_shard[Dictionary::shard_of(words[j])]
+                                .push_back(chunk.strings.size());
+                            chunk.strings.push_back(words[j]);
+                        }
+                        chunk.triples.push_back(it->second);
+                    }
+                }
+            } catch (std::invalid_argument& e) {
+                chunk.error = e.what();
+            }
+        });
+
+        // Nothing after the first syntax error is loaded
+        auto failed = std::find_if(chunks.begin(), chunks.end(),
+            [](const _LoadChunk& chunk) { return !chunk.error.empty(); });
+        if (failed != chunks.end()) chunks.erase(failed+1, chunks.end());
+
+        _encode_chunks(chunks, dictionary);
+        for (_LoadChunk& chunk : chunks) {
+            for (size_t t = 0; t < chunk.triples.size(); t += 3)
+                batch.emplace_back(chunk.ids[chunk.triples[t]],
+                                   chunk.ids[chunk.triples[t+1]],
+                                   chunk.ids[chunk.triples[t+2]]);
+        }
+        if (!chunks.back().error.empty())
+            throw std::invalid_argument(chunks.back().error);
+        file.release(pos);
+    }
+}
+
+/**
+ * @brief Helper function to encode the resources of a round of chunks
+ * 
+ * Sets the ID of every distinct resource in each chunk, adding resources
+ * not yet known to the system in order of first appearance across the
+ * chunks. Each shard of the dictionary is only ever searched by one thread
+ * at a time.
+ * 
+ * @param chunks Chunks in file order, each already tokenised
+ * @param dictionary Dictionary to encode resources with, adding new ones
+ */
+void System::_encode_chunks(std::vector<_LoadChunk>& chunks,
+                            Dictionary& dictionary) {
+    for (_LoadChunk& chunk : chunks) {
+        chunk.ids.assign(chunk.strings.size(), INVALID_RESOURCE);
+        chunk.is_new.assign(chunk.strings.size(), false);
+    }
+
+    // Look up each resource in its shard. Resources not yet known are marked
+    // as new in the chunk where they first appear, and later occurrences
+    // are recorded as (chunk, position, first chunk, first position).
+    std::vector<std::vector<std::array<uint32_t, 4>>> repeats(
+        Dictionary::SHARDS);
+    utils::parallel_for(Dictionary::SHARDS, _threads, [&](size_t k) {
+        std::unordered_map<std::string_view,
+                           std::pair<uint32_t, uint32_t>> first;
+        for (uint32_t c = 0; c < chunks.size(); c++) {
+            for (uint32_t i : chunks[c].by_shard[k]) {
+                std::string_view name = chunks[c].strings[i];
+                Resource known = dictionary.find(name);
+                if (known != INVALID_RESOURCE) {
+                    chunks[c].ids[i] = known;
+                    continue;
+                }
+                auto [it, added] = first.try_emplace(name, c, i);
+                if (added) chunks[c].is_new[i] = true;
+                else repeats[k].push_back({c, i, it->second.first,
+                                           it->second.second});
+            }
+        }
+    });
+
+    // Number new resources chunk by chunk, in order of first appearance,
+    // and add them to the dictionary
+    std::vector<std::string_view> names;
+    for (_LoadChunk& chunk : chunks) {
+        for (size_t i = 0; i < chunk.strings.size(); i++) {
+            if (!chunk.is_new[i]) continue;
+            chunk.ids[i] = dictionary.size() + names.size();
+            names.push_back(chunk.strings[i]);
+        }
+    }
+    dictionary.insert_all(names, _threads);
+
+    // Resolve later occurrences of new resources
+    utils::parallel_for(Dictionary::SHARDS, _threads, [&](size_t k) {
+        for (auto [c, i, first_c, first_i] : repeats[k])
+            chunks[c].ids[i] = chunks[first_c].ids[first_i];
+    });
+}
@@ -0,0 +1,266 @@
+/**
+ * @file i_snapshot.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (i)
+ * 
+ * The binary snapshot format used to save and reopen the system's state.
+ * Full implementation of the Snapshot and SnapshotWriter classes, and
+ * partial implementation of the System class.
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <Dictionary.h>
+#include <RDFIndex.h>
+#include <Snapshot.h>
+#include <System.h>
+#include <utils.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Identifies snapshot files, and the version of the format they use
+static const char SNAPSHOT_MAGIC[8] = {'R', 'D', 'F', 'S', 'N', 'A', 'P', 0};
+static const uint32_t SNAPSHOT_VERSION = 3;
+// Sections start at multiples of this many bytes
+static const size_t SNAPSHOT_ALIGNMENT = 4096;
+
+// Layout of the header at the start of a snapshot file
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_sections;
+    struct { uint64_t offset, length, checksum; } sections[
+        NUM_SNAPSHOT_SECTIONS];
+    // Checksum of all of the above
+    uint64_t checksum;
+};
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a byte string
+ * 
+ * @param data Bytes to hash
+ * @param length Number of bytes
+ * @return uint64_t Checksum
+ */
+static uint64_t fnv1a(const char* data, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Maps a snapshot file and validates its header
+ * 
+ * @param filename Path of the snapshot file
+ */
+Snapshot::Snapshot(std::string filename) :
+        _file(std::make_shared<MappedFile>(filename)) {
+    std::string_view contents = _file->contents();
+    if (contents.size() < sizeof(SnapshotHeader))
+        throw std::invalid_argument("Not a snapshot file");
+    SnapshotHeader header;
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)))
+        throw std::invalid_argument("Not a snapshot file");
+    if (header.version != SNAPSHOT_VERSION)
+        throw std::invalid_argument("Unsupported snapshot version "
+                                    + std::to_string(header.version));
+    if (header.checksum != fnv1a(contents.data(),
+                                 offsetof(SnapshotHeader, checksum)))
+        throw std::invalid_argument("Snapshot header is corrupt");
+    if (header.num_sections != NUM_SNAPSHOT_SECTIONS)
+        throw std::invalid_argument("Snapshot header is corrupt");
+    for (auto& section : header.sections) {
+        if (section.offset % SNAPSHOT_ALIGNMENT != 0 ||
+            section.offset > contents.size() ||
+            section.length > contents.size() - section.offset)
+            throw std::invalid_argument("Snapshot file is truncated");
+    }
+}
+
+/**
+ * @brief Helper function to get the bytes of a section
+ * 
+ * @param id Section to get
+ * @param verify Whether to check the section's checksum
+ * @return std::string_view Contents of the section within the mapped file
+ */
+std::string_view Snapshot::_section(SnapshotSection id, bool verify) const {
+    SnapshotHeader header;
+    std::memcpy(&header, _file->contents().data(), sizeof(header));
+    auto& section = header.sections[id];
+    std::string_view bytes = _file->contents().substr(section.offset,
+                                                      section.length);
+    if (verify && fnv1a(bytes.data(), bytes.size()) != section.checksum)
+        throw std::invalid_argument("Snapshot section "
+                                    + std::to_string(id) + " is corrupt");
+    return bytes;
+}
+
+/**
+ * @brief Helper function to create a temporary file next to another
+ * 
+ * @param filename Path of the file to be replaced
+ * @return std::string Path of the new, empty file
+ */
+static std::string create_temporary(const std::string& filename) {
+    std::string path = filename + ".XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0)
+        throw std::invalid_argument("Could not create file " + filename);
+    // mkstemp makes the file private to its owner, unlike a new file
+    fchmod(fd, 0644);
+    close(fd);
+    return path;
+}
+
+/**
+ * @brief Creates a temporary snapshot file, leaving space for its header
+ * 
+ * @param filename Path of the snapshot file; replaced by `finish` if it
+ *      exists
+ */
+SnapshotWriter::SnapshotWriter(std::string filename) :
+        _filename(filename), _temporary(create_temporary(filename)),
+        _out(_temporary, std::ios::binary | std::ios::trunc),
+        _offsets(NUM_SNAPSHOT_SECTIONS), _lengths(NUM_SNAPSHOT_SECTIONS),
+        _checksums(NUM_SNAPSHOT_SECTIONS, fnv1a(nullptr, 0)) {
+    if (!_out.is_open()) {
+        unlink(_temporary.c_str());
+        throw std::invalid_argument("Could not create file " + filename);
+    }
+    std::vector<char> blank(SNAPSHOT_ALIGNMENT, 0);
+    _out.write(blank.data(), blank.size());
+}
+
+/**
+ * @brief Removes the temporary file unless the snapshot was completed
+ */
+SnapshotWriter::~SnapshotWriter() {
+    if (!_finished) {
+        _out.close();
+        unlink(_temporary.c_str());
+    }
+}
+
+/**
+ * @brief Helper function to write the bytes of a section
+ * 
+ * @param id Section to write
+ * @param data Bytes to write
+ * @param length Number of bytes
+ */
+void SnapshotWriter::_write(SnapshotSection id, const char* data,
+                            size_t length) {
+    size_t position = _out.tellp();
+    size_t padding = (SNAPSHOT_ALIGNMENT - position % SNAPSHOT_ALIGNMENT)
+                     % SNAPSHOT_ALIGNMENT;
+    std::vector<char> blank(padding, 0);
+    _out.write(blank.data(), padding);
+    _offsets[id] = position + padding;
+    _lengths[id] = length;
+    _checksums[id] = fnv1a(data, length);
+    _out.write(data, length);
+}
+
+/**
+ * @brief Writes the header, completing the snapshot file
+ * 
+ * The file is flushed to disk before being renamed over the target, so the
+ * target holds either the old or the new snapshot in full.
+ */
+void SnapshotWriter::finish() {
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.num_sections = NUM_SNAPSHOT_SECTIONS;
+    for (size_t id = 0; id < NUM_SNAPSHOT_SECTIONS; id++) {
+        header.sections[id].offset = _offsets[id];
+        header.sections[id].length = _lengths[id];
+        header.sections[id].checksum = _checksums[id];
+    }
+    header.checksum = fnv1a(reinterpret_cast<const char*>(&header),
+                            offsetof(SnapshotHeader, checksum));
+    _out.seekp(0);
+    _out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    _out.close();
+    if (_out.fail()) throw std::invalid_argument("Could not write snapshot");
+    int fd = open(_temporary.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) close(fd);
+    if (!synced || rename(_temporary.c_str(), _filename.c_str()) != 0)
+        throw std::invalid_argument("Could not write snapshot");
+    _finished = true;
+}
+
+/**
+ * @brief Saves the dictionary and index to a snapshot file
+ * 
+ * Prints time taken.
+ * 
+ * @param filename Path of the snapshot file; overwritten if it exists
+ * @param out Stream to print to
+ */
+void System::save_snapshot(std::string filename, std::ostream& out) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::shared_ptr<const _Version> version = std::atomic_load(&_version);
+    SnapshotWriter writer(filename);
+    version->dictionary.save(writer);
+    version->index->save(writer);
+    writer.finish();
+
+    auto end = std::chrono::high_resolution_clock::now();
+    int elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>
+        (end-start).count();
+    out << "Snapshot saved in " << elapsed_ms << " ms." << std::endl;
+}
+
+/**
+ * @brief Replaces the dictionary and index with those in a snapshot file
+ * 
+ * The dictionary, and the index where its implementation allows it, are
+ * used directly from the mapped file, so only the pages touched by queries
+ * are ever read. The current state is left unchanged if the snapshot is
+ * invalid.
+ * 
+ * Prints number of resources and time taken.
+ * 
+ * @param filename Path of the snapshot file
+ * @param verify Whether to check the checksums of all sections, rather than
+ *      only of those read in full while opening
+ * @param out Stream to print to
+ */
+void System::open_snapshot(std::string filename, bool verify,
+                           std::ostream& out) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::lock_guard<std::mutex> guard(_write_lock);
+    Snapshot snapshot(filename);
+    auto version = std::make_shared<_Version>();
+    version->dictionary.open(snapshot, verify);
+    version->index = RDFIndex::create(_index_type, _compress_threshold);
+    version->index->open(snapshot, verify, _threads);
+    size_t resources = version->dictionary.size();
+
+    // Only modify the system once the snapshot has been read successfully
+    _publish(version);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    int elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>
+        (end-start).count();
+    out << "Snapshot with " << resources
+        << " resources opened in " << elapsed_ms << " ms." << std::endl;
+}
@@ -0,0 +1,583 @@
+/**
+ * @file j_dictionary.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (j)
+ *
+ * The compact string dictionary used to encode resources.
+ * Full implementation of the Dictionary class.
+ */
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <Dictionary.h>
+#include <utils.h>
+
+// Prefix number returned by Dictionary::_find_prefix for unknown prefixes
+static const uint32_t NO_PREFIX = UINT32_MAX;
+// Initial number of slots in each hash table, a power of two
+static const size_t INITIAL_SLOTS = 16;
+// Names handled by each task of Dictionary::insert_all
+static const size_t INSERT_BLOCK = 4096;
+
+/**
+ * @brief Helper function to get the smallest number of slots, a power of two,
+ *      keeping a hash table holding \p n entries at most 70% full
+ *
+ * @param n Number of entries
+ * @return size_t Number of slots
+ */
+static size_t slots_for(size_t n) {
+    size_t slots = INITIAL_SLOTS;
+    while (n * 10 > slots * 7) slots *= 2;
+    return slots;
+}
+
+/**
+ * @brief Constructs an empty dictionary
+ */
+Dictionary::Dictionary() : _head(std::make_shared<size_t>(0)) {
+    _prefix_offsets.push_back(0);
+    _prefix_slots.assign(std::vector<uint32_t>(INITIAL_SLOTS, 0));
+    _add_prefix("");
+    _entry_offsets.push_back(0);
+    for (auto& slots : _slots)
+        slots.assign(std::vector<uint32_t>(INITIAL_SLOTS, 0));
+    _shard_sizes.assign(std::vector<uint32_t>(SHARDS, 0));
+}
+
+/**
+ * @brief Gets the ID of a string without adding it
+ *
+ * Safe to call from several threads at once, provided none are modifying the
+ * dictionary.
+ *
+ * @param name String to look up
+ * @return Resource ID of the string, or INVALID_RESOURCE if not present
+ */
+Resource Dictionary::find(std::string_view name) const {
+    return _find(name, _hash(name));
+}
+
+/**
+ * @brief Gets the ID of a string, adding it if not already present
+ *
+ * @param name String to encode
+ * @return Resource ID of the string
+ */
+Resource Dictionary::encode(std::string_view name) {
+    uint64_t hash = _hash(name);
+    Resource id = _find(name, hash);
+    if (id != INVALID_RESOURCE) return id;
+    if (size() >= (size_t) std::numeric_limits<Resource>::max())
+        throw std::invalid_argument("Too many resources");
+    if (*_head != size()) _detach();
+    // Marks the arrays as modified until the string has been added
+    *_head = SIZE_MAX;
+
+    std::string_view prefix = name.substr(0, _prefix_length(name));
+    uint32_t number = _find_prefix(prefix);
+    if (number == NO_PREFIX) number = _add_prefix(prefix);
+    char buffer[10];
+    _entries.append(buffer, buffer + _put_varint(buffer, number));
+    _entries.append(name.data() + prefix.size(), name.data() + name.size());
+    _entry_offsets.push_back(_entries.size());
+
+    id = size() - 1;
+    size_t shard = hash >> 58;
+    if (slots_for(_shard_sizes[shard] + 1) > _slots[shard].size())
+        _grow_shard(shard, _slots[shard].size() * 2);
+    _insert_slot(shard, hash, id);
+    _shard_sizes.modify()[shard]++;
+    *_head = size();
+    return id;
+}
+
+/**
+ * @brief Adds strings not yet present, numbering them consecutively
+ *
+ * The strings are given IDs starting from the current size of the
+ * dictionary, in the order given. The work of splitting, storing and hashing
+ * them is divided between threads, with each shard of the hash table filled
+ * by a single thread.
+ *
+ * @param names Distinct strings, none of which are already present
+ * @param threads Number of threads to use
+ */
+void Dictionary::insert_all(const std::vector<std::string_view>& names,
+                            int threads) {
+    if (names.empty()) return;
+    size_t n = names.size(), first = size();
+    if (first + n > (size_t) std::numeric_limits<Resource>::max())
+        throw std::invalid_argument("Too many resources");
+    if (*_head != first) _detach();
+    *_head = SIZE_MAX;
+    size_t blocks = (n + INSERT_BLOCK - 1) / INSERT_BLOCK;
+    auto for_each_block = [&](std::function<void(size_t)> f) {
+        utils::parallel_for(blocks, threads, [&](size_t b) {
+            for (size_t i = b * INSERT_BLOCK;
+                 i < std::min(n, (b+1) * INSERT_BLOCK); i++) f(i);
+        });
+    };
+
+    // Find the prefix of each name, adding unknown prefixes in order
+    std::vector<uint32_t> prefixes(n);
+    for_each_block([&](size_t i) {
+        std::string_view name = names[i];
+        prefixes[i] = _find_prefix(name.substr(0, _prefix_length(name)));
+    });
+    for (size_t i = 0; i < n; i++) {
+        if (prefixes[i] != NO_PREFIX) continue;
+        std::string_view prefix = names[i].substr(0,
+                                                  _prefix_length(names[i]));
+        prefixes[i] = _find_prefix(prefix);
+        if (prefixes[i] == NO_PREFIX) prefixes[i] = _add_prefix(prefix);
+    }
+
+    // Lay out the new entries at the end of the arena, then fill them in
+    uint64_t start = _entry_offsets[first], end = start;
+    uint64_t* offsets = _entry_offsets.extend(n);
+    char buffer[10];
+    for (size_t i = 0; i < n; i++) {
+        size_t suffix = names[i].size() - _prefix_length(names[i]);
+        end += _put_varint(buffer, prefixes[i]) + suffix;
+        offsets[i] = end;
+    }
+    char* entries = _entries.extend(end - start);
+    for_each_block([&](size_t i) {
+        std::string_view name = names[i];
+        char* out = entries + (_entry_offsets[first + i] - start);
+        out += _put_varint(out, prefixes[i]);
+        size_t split = _prefix_length(name);
+        std::memcpy(out, name.data() + split, name.size() - split);
+    });
+
+    // Group the new IDs by shard, then add each shard's to its hash table
+    std::vector<uint64_t> hashes(n);
+    for_each_block([&](size_t i) { hashes[i] = _hash(names[i]); });
+    std::vector<std::vector<uint32_t>> by_shard(SHARDS);
+    for (size_t i = 0; i < n; i++) by_shard[hashes[i] >> 58].push_back(i);
+    uint32_t* sizes = _shard_sizes.modify();
+    utils::parallel_for(SHARDS, threads, [&](size_t k) {
+        if (by_shard[k].empty()) return;
+        size_t needed = slots_for(sizes[k] + by_shard[k].size());
+        if (needed > _slots[k].size()) _grow_shard(k, needed);
+        for (uint32_t i : by_shard[k]) _insert_slot(k, hashes[i], first + i);
+        sizes[k] += by_shard[k].size();
+    });
+    *_head = size();
+}
+
+/**
+ * @brief Gets the string with a given ID
+ *
+ * @param id ID of the string, which must be present
+ * @return std::string The string
+ */
+std::string Dictionary::decode(Resource id) const {
+    std::string name;
+    decode_to(id, name);
+    return name;
+}
+
+/**
+ * @brief Appends the string with a given ID to another string
+ *
+ * Avoids allocating a new string for every ID decoded.
+ *
+ * @param id ID of the string, which must be present
+ * @param out String to append to
+ */
+void Dictionary::decode_to(Resource id, std::string& out) const {
+    uint32_t prefix;
+    std::string_view suffix;
+    _read_entry(id, prefix, suffix);
+    std::string_view start = _prefix(prefix);
+    size_t at = out.size();
+    out.resize(at + start.size() + suffix.size());
+    std::memcpy(&out[at], start.data(), start.size());
+    std::memcpy(&out[at + start.size()], suffix.data(), suffix.size());
+}
+
+/**
+ * @brief Gets the number of bytes used by the dictionary's arrays
+ *
+ * Counted as by Dictionary::report_memory, from the capacity allocated for
+ * each array, and includes arrays used in place from a snapshot.
+ *
+ * @return size_t Number of bytes
+ */
+size_t Dictionary::memory_usage() const {
+    std::vector<MemoryUsage> usage;
+    report_memory(usage);
+    size_t bytes = 0;
+    for (const MemoryUsage& part : usage)
+        bytes += part.bytes + part.mapped_bytes;
+    return bytes;
+}
+
+/**
+ * @brief Reports the memory held by each part of the dictionary
+ *
+ * The strings are the byte arena of prefix numbers and suffixes with its
+ * offsets, the prefixes the prefix table with its hash table, and the hash
+ * tables those from strings to IDs.
+ *
+ * @param usage Vector to append one entry per part to
+ */
+void Dictionary::report_memory(std::vector<MemoryUsage>& usage) const {
+    usage.push_back(MemoryUsage{"dictionary.strings", size(),
+        _entries.memory_usage() + _entry_offsets.memory_usage(),
+        _entries.mapped_bytes() + _entry_offsets.mapped_bytes()});
+    usage.push_back(MemoryUsage{"dictionary.prefixes",
+        _prefix_offsets.size() - 1,
+        _prefixes.memory_usage() + _prefix_offsets.memory_usage() +
+            _prefix_slots.memory_usage(),
+        _prefixes.mapped_bytes() + _prefix_offsets.mapped_bytes() +
+            _prefix_slots.mapped_bytes()});
+    size_t bytes = _shard_sizes.memory_usage();
+    size_t mapped_bytes = _shard_sizes.mapped_bytes();
+    for (auto& slots : _slots) {
+        bytes += slots.memory_usage();
+        mapped_bytes += slots.mapped_bytes();
+    }
+    usage.push_back(MemoryUsage{"dictionary.hash_tables", size(), bytes,
+                                mapped_bytes});
+}
+
+/**
+ * @brief Writes the dictionary's arrays to a snapshot file
+ *
+ * @param writer Snapshot file being written
+ */
+void Dictionary::save(SnapshotWriter& writer) const {
+    // Slots set by later copies sharing the tables are written as empty
+    auto copy_slots = [](const MappableArray<uint32_t>& from, size_t limit,
+                         std::vector<uint32_t>& to) {
+        for (size_t i = 0; i < from.size(); i++) {
+            uint32_t slot = from.load(i);
+            to.push_back(slot <= limit ? slot : 0);
+        }
+    };
+    writer.write(DICTIONARY_OFFSETS, _entry_offsets.view());
+    writer.write(DICTIONARY_STRINGS, _entries.view());
+    writer.write(DICTIONARY_PREFIX_OFFSETS, _prefix_offsets.view());
+    writer.write(DICTIONARY_PREFIXES, _prefixes.view());
+    std::vector<uint32_t> prefix_slots;
+    copy_slots(_prefix_slots, _prefix_offsets.size() - 1, prefix_slots);
+    writer.write(DICTIONARY_PREFIX_SLOTS, ArrayView<uint32_t>(prefix_slots));
+    std::vector<uint64_t> slot_offsets{0};
+    std::vector<uint32_t> slots;
+    for (auto& shard : _slots) {
+        copy_slots(shard, size(), slots);
+        slot_offsets.push_back(slots.size());
+    }
+    writer.write(DICTIONARY_SLOT_OFFSETS, ArrayView<uint64_t>(slot_offsets));
+    writer.write(DICTIONARY_SLOTS, ArrayView<uint32_t>(slots));
+    writer.write(DICTIONARY_SHARD_SIZES, _shard_sizes.view());
+}
+
+/**
+ * @brief Replaces the dictionary's arrays with those in a snapshot file
+ *
+ * The arrays are used in place, so opening takes constant time regardless
+ * of the number of strings, and each is copied into memory only if strings
+ * are later added.
+ *
+ * @param snapshot Snapshot file to read
+ * @param verify Whether to check the checksums of the arrays
+ */
+void Dictionary::open(const Snapshot& snapshot, bool verify) {
+    auto is_power_of_two = [](size_t n) { return n > 0 && !(n & (n-1)); };
+    auto entry_offsets = snapshot.section<uint64_t>(DICTIONARY_OFFSETS,
+                                                    verify);
+    auto entries = snapshot.section<char>(DICTIONARY_STRINGS, verify);
+    auto prefix_offsets = snapshot.section<uint64_t>(
+        DICTIONARY_PREFIX_OFFSETS, verify);
+    auto prefixes = snapshot.section<char>(DICTIONARY_PREFIXES, verify);
+    auto prefix_slots = snapshot.section<uint32_t>(DICTIONARY_PREFIX_SLOTS,
+                                                   verify);
+    auto slot_offsets = snapshot.section<uint64_t>(DICTIONARY_SLOT_OFFSETS,
+                                                   true);
+    auto slots = snapshot.section<uint32_t>(DICTIONARY_SLOTS, verify);
+    auto shard_sizes = snapshot.section<uint32_t>(DICTIONARY_SHARD_SIZES,
+                                                  true);
+    if (entry_offsets.empty() || entry_offsets[entry_offsets.size()-1]
+                                 != entries.size() ||
+        prefix_offsets.empty() || prefix_offsets[prefix_offsets.size()-1]
+                                  != prefixes.size() ||
+        !is_power_of_two(prefix_slots.size()) ||
+        slot_offsets.size() != SHARDS+1 || shard_sizes.size() != SHARDS ||
+        slot_offsets[SHARDS] != slots.size())
+        throw std::invalid_argument("Snapshot dictionary is corrupt");
+    for (size_t k = 0; k < SHARDS; k++) {
+        if (slot_offsets[k] > slot_offsets[k+1] ||
+            !is_power_of_two(slot_offsets[k+1] - slot_offsets[k]))
+            throw std::invalid_argument("Snapshot dictionary is corrupt");
+    }
+
+    _mapping = snapshot.mapping();
+    _head = std::make_shared<size_t>(entry_offsets.size() - 1);
+    _entry_offsets.map(entry_offsets);
+    _entries.map(entries);
+    _prefix_offsets.map(prefix_offsets);
+    _prefixes.map(prefixes);
+    _prefix_slots.map(prefix_slots);
+    for (size_t k = 0; k < SHARDS; k++)
+        _slots[k].map(ArrayView<uint32_t>(slots.data() + slot_offsets[k],
+                                          slot_offsets[k+1]
+                                          - slot_offsets[k]));
+    _shard_sizes.map(shard_sizes);
+}
+
+/**
+ * @brief Gets the shard of the hash table holding a string
+ *
+ * @param name String to look up
+ * @return size_t Shard number, less than Dictionary::SHARDS
+ */
+size_t Dictionary::shard_of(std::string_view name) {
+    return _hash(name) >> 58;
+}
+
+/**
+ * @brief Helper function to take arrays of its own, for a copy that is not
+ *      the latest to have added strings
+ *
+ * The hash tables may hold IDs and prefixes added by other copies since
+ * this one was made. These were set after every other slot, so clearing
+ * them leaves each table as it was when the copy was made.
+ */
+void Dictionary::_detach() {
+    size_t prefixes = _prefix_offsets.size() - 1;
+    uint32_t* prefix_slots = _prefix_slots.modify();
+    for (size_t i = 0; i < _prefix_slots.size(); i++)
+        if (prefix_slots[i] > prefixes) prefix_slots[i] = 0;
+    for (auto& shard : _slots) {
+        uint32_t* slots = shard.modify();
+        for (size_t i = 0; i < shard.size(); i++)
+            if (slots[i] > size()) slots[i] = 0;
+    }
+    _head = std::make_shared<size_t>(size());
+}
+
+/**
+ * @brief Helper function to look up a string given its hash
+ *
+ * @param name String to look up
+ * @param hash Hash of the string
+ * @return Resource ID of the string, or INVALID_RESOURCE if not present
+ */
+Resource Dictionary::_find(std::string_view name, uint64_t hash) const {
+    const MappableArray<uint32_t>& slots = _slots[hash >> 58];
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i+1) & mask) {
+        uint32_t slot = slots.load(i);
+        if (slot == 0) return INVALID_RESOURCE;
+        // Skip IDs added to later copies sharing the table
+        if (slot <= size() && _equals(slot-1, name)) return slot-1;
+    }
+}
+
+/**
+ * @brief Helper function to get a prefix by number
+ *
+ * @param prefix Prefix number
+ * @return std::string_view The prefix
+ */
+std::string_view Dictionary::_prefix(uint32_t prefix) const {
+    return std::string_view(_prefixes.view().data()
+                            + _prefix_offsets[prefix],
+                            _prefix_offsets[prefix+1]
+                            - _prefix_offsets[prefix]);
+}
+
+/**
+ * @brief Helper function to look up the number of a prefix
+ *
+ * @param prefix Prefix to look up
+ * @return uint32_t Prefix number, or NO_PREFIX if not present
+ */
+uint32_t Dictionary::_find_prefix(std::string_view prefix) const {
+    size_t mask = _prefix_slots.size() - 1;
+    size_t prefixes = _prefix_offsets.size() - 1;
+    for (size_t i = _hash(prefix) & mask;; i = (i+1) & mask) {
+        uint32_t slot = _prefix_slots.load(i);
+        if (slot == 0) return NO_PREFIX;
+        if (slot <= prefixes && _prefix(slot-1) == prefix) return slot-1;
+    }
+}
+
+/**
+ * @brief Helper function to add a prefix not yet present
+ *
+ * @param prefix Prefix to add
+ * @return uint32_t Number of the new prefix
+ */
+uint32_t Dictionary::_add_prefix(std::string_view prefix) {
+    uint32_t number = _prefix_offsets.size() - 1;
+    _prefixes.append(prefix.data(), prefix.data() + prefix.size());
+    _prefix_offsets.push_back(_prefixes.size());
+
+    // Rebuild the table with twice the slots once it becomes too full
+    size_t count = number + 1;
+    if (slots_for(count) > _prefix_slots.size()) {
+        std::vector<uint32_t> slots(slots_for(count), 0);
+        for (uint32_t p = 0; p < number; p++) {
+            size_t mask = slots.size() - 1, i = _hash(_prefix(p)) & mask;
+            while (slots[i] != 0) i = (i+1) & mask;
+            slots[i] = p+1;
+        }
+        _prefix_slots.assign(std::move(slots));
+    }
+    size_t mask = _prefix_slots.size() - 1, i = _hash(prefix) & mask;
+    while (_prefix_slots.load(i) != 0) i = (i+1) & mask;
+    _prefix_slots.store(i, number+1);
+    return number;
+}
+
+/**
+ * @brief Helper function to read the arena entry of an ID
+ *
+ * @param id ID of the entry
+ * @param prefix Set to the prefix number of the string
+ * @param suffix Set to the suffix of the string, within the arena
+ */
+void Dictionary::_read_entry(Resource id, uint32_t& prefix,
+                             std::string_view& suffix) const {
+    const char* entries = _entries.view().data();
+    const char* at = entries + _entry_offsets[id];
+    prefix = _get_varint(at);
+    suffix = std::string_view(at, entries + _entry_offsets[id+1] - at);
+}
+
+/**
+ * @brief Helper function to compare the string with an ID to another string
+ *
+ * @param id ID of the string, which must be present
+ * @param name String to compare with
+ * @return bool Whether they are equal
+ */
+bool Dictionary::_equals(Resource id, std::string_view name) const {
+    uint32_t prefix;
+    std::string_view suffix;
+    _read_entry(id, prefix, suffix);
+    if (name.size() < suffix.size()) return false;
+    size_t split = name.size() - suffix.size();
+    return name.substr(split) == suffix
+           && name.substr(0, split) == _prefix(prefix);
+}
+
+/**
+ * @brief Helper function to add an ID to a shard of the hash table
+ *
+ * The shard must already have space for it, and the caller counts it in
+ * the shard's size.
+ *
+ * @param shard Shard of the hash table
+ * @param hash Hash of the string with this ID
+ * @param id ID to add
+ */
+void Dictionary::_insert_slot(size_t shard, uint64_t hash, Resource id) {
+    MappableArray<uint32_t>& slots = _slots[shard];
+    size_t mask = slots.size() - 1, i = hash & mask;
+    while (slots.load(i) != 0) i = (i+1) & mask;
+    slots.store(i, id+1);
+}
+
+/**
+ * @brief Helper function to rebuild a shard of the hash table with more slots
+ *
+ * @param shard Shard of the hash table
+ * @param capacity New number of slots, a power of two
+ */
+void Dictionary::_grow_shard(size_t shard, size_t capacity) {
+    std::vector<uint32_t> slots(capacity, 0);
+    std::string name;
+    for (uint32_t slot : _slots[shard].view()) {
+        if (slot == 0) continue;
+        name.clear();
+        decode_to(slot-1, name);
+        size_t mask = capacity - 1, i = _hash(name) & mask;
+        while (slots[i] != 0) i = (i+1) & mask;
+        slots[i] = slot;
+    }
+    _slots[shard].assign(std::move(slots));
+}
+
+/**
+ * @brief Helper function to get the length of the prefix of a string
+ *
+ * The prefix runs up to and including the last `/` or `#`, so URIs sharing a
+ * namespace share a prefix.
+ *
+ * @param name String to split
+ * @return size_t Length of the prefix
+ */
+size_t Dictionary::_prefix_length(std::string_view name) {
+    size_t last = name.find_last_of("/#");
+    return last == std::string_view::npos ? 0 : last+1;
+}
+
+/**
+ * @brief Helper function to hash a string
+ *
+ * Unlike `std::hash`, the result is fixed across builds, so hash tables
+ * saved in snapshots remain valid. The top six bits select the shard, and
+ * the low bits the slot within it.
+ *
+ * @param name String to hash
+ * @return uint64_t Hash of the string
+ */
+uint64_t Dictionary::_hash(std::string_view name) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ name.size();
+    size_t i = 0;
+    for (; i + 8 <= name.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, name.data() + i, 8);
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 31;
+    }
+    uint64_t word = 0;
+    std::memcpy(&word, name.data() + i, name.size() - i);
+    hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 29;
+    hash *= 0x94d049bb133111ebull;
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * @brief Helper function to write a variable-length integer
+ *
+ * Uses seven bits per byte, with the top bit set on all but the last byte.
+ *
+ * @param out Buffer to write to, with space for at least 10 bytes
+ * @param value Integer to write
+ * @return size_t Number of bytes written
+ */
+size_t Dictionary::_put_varint(char* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (char) (value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (char) value;
+    return n;
+}
+
+/**
+ * @brief Helper function to read a variable-length integer
+ *
+ * @param at Position to read from; updated to just after the integer
+ * @return uint64_t Integer read
+ */
+uint64_t Dictionary::_get_varint(const char*& at) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char byte = *at++;
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (byte < 0x80) return value;
+    }
+}
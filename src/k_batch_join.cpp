@@ -0,0 +1,596 @@
+/**
+ * @file k_batch_join.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (k)
+ *
+ * The batch-at-a-time join engine used to evaluate queries.
+ * Full implementation of the BatchJoin class.
+ */
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <BatchJoin.h>
+#include <LinkedIndex.h>
+#include <PerfCounters.h>
+#include <PermutationIndex.h>
+#include <Query.h>
+#include <utils.h>
+
+static_assert(sizeof(Resource) == 4, "Kernels compare 32-bit resources");
+
+/**
+ * @brief Helper function to find the rows at which two columns are equal
+ *
+ * Compares four rows at a time where SSE2 is available.
+ *
+ * @param x First column
+ * @param y Second column
+ * @param n Number of rows
+ * @param selection Set to the positions of equal rows, in order; must have
+ *      space for \p n positions
+ * @return size_t Number of equal rows
+ */
+static size_t select_equal(const Resource* x, const Resource* y, size_t n,
+                           uint32_t* selection) {
+    size_t count = 0, i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (x + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (y + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)));
+        for (; mask; mask &= mask - 1)
+            selection[count++] = i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; i++) {
+        selection[count] = i;
+        count += x[i] == y[i];
+    }
+    return count;
+}
+
+/**
+ * @brief Helper function to keep only the selected rows of a column
+ *
+ * @param column Column to compact in place
+ * @param selection Positions of the rows to keep, in increasing order
+ * @param n Number of rows to keep
+ */
+static void compact(Resource* column, const uint32_t* selection, size_t n) {
+    for (size_t i = 0; i < n; i++) column[i] = column[selection[i]];
+}
+
+/**
+ * @brief Helper function to hash the bindings a hash join matches on
+ *
+ * @param key Bindings to hash
+ * @param n Number of bindings
+ * @return uint32_t Hash of the bindings
+ */
+static uint32_t hash_key(const Resource* key, size_t n) {
+    uint64_t hash = 0;
+    for (size_t k = 0; k < n; k++)
+        hash = (hash ^ (uint32_t) key[k]) * 0x9E3779B97F4A7C15ull;
+    return hash >> 32;
+}
+
+/**
+ * @brief Prepares a join of the patterns of a compiled query
+ *
+ * Works out, for every stage, which slots the pattern binds and which
+ * earlier bindings must be carried past it, and allocates its batch.
+ *
+ * @param index Index to evaluate the patterns over
+ * @param query Compiled query to evaluate
+ * @param project Whether the selected variables must be output, as opposed
+ *      to just the number of rows
+ */
+template <class Index>
+BatchJoin<Index>::BatchJoin(Index& index, const CompiledQuery& query,
+                            bool project) :
+    _produced(query.patterns.size(), 0), _selection(BATCH_SIZE),
+    _sink(nullptr), _profiles(query.patterns.size() + 1) {
+    size_t n = query.patterns.size();
+    Slot slots = query.slot_variables.size();
+
+    // Slots needed after each stage, by later patterns or the output
+    std::vector<std::vector<bool>> needed(n);
+    std::vector<bool> later(slots, false);
+    for (Slot slot : query.projection)
+        if (project && slot != NO_SLOT) later[slot] = true;
+    for (size_t i = n; i-- > 0;) {
+        needed[i] = later;
+        auto [a,b,c] = query.patterns[i];
+        for (SlotTerm term : {a, b, c})
+            if (term.slot != NO_SLOT) later[term.slot] = true;
+    }
+
+    // Give repeated variables spare slots after the query's own, as well
+    // as earlier bindings matched by hash and merge joins
+    Slot spare = slots;
+    std::vector<bool> bound(slots, false);
+    for (size_t i = 0; i < n; i++) {
+        _stages.push_back(_Stage{_Cursor(index), query.joins[i],
+                                 query.patterns[i], {false, false, false},
+                                 {}, {}, {}, {}, {}, {}, Batch(), nullptr,
+                                 Batch(), false, 0, false, Batch(),
+                                 INVALID_RESOURCE});
+        _Stage& stage = _stages.back();
+        auto [a,b,c] = query.patterns[i];
+        SlotTerm* terms[3] = {&a, &b, &c};
+        std::vector<Slot> binds;
+        for (int k = 0; k < 3; k++) {
+            Slot slot = terms[k]->slot;
+            if (slot == NO_SLOT) continue;
+            if (bound[slot]) {
+                if (stage.join == NESTED_LOOP) {
+                    stage.bound[k] = true;
+                    continue;
+                }
+                terms[k]->slot = spare;
+                auto key = std::find_if(stage.keys.begin(), stage.keys.end(),
+                    [=](auto pair) { return pair.first == slot; });
+                if (key != stage.keys.end())
+                    stage.equal.emplace_back(key->second, spare);
+                else stage.keys.emplace_back(slot, spare);
+                stage.read.push_back(spare++);
+            } else if (std::find(binds.begin(), binds.end(), slot)
+                       != binds.end()) {
+                terms[k]->slot = spare;
+                stage.equal.emplace_back(slot, spare);
+                stage.written.push_back(spare);
+                stage.read.push_back(spare++);
+            } else {
+                binds.push_back(slot);
+                stage.written.push_back(slot);
+                stage.read.push_back(slot);
+            }
+        }
+        for (Slot slot = 0; slot < slots; slot++) {
+            if (bound[slot] && needed[i][slot]) stage.carried.push_back(slot);
+        }
+        for (Slot slot : binds) bound[slot] = true;
+        stage.pattern = std::make_tuple(a, b, c);
+    }
+
+    for (_Stage& stage : _stages) {
+        for (Batch* batch : {&stage.out, &stage.inner, &stage.group})
+            batch->columns.resize(spare);
+        stage.targets.assign(spare, nullptr);
+        for (auto used : {&stage.written, &stage.carried}) {
+            for (Slot slot : *used) stage.out.columns[slot].resize(BATCH_SIZE);
+        }
+        if (stage.join == MERGE_JOIN) {
+            for (Slot slot : stage.read)
+                stage.inner.columns[slot].resize(BATCH_SIZE);
+        }
+    }
+}
+
+/**
+ * @brief Evaluates the query, passing the resulting rows on in batches
+ *
+ * Each batch passed to \p sink holds the columns of the selected variables
+ * if requested when constructed, and is only valid during the call.
+ *
+ * @param sink Function to call with each nonempty batch of results
+ */
+template <class Index>
+void BatchJoin<Index>::run(const std::function<void(const Batch&)>& sink) {
+    _sink = &sink;
+    // Start from a single row binding nothing
+    Batch start;
+    start.size = 1;
+    _push(0, start);
+    _finish(0);
+}
+
+/**
+ * @brief Reads all matches of the first pattern
+ *
+ * These are the rows the first stage would pass on, which can then be run
+ * through the later stages in slices by BatchJoin::run.
+ *
+ * @param rows Set to the matches, with the columns of the slots bound by
+ *      the first stage
+ */
+template <class Index>
+void BatchJoin<Index>::scan(Batch& rows) {
+    _Stage& stage = _stages[0];
+    rows.columns.assign(stage.out.columns.size(), {});
+    rows.size = 0;
+    auto [a,b,c] = stage.pattern;
+    stage.cursor.open(a, b, c);
+    _profiles[0].probes++;
+    _read_all(stage, rows);
+}
+
+/**
+ * @brief Builds the hash tables of all hash joins after the first stage
+ *
+ * Done before copying the BatchJoin to run slices of rows in parallel, so
+ * that the copies share the tables rather than each building its own.
+ */
+template <class Index>
+void BatchJoin<Index>::prepare() {
+    for (size_t i = 1; i < _stages.size(); i++) {
+        if (_stages[i].join == HASH_JOIN && !_stages[i].table)
+            _build_hash(_stages[i]);
+    }
+}
+
+/**
+ * @brief Runs a slice of the first pattern's matches through the later
+ *      stages, passing the resulting rows on in batches
+ *
+ * The rows must be sorted as the first stage would return them if any
+ * stage merge joins, and later slices must follow earlier ones.
+ *
+ * @param rows Matches of the first pattern, as read by BatchJoin::scan
+ * @param begin Position of the first row of the slice
+ * @param end Position after the last row of the slice, at most
+ *      `BATCH_SIZE` rows after \p begin
+ * @param sink Function to call with each nonempty batch of results
+ */
+template <class Index>
+void BatchJoin<Index>::run(const Batch& rows, size_t begin, size_t end,
+                           const std::function<void(const Batch&)>& sink) {
+    _sink = &sink;
+    Batch& out = _stages[0].out;
+    for (Slot slot : _stages[0].written) {
+        std::copy(rows.columns[slot].begin() + begin,
+                  rows.columns[slot].begin() + end, out.columns[slot].begin());
+    }
+    out.size = end - begin;
+    _push(1, out);
+    out.size = 0;
+    _finish(1);
+}
+
+/**
+ * @brief Gets the number of rows produced by each stage
+ *
+ * @return const std::vector<size_t>& Rows produced by the stage of each
+ *      pattern so far
+ */
+template <class Index>
+const std::vector<size_t>& BatchJoin<Index>::produced() const {
+    return _produced;
+}
+
+/**
+ * @brief Starts charging the time and hardware events of the join to its
+ *      stages
+ *
+ * The work counted so far is forgotten, so that a copy of a BatchJoin
+ * profiles only its own work.
+ *
+ * @param counters Counters of the thread the join runs on, or null to
+ *      charge only time
+ */
+template <class Index>
+void BatchJoin<Index>::profile(const PerfCounters* counters) {
+    std::fill(_profiles.begin(), _profiles.end(), StageProfile());
+    _profiling = true;
+    _counters = counters;
+    _current = _stages.size();
+    _last = std::chrono::steady_clock::now();
+    if (_counters) _counters->read(_last_events);
+}
+
+/**
+ * @brief Helper function to process a batch of rows with a stage
+ *
+ * @param i Index of the stage, or the number of stages for the output
+ * @param in Rows bound by the earlier stages
+ */
+template <class Index>
+void BatchJoin<Index>::_push(size_t i, const Batch& in) {
+    if (i > 0) _produced[i-1] += in.size;
+    utils::check_deadline(_deadline);
+    size_t caller = _charge(i);
+    if (i == _stages.size()) {
+        (*_sink)(in);
+    } else {
+        switch (_stages[i].join) {
+        case HASH_JOIN:
+            for (size_t row = 0; row < in.size; row++)
+                _probe_hash(i, in, row);
+            break;
+        case MERGE_JOIN:
+            for (size_t row = 0; row < in.size; row++)
+                _probe_merge(i, in, row);
+            break;
+        default:
+            for (size_t row = 0; row < in.size; row++) _probe(i, in, row);
+        }
+    }
+    _charge(caller);
+}
+
+/**
+ * @brief Helper function to charge the time and events since the last
+ *      change of stage to the stage running, if profiling, and to switch
+ *      to another
+ *
+ * @param i Index of the stage to charge from now on, or the number of
+ *      stages for the output
+ * @return size_t Index of the stage charged until now
+ */
+template <class Index>
+size_t BatchJoin<Index>::_charge(size_t i) {
+    size_t previous = _current;
+    _current = i;
+    if (!_profiling) return previous;
+    StageProfile& profile = _profiles[previous];
+    auto now = std::chrono::steady_clock::now();
+    profile.time += now - _last;
+    _last = now;
+    if (_counters) {
+        uint64_t events[PerfCounters::EVENTS];
+        _counters->read(events);
+        for (int e = 0; e < PerfCounters::EVENTS; e++) {
+            profile.events[e] += events[e] - _last_events[e];
+            _last_events[e] = events[e];
+        }
+    }
+    return previous;
+}
+
+/**
+ * @brief Helper function to pass on the partial batches of stages
+ *
+ * Called once no more rows will reach stage \p i.
+ *
+ * @param i Index of the first stage to flush
+ */
+template <class Index>
+void BatchJoin<Index>::_finish(size_t i) {
+    for (; i < _stages.size(); i++) {
+        Batch& out = _stages[i].out;
+        if (out.size > 0) _push(i+1, out);
+        out.size = 0;
+    }
+}
+
+/**
+ * @brief Helper function to read matches from a stage's cursor into a batch
+ *
+ * Matches are written straight into the batch after its existing rows, then
+ * any repeated-variable checks compact them.
+ *
+ * @param stage Stage whose cursor to read from
+ * @param into Batch to add the matches to, with columns of at least
+ *      \p capacity rows for the slots the cursor writes
+ * @param capacity Number of rows to fill the batch up to
+ * @return bool Whether the cursor is exhausted
+ */
+template <class Index>
+bool BatchJoin<Index>::_read(_Stage& stage, Batch& into, size_t capacity) {
+    for (Slot slot : stage.read)
+        stage.targets[slot] = into.columns[slot].data() + into.size;
+    size_t space = capacity - into.size;
+    size_t n = stage.cursor.next_batch(stage.targets.data(), space);
+    bool exhausted = n < space;
+    StageProfile& profile = _profiles[&stage - _stages.data()];
+    profile.matches += n;
+    for (auto [x, y] : stage.equal) {
+        size_t before = n;
+        n = select_equal(stage.targets[x], stage.targets[y], n,
+                         _selection.data());
+        profile.rejected += before - n;
+        for (Slot slot : stage.read)
+            compact(stage.targets[slot], _selection.data(), n);
+    }
+    into.size += n;
+    return exhausted;
+}
+
+/**
+ * @brief Helper function to read all remaining matches from a stage's
+ *      cursor into a batch, growing its columns as needed
+ *
+ * @param stage Stage whose cursor to read from
+ * @param into Batch to add the matches to; its columns for the slots the
+ *      cursor writes are resized to its final number of rows
+ */
+template <class Index>
+void BatchJoin<Index>::_read_all(_Stage& stage, Batch& into) {
+    for (bool exhausted = false; !exhausted;) {
+        for (Slot slot : stage.read)
+            into.columns[slot].resize(into.size + BATCH_SIZE);
+        exhausted = _read(stage, into, into.size + BATCH_SIZE);
+    }
+    for (Slot slot : stage.read) into.columns[slot].resize(into.size);
+}
+
+/**
+ * @brief Helper function to add one extended row to a stage's batch
+ *
+ * @param i Index of the stage
+ * @param match Matches of the stage's pattern
+ * @param j Position of the match to add within \p match
+ * @param in Rows bound by the earlier stages
+ * @param row Position of the row it extends within \p in
+ */
+template <class Index>
+void BatchJoin<Index>::_emit(size_t i, const Batch& match, size_t j,
+                             const Batch& in, size_t row) {
+    _Stage& stage = _stages[i];
+    Batch& out = stage.out;
+    if (out.size == BATCH_SIZE) {
+        _push(i+1, out);
+        out.size = 0;
+    }
+    for (Slot slot : stage.written)
+        out.columns[slot][out.size] = match.columns[slot][j];
+    for (Slot slot : stage.carried)
+        out.columns[slot][out.size] = in.columns[slot][row];
+    out.size++;
+}
+
+/**
+ * @brief Helper function to extend one row with all matches of a stage's
+ *      pattern by a nested loop join
+ *
+ * Matches are read straight into the stage's batch by the cursor, and the
+ * carried bindings of the row are copied alongside.
+ *
+ * @param i Index of the stage
+ * @param in Rows bound by the earlier stages
+ * @param row Position of the row to extend within \p in
+ */
+template <class Index>
+void BatchJoin<Index>::_probe(size_t i, const Batch& in, size_t row) {
+    _Stage& stage = _stages[i];
+    Batch& out = stage.out;
+    auto [a,b,c] = stage.pattern;
+    SlotTerm* terms[3] = {&a, &b, &c};
+    for (int k = 0; k < 3; k++) {
+        if (stage.bound[k])
+            *terms[k] = SlotTerm{NO_SLOT, in.columns[terms[k]->slot][row]};
+    }
+    stage.cursor.open(a, b, c);
+    _profiles[i].probes++;
+
+    // The cursor fills all the space given until it runs out of matches
+    for (bool exhausted = false; !exhausted;) {
+        if (out.size == BATCH_SIZE) {
+            _push(i+1, out);
+            out.size = 0;
+        }
+        size_t start = out.size;
+        exhausted = _read(stage, out, BATCH_SIZE);
+        for (Slot slot : stage.carried) {
+            std::fill(out.columns[slot].data() + start,
+                      out.columns[slot].data() + out.size,
+                      in.columns[slot][row]);
+        }
+    }
+}
+
+/**
+ * @brief Helper function to read all matches of a stage's pattern into a
+ *      hash table
+ *
+ * The table's rows are chained in bucket order, so that matches with the
+ * same key are found in the order the index returns them.
+ *
+ * @param stage Stage to build the hash table of
+ */
+template <class Index>
+void BatchJoin<Index>::_build_hash(_Stage& stage) {
+    auto table = std::make_shared<_HashTable>();
+    Batch& rows = table->rows;
+    rows.columns.resize(stage.out.columns.size());
+    auto [a,b,c] = stage.pattern;
+    stage.cursor.open(a, b, c);
+    _profiles[&stage - _stages.data()].probes++;
+    _read_all(stage, rows);
+
+    size_t buckets = 1;
+    while (buckets < 2*rows.size) buckets *= 2;
+    table->buckets.assign(buckets, _NO_ENTRY);
+    table->chain.resize(rows.size);
+    Resource key[3];
+    for (size_t j = rows.size; j-- > 0;) {
+        for (size_t k = 0; k < stage.keys.size(); k++)
+            key[k] = rows.columns[stage.keys[k].second][j];
+        uint32_t& head = table->buckets[hash_key(key, stage.keys.size())
+                                        & (buckets-1)];
+        table->chain[j] = head;
+        head = j;
+    }
+    stage.table = table;
+}
+
+/**
+ * @brief Helper function to extend one row with all matches of a stage's
+ *      pattern by a hash join
+ *
+ * The hash table is built on the first row to reach the stage.
+ *
+ * @param i Index of the stage
+ * @param in Rows bound by the earlier stages
+ * @param row Position of the row to extend within \p in
+ */
+template <class Index>
+void BatchJoin<Index>::_probe_hash(size_t i, const Batch& in, size_t row) {
+    _Stage& stage = _stages[i];
+    if (!stage.table) _build_hash(stage);
+    const _HashTable& table = *stage.table;
+    size_t n = stage.keys.size();
+    Resource key[3];
+    for (size_t k = 0; k < n; k++)
+        key[k] = in.columns[stage.keys[k].first][row];
+    uint32_t j = table.buckets[hash_key(key, n) & (table.buckets.size()-1)];
+    for (; j != _NO_ENTRY; j = table.chain[j]) {
+        bool match = true;
+        for (size_t k = 0; k < n; k++)
+            match &= table.rows.columns[stage.keys[k].second][j] == key[k];
+        if (match) _emit(i, table.rows, j, in, row);
+    }
+}
+
+/**
+ * @brief Helper function to extend one row with all matches of a stage's
+ *      pattern by a merge join
+ *
+ * The rows must reach the stage sorted on the variable joined on, and the
+ * cursor return the pattern's matches sorted on it too. The matches for the
+ * current binding of that variable are kept, so that they can be repeated
+ * for any later rows with the same binding; matches with smaller bindings
+ * are skipped.
+ *
+ * @param i Index of the stage
+ * @param in Rows bound by the earlier stages
+ * @param row Position of the row to extend within \p in
+ */
+template <class Index>
+void BatchJoin<Index>::_probe_merge(size_t i, const Batch& in, size_t row) {
+    _Stage& stage = _stages[i];
+    Batch& ahead = stage.inner;
+    Batch& group = stage.group;
+    auto [outer, inner] = stage.keys[0];
+    Resource value = in.columns[outer][row];
+    if (!stage.ready) {
+        auto [a,b,c] = stage.pattern;
+        stage.cursor.open(a, b, c);
+        _profiles[i].probes++;
+        stage.ready = true;
+    } else if (value == stage.group_key) {
+        for (size_t j = 0; j < group.size; j++) _emit(i, group, j, in, row);
+        return;
+    }
+
+    // Collect the matches with the row's binding
+    group.size = 0;
+    for (Slot slot : stage.written) group.columns[slot].clear();
+    stage.group_key = value;
+    while (true) {
+        if (stage.ahead == ahead.size) {
+            if (stage.exhausted) break;
+            ahead.size = stage.ahead = 0;
+            stage.exhausted = _read(stage, ahead, BATCH_SIZE);
+            continue;
+        }
+        Resource key = ahead.columns[inner][stage.ahead];
+        if (key > value) break;
+        if (key == value) {
+            for (Slot slot : stage.written)
+                group.columns[slot].push_back(ahead.columns[slot][stage.ahead]);
+            group.size++;
+        }
+        stage.ahead++;
+    }
+    for (size_t j = 0; j < group.size; j++) _emit(i, group, j, in, row);
+}
+
+template class BatchJoin<LinkedIndex>;
+template class BatchJoin<PermutationIndex>;
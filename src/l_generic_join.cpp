@@ -0,0 +1,205 @@
+/**
+ * @file l_generic_join.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (l)
+ *
+ * The worst-case optimal join engine used to evaluate cyclic queries.
+ * Full implementation of the GenericJoin class.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <vector>
+#include <BatchJoin.h>
+#include <GenericJoin.h>
+#include <LinkedIndex.h>
+#include <PermutationIndex.h>
+#include <Query.h>
+#include <utils.h>
+
+/**
+ * @brief Prepares a join of the patterns of a compiled query
+ *
+ * Works out which patterns constrain each variable, and allocates the
+ * batch of output rows.
+ *
+ * @param index Index to evaluate the patterns over
+ * @param query Compiled query to evaluate
+ * @param project Whether the selected variables must be output, as opposed
+ *      to just the number of rows
+ */
+template <class Index>
+GenericJoin<Index>::GenericJoin(Index& index, const CompiledQuery& query,
+                                bool project) :
+    _index(&index), _query(&query), _levels(query.slot_variables.size()),
+    _row(query.slot_variables.size(), INVALID_RESOURCE),
+    _scratch(query.slot_variables.size(), INVALID_RESOURCE),
+    _cursor(index), _sink(nullptr) {
+    for (size_t i = 0; i < query.patterns.size(); i++) {
+        auto [a,b,c] = query.patterns[i];
+        bool ground = true;
+        for (SlotTerm term : {a, b, c}) {
+            if (term.slot == NO_SLOT) continue;
+            ground = false;
+            std::vector<size_t>& patterns = _levels[term.slot].patterns;
+            if (patterns.empty() || patterns.back() != i)
+                patterns.push_back(i);
+        }
+        if (ground) _ground.push_back(i);
+    }
+    _out.columns.resize(query.slot_variables.size());
+    for (Slot slot : query.projection) {
+        if (!project || slot == NO_SLOT) continue;
+        _output.push_back(slot);
+        _out.columns[slot].resize(BATCH_SIZE);
+    }
+}
+
+/**
+ * @brief Evaluates the query, passing the resulting rows on in batches
+ *
+ * Each batch passed to \p sink holds the columns of the selected variables
+ * if requested when constructed, and is only valid during the call.
+ *
+ * @param sink Function to call with each nonempty batch of results
+ */
+template <class Index>
+void GenericJoin<Index>::run(const std::function<void(const Batch&)>& sink) {
+    _sink = &sink;
+    for (size_t i : _ground) {
+        auto [a,b,c] = _query->patterns[i];
+        _cursor.open(a, b, c);
+        if (!_cursor.next(_scratch.data())) return;
+    }
+    _out.size = 0;
+    _bind(0);
+    if (_out.size > 0) sink(_out);
+}
+
+/**
+ * @brief Helper function to bind the variables from a given slot onwards,
+ *      outputting a row for each consistent set of bindings
+ *
+ * Candidates for the slot's variable are the distinct bindings of it in
+ * the matches of the pattern estimated to have the fewest, given the
+ * bindings of earlier slots. Each is kept only if every other pattern
+ * containing the variable still has a match once it is bound. Where the
+ * variable is the only one a pattern leaves unbound, and the pattern has
+ * not many more matches than there are candidates, this is checked for all
+ * candidates at once by intersecting them with the pattern's values;
+ * otherwise each candidate is checked by opening a cursor.
+ *
+ * @param k Slot of the variable to bind next
+ */
+template <class Index>
+void GenericJoin<Index>::_bind(size_t k) {
+    if (++_steps == _CHECK_INTERVAL) {
+        utils::check_deadline(_deadline);
+        _steps = 0;
+    }
+    if (k == _levels.size()) {
+        if (_out.size == BATCH_SIZE) {
+            (*_sink)(_out);
+            _out.size = 0;
+        }
+        for (Slot slot : _output) _out.columns[slot][_out.size] = _row[slot];
+        _out.size++;
+        return;
+    }
+    _Level& level = _levels[k];
+    auto last_unbound = [&](SlotPattern pattern) {
+        auto [a,b,c] = pattern;
+        for (SlotTerm term : {a, b, c})
+            if (term.slot != NO_SLOT && (size_t) term.slot != k) return false;
+        return true; };
+
+    // Propose candidates from the pattern with the fewest matches
+    size_t n = level.patterns.size();
+    size_t proposer = 0;
+    level.matches.resize(n);
+    for (size_t j = 0; j < n; j++) {
+        if (n == 1) break;
+        auto [a,b,c] = _substitute(level.patterns[j], k);
+        level.matches[j] = _index->estimate(a, b, c);
+        if (level.matches[j] == 0) return;
+        if (level.matches[j] < level.matches[proposer]) proposer = j;
+    }
+    _read(_substitute(level.patterns[proposer], k), k, level.candidates);
+
+    // Intersect with the values of other patterns, or check them later
+    level.checks.clear();
+    for (size_t j = 0; j < n && !level.candidates.empty(); j++) {
+        if (j == proposer) continue;
+        SlotPattern pattern = _substitute(level.patterns[j], k);
+        if (!last_unbound(pattern) ||
+            level.matches[j] > level.candidates.size() * _PROBE_COST) {
+            level.checks.push_back(level.patterns[j]);
+            continue;
+        }
+        _read(pattern, k, level.values);
+        auto end = std::set_intersection(
+            level.candidates.begin(), level.candidates.end(),
+            level.values.begin(), level.values.end(),
+            level.candidates.begin());
+        level.candidates.erase(end, level.candidates.end());
+    }
+
+    for (Resource candidate : level.candidates) {
+        _row[k] = candidate;
+        bool consistent = true;
+        for (size_t i : level.checks) {
+            auto [a,b,c] = _substitute(i, k+1);
+            _cursor.open(a, b, c);
+            if (!_cursor.next(_scratch.data())) {
+                consistent = false;
+                break;
+            }
+        }
+        if (consistent) _bind(k+1);
+    }
+    _row[k] = INVALID_RESOURCE;
+}
+
+/**
+ * @brief Helper function to read the distinct bindings of a variable in the
+ *      matches of a pattern
+ *
+ * Sorting is skipped if the index returns the bindings in order already.
+ *
+ * @param pattern Pattern to evaluate
+ * @param k Slot of the variable
+ * @param values Set to the bindings, in ascending order
+ */
+template <class Index>
+void GenericJoin<Index>::_read(SlotPattern pattern, size_t k,
+                               std::vector<Resource>& values) {
+    auto [a,b,c] = pattern;
+    values.clear();
+    _cursor.open(a, b, c);
+    while (_cursor.next(_scratch.data())) values.push_back(_scratch[k]);
+    if (!std::is_sorted(values.begin(), values.end()))
+        std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+/**
+ * @brief Helper function to substitute the bindings of earlier slots into
+ *      a pattern
+ *
+ * @param i Index of the pattern
+ * @param bound Number of slots bound, from the first
+ * @return SlotPattern The pattern, with variables in the bound slots
+ *      replaced by their bindings
+ */
+template <class Index>
+SlotPattern GenericJoin<Index>::_substitute(size_t i, size_t bound) {
+    auto substitute = [&](SlotTerm term) {
+        if (term.slot == NO_SLOT || (size_t) term.slot >= bound) return term;
+        return SlotTerm{NO_SLOT, _row[term.slot]}; };
+    auto [a,b,c] = _query->patterns[i];
+    return std::make_tuple(substitute(a), substitute(b), substitute(c));
+}
+
+template class GenericJoin<LinkedIndex>;
+template class GenericJoin<PermutationIndex>;
@@ -0,0 +1,228 @@
+/**
+ * @file m_characteristic_sets.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (m)
+ *
+ * Statistics used to estimate the size of subject stars.
+ * Full implementation of the CharacteristicSets class.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <CharacteristicSets.h>
+#include <utils.h>
+
+/**
+ * @brief Forgets all subjects
+ */
+void CharacteristicSets::clear() {
+    _sets.clear();
+    _ids.clear();
+    _subject_sets.clear();
+}
+
+/**
+ * @brief Adds a subject not seen before with all its triples
+ *
+ * @param s Subject resource
+ * @param counts Number of triples of the subject with each predicate
+ */
+void CharacteristicSets::add_subject(Resource s, const Counts& counts) {
+    std::vector<Resource> predicates;
+    for (auto [p, n] : counts) predicates.push_back(p);
+    _SetId id = _find(predicates);
+    _update(id, counts, 1);
+    if ((size_t) s >= _subject_sets.size())
+        _subject_sets.resize(s+1, _NO_SET);
+    _subject_sets.write(s) = id;
+}
+
+/**
+ * @brief Adds a triple with a predicate the subject already has
+ *
+ * @param s Subject resource
+ * @param p Predicate resource
+ */
+void CharacteristicSets::add(Resource s, Resource p) {
+    _Set& set = _sets[_subject_sets[s]];
+    auto it = std::lower_bound(set.predicates.begin(), set.predicates.end(),
+                               p);
+    set.triples[it - set.predicates.begin()]++;
+}
+
+/**
+ * @brief Adds a triple with a predicate the subject does not have yet,
+ *      moving the subject to a larger characteristic set
+ *
+ * @param s Subject resource, possibly not seen before
+ * @param p Predicate resource
+ * @param counts Number of triples of the subject with each predicate
+ *      before this one
+ */
+void CharacteristicSets::extend(Resource s, Resource p,
+                                const Counts& counts) {
+    if (!counts.empty()) _update(_subject_sets[s], counts, -1);
+    Counts extended(counts);
+    extended.insert(std::lower_bound(extended.begin(), extended.end(),
+                                     std::make_pair(p, (size_t) 0)),
+                    std::make_pair(p, (size_t) 1));
+    add_subject(s, extended);
+}
+
+/**
+ * @brief Gets the predicates of a subject's triples
+ *
+ * @param s Subject resource
+ * @return const std::vector<Resource>& Predicates of the subject's
+ *      characteristic set in ascending order, empty if it has no triples
+ */
+const std::vector<Resource>& CharacteristicSets::predicates(Resource s)
+        const {
+    static const std::vector<Resource> none;
+    if ((size_t) s >= _subject_sets.size() || _subject_sets[s] == _NO_SET)
+        return none;
+    return _sets[_subject_sets[s]].predicates;
+}
+
+/**
+ * @brief Estimates the number of matches of a subject star
+ *
+ * The star has one pattern per given predicate, all sharing a subject
+ * variable and each with an object variable of its own. Every subject
+ * whose characteristic set contains all the predicates matches, once for
+ * each combination of its triples with them; this is estimated for each
+ * such set from its subjects' average number of triples with each
+ * predicate.
+ *
+ * @param predicates Predicates of the star's patterns, possibly repeated
+ * @return double Estimated number of matches
+ */
+double CharacteristicSets::estimate_star(
+        const std::vector<Resource>& predicates) const {
+    std::vector<Resource> required(predicates);
+    std::sort(required.begin(), required.end());
+    required.erase(std::unique(required.begin(), required.end()),
+                   required.end());
+    double total = 0;
+    for (const _Set& set : _sets) {
+        if (set.subjects == 0 ||
+            !std::includes(set.predicates.begin(), set.predicates.end(),
+                           required.begin(), required.end())) continue;
+        double matches = set.subjects;
+        for (Resource p : predicates) {
+            auto it = std::lower_bound(set.predicates.begin(),
+                                       set.predicates.end(), p);
+            matches *= (double) set.triples[it - set.predicates.begin()]
+                       / set.subjects;
+        }
+        total += matches;
+    }
+    return total;
+}
+
+/**
+ * @brief Gets the bytes allocated by the characteristic sets
+ *
+ * Includes the predicates and counts of each set, the hash-map from
+ * predicates to sets with its copies of the predicates, and the set of
+ * each subject.
+ *
+ * @return size_t Number of bytes
+ */
+size_t CharacteristicSets::memory_usage() const {
+    size_t bytes = _sets.capacity() * sizeof(_Set) +
+                   _subject_sets.memory_usage() +
+                   utils::node_map_bytes(_ids);
+    for (const _Set& set : _sets) {
+        bytes += set.predicates.capacity() * sizeof(Resource) +
+                 set.triples.capacity() * sizeof(size_t);
+    }
+    for (auto& [predicates, id] : _ids)
+        bytes += predicates.capacity() * sizeof(Resource);
+    return bytes;
+}
+
+/**
+ * @brief Writes the characteristic sets to a snapshot
+ *
+ * Each set with subjects is written as its number of subjects and of
+ * predicates, followed by its predicates and then its number of triples
+ * with each of them. The set of each subject is not written.
+ *
+ * @param writer Snapshot being written
+ */
+void CharacteristicSets::save(SnapshotWriter& writer) const {
+    std::vector<uint64_t> encoded;
+    for (const _Set& set : _sets) {
+        if (set.subjects == 0) continue;
+        encoded.push_back(set.subjects);
+        encoded.push_back(set.predicates.size());
+        encoded.insert(encoded.end(), set.predicates.begin(),
+                       set.predicates.end());
+        encoded.insert(encoded.end(), set.triples.begin(), set.triples.end());
+    }
+    writer.write(CHARACTERISTIC_SETS, ArrayView<uint64_t>(encoded));
+}
+
+/**
+ * @brief Replaces the characteristic sets with those in a snapshot
+ *
+ * Reads the distinct sets, which are few compared to the subjects, in
+ * full. No subject's set is known afterwards, so the sets can be used for
+ * estimates and have subjects added with CharacteristicSets::add_subject,
+ * but no triples added to existing subjects.
+ *
+ * @param snapshot Snapshot to open
+ */
+void CharacteristicSets::open(const Snapshot& snapshot) {
+    auto encoded = snapshot.section<uint64_t>(CHARACTERISTIC_SETS, true);
+    clear();
+    size_t i = 0;
+    while (i < encoded.size()) {
+        if (encoded.size() - i < 2 ||
+            (encoded.size() - i - 2) / 2 < encoded[i+1])
+            throw std::invalid_argument("Snapshot index is corrupt");
+        size_t subjects = encoded[i], n = encoded[i+1];
+        i += 2;
+        std::vector<Resource> predicates(encoded.begin() + i,
+                                         encoded.begin() + i + n);
+        _Set& set = _sets[_find(predicates)];
+        set.subjects += subjects;
+        for (size_t k = 0; k < n; k++) set.triples[k] += encoded[i + n + k];
+        i += 2 * n;
+    }
+}
+
+/**
+ * @brief Helper function to get the identifier of a characteristic set,
+ *      creating it without any subjects if new
+ *
+ * @param predicates Predicates in the set, in ascending order
+ * @return _SetId Identifier of the set
+ */
+CharacteristicSets::_SetId CharacteristicSets::_find(
+        const std::vector<Resource>& predicates) {
+    auto [it, added] = _ids.try_emplace(predicates, _sets.size());
+    if (added) {
+        _sets.push_back(_Set{predicates, 0,
+                             std::vector<size_t>(predicates.size(), 0)});
+    }
+    return it->second;
+}
+
+/**
+ * @brief Helper function to add or remove a subject's counts to or from a
+ *      characteristic set
+ *
+ * @param id Identifier of the set
+ * @param counts Number of triples of the subject with each predicate of
+ *      the set
+ * @param sign 1 to add the subject, or -1 to remove it
+ */
+void CharacteristicSets::_update(_SetId id, const Counts& counts, int sign) {
+    _Set& set = _sets[id];
+    set.subjects += sign;
+    for (size_t k = 0; k < counts.size(); k++)
+        set.triples[k] += sign * (long long) counts[k].second;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file n_parallel_join.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (n)
+ *
+ * The morsel-driven parallel join engine used to evaluate queries on
+ * several threads.
+ * Full implementation of the ParallelJoin class.
+ */
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <BatchJoin.h>
+#include <LinkedIndex.h>
+#include <ParallelJoin.h>
+#include <PerfCounters.h>
+#include <PermutationIndex.h>
+#include <Query.h>
+#include <ThreadPool.h>
+#include <utils.h>
+
+/**
+ * @brief Prepares a parallel join of the patterns of a compiled query
+ *
+ * @param index Index to evaluate the patterns over
+ * @param query Compiled query to evaluate, without merge joins
+ * @param project Whether the selected variables must be output, as opposed
+ *      to just the number of rows
+ * @param pool Pool of threads to run the morsels on
+ */
+template <class Index>
+ParallelJoin<Index>::ParallelJoin(Index& index, const CompiledQuery& query,
+                                  bool project, ThreadPool& pool) :
+    _query(&query), _join(index, query, project), _project(project),
+    _pool(&pool), _produced(query.patterns.size(), 0) {}
+
+/**
+ * @brief Evaluates the query, passing the resulting rows on in batches
+ *
+ * The hash tables of hash joins are built before the threads start, and
+ * shared between them. Each thread copies the BatchJoin when it runs its
+ * first morsel. The sink is only called from the calling thread, once all
+ * morsels have finished; each batch holds the columns of the
+ * selected variables if requested when constructed, and is only valid
+ * during the call.
+ *
+ * @param sink Function to call with each nonempty batch of results
+ */
+template <class Index>
+void ParallelJoin<Index>::run(const std::function<void(const Batch&)>& sink) {
+    Batch rows;
+    auto scan_start = std::chrono::steady_clock::now();
+    uint64_t before[PerfCounters::EVENTS] = {};
+    if (_counters) _counters->read(before);
+    _join.scan(rows);
+    std::fill(_produced.begin(), _produced.end(), 0);
+    if (_profiling) {
+        // The first stage's work is all done reading its matches here
+        _profiles = _join.profiles();
+        _profiles[0].time += std::chrono::steady_clock::now() - scan_start;
+        if (_counters) {
+            uint64_t after[PerfCounters::EVENTS];
+            _counters->read(after);
+            for (int e = 0; e < PerfCounters::EVENTS; e++)
+                _profiles[0].events[e] += after[e] - before[e];
+        }
+    }
+    if (rows.size == 0) return;
+    _join.prepare();
+
+    // Split the rows into morsels, many per thread
+    size_t threads = _pool->size();
+    size_t size = std::clamp<size_t>(
+        rows.size / (threads * _MORSELS_PER_THREAD), 1, BATCH_SIZE);
+    size_t morsels = (rows.size + size - 1) / size;
+
+    std::vector<Batch> results(_project ? morsels : 0);
+    std::vector<size_t> counts(threads, 0);
+    std::vector<std::unique_ptr<BatchJoin<Index>>> joins(threads);
+    std::vector<std::unique_ptr<PerfCounters>> counters(threads);
+    _pool->run(morsels, threads, [&](size_t t, size_t m) {
+        if (!joins[t]) {
+            joins[t] = std::make_unique<BatchJoin<Index>>(_join);
+            if (_profiling) {
+                if (_counters) counters[t] = std::make_unique<PerfCounters>();
+                joins[t]->profile(counters[t] && counters[t]->available()
+                                  ? counters[t].get() : nullptr);
+            }
+        }
+        std::function<void(const Batch&)> collect = [&](const Batch& batch) {
+            counts[t] += batch.size;
+            if (!_project) return;
+            Batch& result = results[m];
+            result.columns.resize(batch.columns.size());
+            for (Slot slot : _query->projection) {
+                if (slot == NO_SLOT) continue;
+                result.columns[slot].insert(result.columns[slot].end(),
+                    batch.columns[slot].begin(),
+                    batch.columns[slot].begin() + batch.size);
+            }
+            result.size += batch.size;
+        };
+        joins[t]->run(rows, m * size, std::min(rows.size, (m+1) * size),
+                      collect);
+    });
+
+    for (size_t t = 0; t < threads; t++) {
+        if (!joins[t]) continue;
+        const std::vector<size_t>& produced = joins[t]->produced();
+        for (size_t i = 0; i < _produced.size(); i++)
+            _produced[i] += produced[i];
+        if (!_profiling) continue;
+        const std::vector<StageProfile>& profiles = joins[t]->profiles();
+        for (size_t i = 0; i < profiles.size(); i++) {
+            const StageProfile& work = profiles[i];
+            StageProfile& total = _profiles[i];
+            total.probes += work.probes;
+            total.matches += work.matches;
+            total.rejected += work.rejected;
+            total.time += work.time;
+            for (int e = 0; e < PerfCounters::EVENTS; e++)
+                total.events[e] += work.events[e];
+        }
+    }
+    if (_project) {
+        for (const Batch& result : results)
+            if (result.size > 0) sink(result);
+    } else {
+        Batch total;
+        for (size_t count : counts) total.size += count;
+        if (total.size > 0) sink(total);
+    }
+}
+
+/**
+ * @brief Gets the number of rows produced by each stage
+ *
+ * @return const std::vector<size_t>& Rows produced by the stage of each
+ *      pattern, over all threads
+ */
+template <class Index>
+const std::vector<size_t>& ParallelJoin<Index>::produced() const {
+    return _produced;
+}
+
+/**
+ * @brief Makes the next run profile the work of each stage
+ *
+ * The time and hardware events of each stage are summed over all threads.
+ * Building the hash tables before the threads start is only part of the
+ * total time of the join.
+ *
+ * @param counters Counters of the calling thread, or null to charge only
+ *      time; the other threads then open none either
+ */
+template <class Index>
+void ParallelJoin<Index>::profile(const PerfCounters* counters) {
+    _profiling = true;
+    _counters = counters;
+}
+
+template class ParallelJoin<LinkedIndex>;
+template class ParallelJoin<PermutationIndex>;
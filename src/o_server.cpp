@@ -0,0 +1,400 @@
+/**
+ * @file o_server.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (o)
+ *
+ * The local query server, serving many clients from one shared system.
+ * Full implementation of the Server class, and partial implementation of
+ * the System class.
+ */
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <MappedFile.h>
+#include <Server.h>
+#include <System.h>
+#include <utils.h>
+
+/**
+ * @brief Executes a single command of the command line interface
+ *
+ * @param command Command to execute
+ * @param details Rest of the command's input after its keyword
+ * @param out Stream to write the command's output to
+ * @param output_join_order Whether queries should print the join order and
+ *      join operators used
+ * @param deadline Time by which queries must finish
+ * @return bool False if the command was `QUIT`, true otherwise
+ * @throws std::invalid_argument If the command's input is invalid, in which
+ *      case nothing has been changed
+ * @throws std::runtime_error If a query does not finish by the deadline
+ */
+bool System::execute(Command command, std::string details, std::ostream& out,
+                     bool output_join_order, Deadline deadline) {
+    switch (command) {
+        case Command::LOAD: {
+            // Strip whitespace
+            std::stringstream ss(details);
+            std::string filename;
+            ss >> filename;
+
+            // Map file and stream triples from it
+            MappedFile file(filename);
+            try {
+                load_triples(file, out);
+            } catch (const std::invalid_argument& e) {
+                throw std::invalid_argument(std::string(e.what()) +
+                    "\nInput file processing terminated due to error. "
+                    "No triples from the file have been added.");
+            }
+            return true;
+        }
+        case Command::SELECT:
+            // Print enabled
+            evaluate_query(details, true, output_join_order, out, deadline);
+            return true;
+        case Command::COUNT:
+            // Print disabled
+            evaluate_query(details, false, output_join_order, out, deadline);
+            return true;
+        case Command::SAVE: {
+            std::stringstream ss(details);
+            std::string filename;
+            ss >> filename;
+            save_snapshot(filename, out);
+            return true;
+        }
+        case Command::OPEN: {
+            std::stringstream ss(details);
+            std::string filename, option;
+            ss >> filename >> option;
+            open_snapshot(filename, option == "VERIFY", out);
+            return true;
+        }
+        case Command::PREPARE:
+            prepare_query(details, out);
+            return true;
+        case Command::EXECUTE:
+            execute_query(details, output_join_order, out, deadline);
+            return true;
+        case Command::EXPLAIN:
+            explain_query(details, out, deadline);
+            return true;
+        case Command::MEMORY:
+            report_memory(details, out);
+            return true;
+        case Command::QUIT:
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Prepares a server for a system
+ *
+ * @param system System to execute the clients' commands on
+ * @param workers Number of connections to serve at once
+ * @param queue_limit Maximum number of connections waiting for a worker
+ * @param timeout Time allowed for each query, or zero for no limit
+ * @param idle_timeout Time after which a connection waiting for its client
+ *      is closed, or zero for no limit
+ * @param output_join_order Whether queries should print the join order and
+ *      join operators used
+ */
+Server::Server(System& system, int workers, size_t queue_limit,
+               std::chrono::milliseconds timeout,
+               std::chrono::milliseconds idle_timeout,
+               bool output_join_order) :
+    _system(system), _workers(std::max(1, workers)),
+    _queue_limit(std::max<size_t>(1, queue_limit)), _timeout(timeout),
+    _idle_timeout(idle_timeout), _output_join_order(output_join_order) {}
+
+/**
+ * @brief Serves clients forever
+ *
+ * Starts the worker threads, then accepts connections and queues them for
+ * the workers, turning them away if too many are already waiting.
+ *
+ * @param address Port number to listen on at `127.0.0.1`, or otherwise the
+ *      path of a Unix socket to create
+ * @throws std::invalid_argument If the address cannot be listened on
+ */
+void Server::serve(const std::string& address) {
+    int listener = _listen(address);
+    for (int t = 0; t < _workers; t++)
+        std::thread(&Server::_work, this).detach();
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (_waiting.size() < _queue_limit) {
+                _waiting.push_back(fd);
+                _ready.notify_one();
+                continue;
+            }
+        }
+        _send(fd, "BUSY 0\n");
+        close(fd);
+    }
+}
+
+/**
+ * @brief Connects to a server
+ *
+ * @param address Address the server listens on, as given to `serve()`
+ * @return int Socket of the connection, or -1 if it failed
+ */
+int Server::connect(const std::string& address) {
+    bool tcp = !address.empty() && std::all_of(address.begin(),
+        address.end(), [](unsigned char c) { return std::isdigit(c); });
+    int port = tcp ? _port(address) : 0;
+    if (tcp && port == 0) return -1;
+    int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int status;
+    if (tcp) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        status = ::connect(fd, (sockaddr*) &addr, sizeof(addr));
+    } else {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, address.c_str(),
+                     sizeof(addr.sun_path) - 1);
+        status = ::connect(fd, (sockaddr*) &addr, sizeof(addr));
+    }
+    if (status != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Sends a request to a server and waits for its response
+ *
+ * @param fd Socket of the connection to the server
+ * @param line Command to send, on a single line
+ * @param body Set to the body of the response
+ * @return std::string Status of the response, `OK`, `ERROR` or `BUSY`, or
+ *      empty if the connection failed
+ */
+std::string Server::request(int fd, const std::string& line,
+                            std::string& body) {
+    // A busy server may have answered and closed before the line is sent
+    std::string buffer, header;
+    _send(fd, line + "\n");
+    if (!_read_line(fd, buffer, header)) return "";
+    std::stringstream ss(header);
+    std::string status;
+    size_t length = 0;
+    ss >> status >> length;
+    body.swap(buffer);
+    char chunk[65536];
+    while (body.size() < length) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return "";
+        body.append(chunk, n);
+    }
+    body.resize(length);
+    return status;
+}
+
+/**
+ * @brief Helper function run by each worker thread, serving queued
+ *      connections one at a time
+ */
+void Server::_work() {
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _ready.wait(guard, [&] { return !_waiting.empty(); });
+            fd = _waiting.front();
+            _waiting.pop_front();
+        }
+        _serve_connection(fd);
+        close(fd);
+    }
+}
+
+/**
+ * @brief Helper function to answer the requests of one connection until
+ *      the client closes it, sends `QUIT` or stays idle for longer than
+ *      the idle timeout
+ *
+ * @param fd Socket of the connection
+ */
+void Server::_serve_connection(int fd) {
+    if (_idle_timeout.count() > 0) {
+        timeval limit{};
+        limit.tv_sec = _idle_timeout.count() / 1000;
+        limit.tv_usec = _idle_timeout.count() % 1000 * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+    }
+    std::string buffer, line;
+    bool ready = true;
+    while (ready && _read_line(fd, buffer, line)) {
+        if (!_send(fd, _respond(line, ready))) return;
+    }
+    if (buffer.size() > _MAX_LINE_BYTES)
+        _send(fd, "ERROR 18\nRequest too long.\n");
+}
+
+/**
+ * @brief Helper function to execute one request
+ *
+ * @param line Request line, holding a command
+ * @param ready Set to false if the command was `QUIT`
+ * @return std::string Response to send, with its header
+ */
+std::string Server::_respond(const std::string& line, bool& ready) {
+    // Split the keyword from the rest of the command, as the CLI does
+    size_t start = 0;
+    while (start < line.size() && std::isspace((unsigned char) line[start]))
+        start++;
+    size_t end = start;
+    while (end < line.size() && !std::isspace((unsigned char) line[end]))
+        end++;
+    auto it = which_command.find(line.substr(start, end - start));
+    if (it == which_command.end()) return "ERROR 17\nInvalid command.\n";
+
+    std::ostringstream out;
+    std::string status = "OK";
+    Deadline deadline = NO_DEADLINE;
+    if (_timeout.count() > 0)
+        deadline = std::chrono::steady_clock::now() + _timeout;
+    try {
+        ready = _system.execute(it->second, line.substr(end), out,
+                                _output_join_order, deadline);
+    } catch (const std::exception& e) {
+        // Drop any results printed before the error
+        status = "ERROR";
+        out.str("");
+        out << "Error: " << e.what() << std::endl;
+    }
+    std::string body = out.str();
+    return status + " " + std::to_string(body.size()) + "\n" + body;
+}
+
+/**
+ * @brief Helper function to create a listening socket
+ *
+ * @param address Port number to listen on at `127.0.0.1`, or otherwise the
+ *      path of a Unix socket to create, replacing any existing file
+ * @return int Listening socket
+ * @throws std::invalid_argument If the address cannot be listened on
+ */
+int Server::_listen(const std::string& address) {
+    bool tcp = !address.empty() && std::all_of(address.begin(),
+        address.end(), [](unsigned char c) { return std::isdigit(c); });
+    int port = tcp ? _port(address) : 0;
+    if (tcp && port == 0)
+        throw std::invalid_argument("Invalid port " + address +
+                                    ", expected 1 to 65535");
+    int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::invalid_argument("Could not create socket");
+    int status;
+    if (tcp) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        status = bind(fd, (sockaddr*) &addr, sizeof(addr));
+    } else {
+        sockaddr_un addr{};
+        if (address.size() >= sizeof(addr.sun_path)) {
+            close(fd);
+            throw std::invalid_argument("Socket path too long");
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, address.c_str(),
+                     sizeof(addr.sun_path) - 1);
+        unlink(address.c_str());
+        status = bind(fd, (sockaddr*) &addr, sizeof(addr));
+    }
+    if (status != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        throw std::invalid_argument("Could not listen on " + address);
+    }
+    return fd;
+}
+
+/**
+ * @brief Helper function to read a TCP port number
+ *
+ * @param address Address made up of digits only
+ * @return int Port number, or 0 if it is not a valid port
+ */
+int Server::_port(const std::string& address) {
+    unsigned long port;
+    try {
+        port = std::stoul(address);
+    } catch (const std::out_of_range&) {
+        return 0;
+    }
+    return port <= 65535 ? port : 0;
+}
+
+/**
+ * @brief Helper function to send the whole of a message
+ *
+ * @param fd Socket to send on
+ * @param message Message to send
+ * @return bool Whether all of it was sent
+ */
+bool Server::_send(int fd, const std::string& message) {
+    size_t sent = 0;
+    while (sent < message.size()) {
+        ssize_t n = send(fd, message.data() + sent, message.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Helper function to read the next line from a socket
+ *
+ * @param fd Socket to read from
+ * @param buffer Bytes read but not yet consumed, kept between calls
+ * @param line Set to the line read, without its line ending
+ * @return bool False if the socket closed before a whole line was read, or
+ *      if the line is too long
+ */
+bool Server::_read_line(int fd, std::string& buffer, std::string& line) {
+    size_t scanned = 0, end;
+    while ((end = buffer.find('\n', scanned)) == buffer.npos) {
+        if (buffer.size() > _MAX_LINE_BYTES) return false;
+        scanned = buffer.size();
+        char chunk[65536];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+    line.assign(buffer, 0, end);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    buffer.erase(0, end + 1);
+    return true;
+}
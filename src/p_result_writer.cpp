@@ -0,0 +1,72 @@
+/**
+ * @file p_result_writer.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (p)
+ *
+ * The buffered output of query results.
+ * Full implementation of the ResultWriter class.
+ */
+#include <chrono>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <BatchJoin.h>
+#include <Dictionary.h>
+#include <ResultWriter.h>
+#include <utils.h>
+
+/**
+ * @brief Prepares to write the results of a query
+ *
+ * @param out Stream to write to
+ * @param dictionary Dictionary to decode resources with
+ * @param projection Slots of the variables to print, in order
+ */
+ResultWriter::ResultWriter(std::ostream& out, const Dictionary& dictionary,
+                           const std::vector<Slot>& projection) :
+    _out(out), _dictionary(dictionary), _projection(projection) {
+    _buffer.reserve(_BUFFER_BYTES);
+}
+
+/**
+ * @brief Prints the bindings of the selected variables in each row of a
+ *      batch
+ *
+ * @param batch Rows of bindings, holding the columns of the selected slots
+ */
+void ResultWriter::write(const Batch& batch) {
+    if (batch.size == 0) return;
+    auto start = std::chrono::steady_clock::now();
+    for (Slot slot : _projection) {
+        if (slot == NO_SLOT)
+            throw std::invalid_argument("Map doesn't contain all variables");
+    }
+    for (size_t row = 0; row < batch.size; row++) {
+        for (Slot slot : _projection) {
+            Resource id = batch.columns[slot][row];
+            if (id < 0 || (size_t) id >= _dictionary.size())
+                throw std::invalid_argument("Resource ID does not exist");
+            _dictionary.decode_to(id, _buffer);
+            _buffer += '\t';
+        }
+        _buffer += '\n';
+        if (_buffer.size() >= _BUFFER_BYTES) {
+            _out.write(_buffer.data(), _buffer.size());
+            _buffer.clear();
+        }
+    }
+    _rows += batch.size;
+    _time += std::chrono::steady_clock::now() - start;
+}
+
+/**
+ * @brief Writes any buffered rows to the stream, and flushes it
+ */
+void ResultWriter::flush() {
+    auto start = std::chrono::steady_clock::now();
+    _out.write(_buffer.data(), _buffer.size());
+    _buffer.clear();
+    _out.flush();
+    _time += std::chrono::steady_clock::now() - start;
+}
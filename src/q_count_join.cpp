@@ -0,0 +1,287 @@
+/**
+ * @file q_count_join.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (q)
+ *
+ * The factorised counting engine used to evaluate `COUNT` queries.
+ * Full implementation of the CountJoin class.
+ */
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <BatchJoin.h>
+#include <CountJoin.h>
+#include <LinkedIndex.h>
+#include <PermutationIndex.h>
+#include <Query.h>
+#include <ThreadPool.h>
+#include <utils.h>
+
+/**
+ * @brief Prepares a count of the results of a compiled query
+ *
+ * Splits the patterns into the tree of components they are counted by.
+ *
+ * @param index Index to evaluate the patterns over
+ * @param query Compiled query to count the results of
+ * @param pool Pool of threads to count on, or null to count on the
+ *      calling thread only
+ */
+template <class Index>
+CountJoin<Index>::CountJoin(Index& index, const CompiledQuery& query,
+                            ThreadPool* pool) :
+    _index(&index), _query(&query), _pool(pool),
+    _row(query.slot_variables.size(), INVALID_RESOURCE),
+    _profiles(query.patterns.size()) {
+    std::vector<size_t> patterns(query.patterns.size());
+    std::iota(patterns.begin(), patterns.end(), 0);
+    _roots = _split(patterns,
+                    std::vector<bool>(query.slot_variables.size(), false));
+}
+
+/**
+ * @brief Counts the results of the query
+ *
+ * @return size_t Number of rows the join of the query's patterns produces
+ */
+template <class Index>
+size_t CountJoin<Index>::run() {
+    bool parallel = _pool && _pool->size() > 1;
+    size_t total = 1;
+    for (size_t root : _roots) {
+        total *= (parallel && !_components[root].parts.empty())
+                 ? _count_parallel(root) : _count(root);
+        if (total == 0) break;
+    }
+    return total;
+}
+
+/**
+ * @brief Helper function to split patterns into components connected
+ *      through unbound variables, adding each component and those it splits
+ *      into in turn
+ *
+ * @param patterns Positions of the patterns in the query, in plan order
+ * @param bound Whether each slot is bound outside the patterns
+ * @return std::vector<size_t> Positions of the new components
+ */
+template <class Index>
+std::vector<size_t> CountJoin<Index>::_split(
+        const std::vector<size_t>& patterns, const std::vector<bool>& bound) {
+    auto slots = [&](size_t i) {
+        auto [a,b,c] = _query->patterns[patterns[i]];
+        return std::vector<Slot>{a.slot, b.slot, c.slot}; };
+    auto connected = [&](size_t i, size_t j) {
+        for (Slot x : slots(i)) {
+            if (x == NO_SLOT || bound[x]) continue;
+            for (Slot y : slots(j)) if (x == y) return true;
+        }
+        return false; };
+
+    // Label each pattern with its component, in order of first pattern
+    std::vector<int> labels(patterns.size(), -1);
+    int components = 0;
+    for (size_t i = 0; i < patterns.size(); i++) {
+        if (labels[i] >= 0) continue;
+        std::vector<size_t> stack{i};
+        labels[i] = components;
+        while (!stack.empty()) {
+            size_t j = stack.back();
+            stack.pop_back();
+            for (size_t k = 0; k < patterns.size(); k++) {
+                if (labels[k] >= 0 || !connected(j, k)) continue;
+                labels[k] = components;
+                stack.push_back(k);
+            }
+        }
+        components++;
+    }
+
+    std::vector<size_t> ids;
+    for (int label = 0; label < components; label++) {
+        std::vector<size_t> members;
+        std::vector<Slot> inputs;
+        for (size_t i = 0; i < patterns.size(); i++) {
+            if (labels[i] != label) continue;
+            members.push_back(patterns[i]);
+            for (Slot slot : slots(i))
+                if (slot != NO_SLOT && bound[slot]) inputs.push_back(slot);
+        }
+        std::sort(inputs.begin(), inputs.end());
+        inputs.erase(std::unique(inputs.begin(), inputs.end()),
+                     inputs.end());
+
+        // The first pattern binds its variables for the rest
+        const SlotPattern& pattern = _query->patterns[members[0]];
+        auto [a,b,c] = pattern;
+        _Component component{pattern, members[0], {}, inputs, {},
+                             _Cursor(*_index), {}, {}};
+        std::vector<bool> next_bound(bound);
+        SlotTerm terms[] = {a, b, c};
+        for (int k = 0; k < 3; k++) {
+            component.bound[k] = terms[k].slot != NO_SLOT &&
+                                 bound[terms[k].slot];
+            if (terms[k].slot != NO_SLOT) next_bound[terms[k].slot] = true;
+        }
+        size_t id = _components.size();
+        _components.push_back(std::move(component));
+        ids.push_back(id);
+        if (members.size() > 1) {
+            members.erase(members.begin());
+            std::vector<size_t> parts = _split(members, next_bound);
+            _components[id].parts = parts;
+        }
+    }
+    return ids;
+}
+
+/**
+ * @brief Helper function to count the rows of a component under the
+ *      bindings so far
+ *
+ * @param c Position of the component
+ * @return size_t Number of rows the join of the component's patterns
+ *      produces
+ */
+template <class Index>
+size_t CountJoin<Index>::_count(size_t c) {
+    _Component& component = _components[c];
+    StageProfile& profile = _profiles[component.position];
+    auto [a,b,o] = _substitute(component);
+    if (component.parts.empty()) {
+        size_t count = _index->count(a, b, o);
+        profile.probes++;
+        profile.matches += count;
+        return count;
+    }
+
+    component.key.clear();
+    for (Slot slot : component.inputs) component.key.push_back(_row[slot]);
+    auto it = component.counts.find(component.key);
+    if (it != component.counts.end()) return it->second;
+
+    // Each match of the pattern contributes the product of the counts of
+    // the parts under its bindings
+    size_t total = 0;
+    component.cursor.open(a, b, o);
+    profile.probes++;
+    while (component.cursor.next(_row.data())) {
+        profile.matches++;
+        total += _count_parts(c);
+    }
+    if (component.counts.size() < _MAX_KEPT)
+        component.counts.emplace(component.key, total);
+    return total;
+}
+
+/**
+ * @brief Helper function to count the rows of a component binding none of
+ *      the variables bound outside it, on the pool's threads
+ *
+ * The matches of the component's pattern are read first, and then split
+ * into morsels, for each of which a thread sums the product of the counts
+ * of the parts under each match's bindings.
+ *
+ * @param c Position of the component, which must have parts
+ * @return size_t Number of rows the join of the component's patterns
+ *      produces
+ */
+template <class Index>
+size_t CountJoin<Index>::_count_parallel(size_t c) {
+    _Component& component = _components[c];
+    StageProfile& profile = _profiles[component.position];
+    auto [a,b,o] = _substitute(component);
+    std::vector<Slot> slots;
+    for (SlotTerm term : {a, b, o}) {
+        if (term.slot != NO_SLOT &&
+            std::find(slots.begin(), slots.end(), term.slot) == slots.end())
+            slots.push_back(term.slot);
+    }
+
+    // Read the bindings of every match, one after the other
+    std::vector<Resource> matches;
+    component.cursor.open(a, b, o);
+    profile.probes++;
+    while (component.cursor.next(_row.data())) {
+        profile.matches++;
+        if (++_steps % _CHECK_INTERVAL == 0) utils::check_deadline(_deadline);
+        for (Slot slot : slots) matches.push_back(_row[slot]);
+    }
+    size_t rows = matches.size() / slots.size();
+    if (rows == 0) return 0;
+
+    // Count the morsels, each thread with a CountJoin of its own
+    size_t threads = _pool->size();
+    size_t size = std::clamp<size_t>(
+        rows / (threads * _MORSELS_PER_THREAD), 1, BATCH_SIZE);
+    size_t morsels = (rows + size - 1) / size;
+    std::vector<std::unique_ptr<CountJoin>> joins(threads);
+    std::vector<size_t> totals(threads, 0);
+    _pool->run(morsels, threads, [&](size_t t, size_t m) {
+        if (!joins[t]) {
+            joins[t] = std::make_unique<CountJoin>(*_index, *_query);
+            joins[t]->set_deadline(_deadline);
+        }
+        CountJoin& join = *joins[t];
+        for (size_t i = m * size; i < std::min(rows, (m+1) * size); i++) {
+            for (size_t k = 0; k < slots.size(); k++)
+                join._row[slots[k]] = matches[i * slots.size() + k];
+            totals[t] += join._count_parts(c);
+        }
+    });
+
+    size_t total = 0;
+    for (size_t t = 0; t < threads; t++) {
+        total += totals[t];
+        if (!joins[t]) continue;
+        for (size_t i = 0; i < _profiles.size(); i++) {
+            _profiles[i].probes += joins[t]->_profiles[i].probes;
+            _profiles[i].matches += joins[t]->_profiles[i].matches;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Helper function to count the rows of the parts of a component
+ *      under the bindings so far
+ *
+ * @param c Position of the component, whose pattern's variables must all
+ *      be bound
+ * @return size_t Product of the counts of the component's parts
+ */
+template <class Index>
+size_t CountJoin<Index>::_count_parts(size_t c) {
+    if (++_steps % _CHECK_INTERVAL == 0) utils::check_deadline(_deadline);
+    size_t product = 1;
+    for (size_t part : _components[c].parts) {
+        product *= _count(part);
+        if (product == 0) break;
+    }
+    return product;
+}
+
+/**
+ * @brief Helper function to substitute the bindings so far into the
+ *      pattern of a component
+ *
+ * @param component Component whose pattern to substitute into
+ * @return SlotPattern The pattern, with its variables bound outside the
+ *      component replaced by their bindings
+ */
+template <class Index>
+SlotPattern CountJoin<Index>::_substitute(const _Component& component) const {
+    auto [a,b,c] = component.pattern;
+    SlotTerm terms[] = {a, b, c};
+    for (int k = 0; k < 3; k++) {
+        if (component.bound[k])
+            terms[k] = SlotTerm{NO_SLOT, _row[terms[k].slot]};
+    }
+    return std::make_tuple(terms[0], terms[1], terms[2]);
+}
+
+template class CountJoin<LinkedIndex>;
+template class CountJoin<PermutationIndex>;
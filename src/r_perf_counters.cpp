@@ -0,0 +1,86 @@
+/**
+ * @file r_perf_counters.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (r)
+ *
+ * The hardware performance counters used to profile queries.
+ * Full implementation of the PerfCounters class.
+ */
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <PerfCounters.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Opens and starts the counters for the calling thread
+ *
+ * Leaves them unavailable, with the reason kept, if the cycle counter
+ * cannot be opened.
+ */
+PerfCounters::PerfCounters() {
+    for (int e = 0; e < EVENTS; e++) _fds[e] = _positions[e] = -1;
+#ifdef __linux__
+    const uint64_t configs[] = {PERF_COUNT_HW_CPU_CYCLES,
+                                PERF_COUNT_HW_INSTRUCTIONS,
+                                PERF_COUNT_HW_CACHE_MISSES};
+    for (int e = 0; e < EVENTS; e++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[e];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = e == CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1,
+                          e == CYCLES ? -1 : _fds[CYCLES], 0);
+        if (_fds[e] < 0) {
+            if (e == CYCLES) {
+                _error = std::strerror(errno);
+                return;
+            }
+            continue;
+        }
+        _positions[e] = _open++;
+    }
+    ioctl(_fds[CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(_fds[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+    _error = "not supported on this system";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int e = 0; e < EVENTS; e++) if (_fds[e] >= 0) close(_fds[e]);
+#endif
+}
+
+/**
+ * @brief Reads the counts of the events since the counters were opened
+ *
+ * @param counts Set to the count of each event, by PerfCounters::Event;
+ *      all zero if the counters are unavailable
+ */
+void PerfCounters::read(uint64_t* counts) const {
+    for (int e = 0; e < EVENTS; e++) counts[e] = 0;
+#ifdef __linux__
+    if (!available()) return;
+    // Number of counters, then the count of each in the order opened
+    uint64_t values[1 + EVENTS];
+    ssize_t bytes = ::read(_fds[CYCLES], values, sizeof(values));
+    if (bytes < (ssize_t) sizeof(uint64_t)) return;
+    for (int e = 0; e < EVENTS; e++) {
+        if (_positions[e] >= 0 && (uint64_t) _positions[e] < values[0])
+            counts[e] = values[1 + _positions[e]];
+    }
+#endif
+}
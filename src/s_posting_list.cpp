@@ -0,0 +1,126 @@
+/**
+ * @file s_posting_list.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (s)
+ *
+ * Compressed lists of row positions and resources scanned by the index.
+ * Full implementation of the PostingList class.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <PostingList.h>
+
+/**
+ * @brief Compresses a list of integers
+ *
+ * The last block is padded with copies of the last value, which are never
+ * decoded.
+ *
+ * @param values Integers to store, in ascending order
+ */
+PostingList::PostingList(const std::vector<uint32_t>& values) :
+        _size(values.size()) {
+    for (size_t start = 0; start < _size; start += BLOCK) {
+        uint32_t base = values[start == 0 ? 0 : start - 1];
+        uint32_t deltas[BLOCK], block[BLOCK], largest = 0;
+        for (size_t i = 0; i < BLOCK; i++) {
+            block[i] = values[std::min(start + i, _size - 1)];
+            deltas[i] = block[i] - (i < _LANES ? base : block[i - _LANES]);
+            largest |= deltas[i];
+        }
+        uint8_t width = largest ? 32 - __builtin_clz(largest) : 0;
+        size_t offset = _words.size();
+        _blocks.push_back(_Block{base, offset, width});
+
+        // Lane `j` holds values `j`, `j + 4` and so on, packed into every
+        // fourth word from word `j` of the block
+        _words.resize(offset + _LANES * width);
+        uint32_t* words = &_words[offset];
+        for (size_t i = 0; i < BLOCK && width > 0; i++) {
+            size_t bit = i / _LANES * width, lane = i % _LANES;
+            size_t word = bit / 32, shift = bit % 32;
+            words[word * _LANES + lane] |= deltas[i] << shift;
+            if (shift + width > 32)
+                words[(word + 1) * _LANES + lane] |= deltas[i] >> (32-shift);
+        }
+    }
+}
+
+/**
+ * @brief Decodes one block of the list
+ *
+ * Unpacks and sums the differences of all four lanes at once where SSE2 is
+ * available.
+ *
+ * @param block Position of the block, less than `blocks()`
+ * @param out Set to the values of the block; must have space for BLOCK
+ *      values
+ * @return size_t Number of values in the block, BLOCK for all but the last
+ */
+size_t PostingList::decode(size_t block, uint32_t* out) const {
+    const _Block& header = _blocks[block];
+    size_t count = std::min(BLOCK, _size - block * BLOCK);
+    uint32_t width = header.width;
+    if (width == 0) {
+        std::fill(out, out + BLOCK, header.base);
+        return count;
+    }
+    const uint32_t* words = &_words[header.offset];
+    uint32_t mask = width == 32 ? UINT32_MAX : (1u << width) - 1;
+#ifdef __SSE2__
+    const __m128i* in = (const __m128i*) words;
+    __m128i lanes = _mm_set1_epi32(header.base);
+    __m128i masks = _mm_set1_epi32(mask);
+    __m128i current = _mm_loadu_si128(in);
+    // Bits of the current word of each lane already unpacked
+    uint32_t used = 0;
+    size_t word = 0;
+    for (size_t i = 0; i < BLOCK; i += _LANES) {
+        __m128i deltas = _mm_srl_epi32(current, _mm_cvtsi32_si128(used));
+        used += width;
+        if (used >= 32) {
+            used -= 32;
+            if (++word < width) {
+                current = _mm_loadu_si128(in + word);
+                if (used > 0) {
+                    deltas = _mm_or_si128(deltas, _mm_sll_epi32(
+                        current, _mm_cvtsi32_si128(width - used)));
+                }
+            }
+        }
+        lanes = _mm_add_epi32(lanes, _mm_and_si128(deltas, masks));
+        _mm_storeu_si128((__m128i*) (out + i), lanes);
+    }
+#else
+    for (size_t lane = 0; lane < _LANES; lane++) {
+        uint32_t sum = header.base;
+        for (size_t i = lane; i < BLOCK; i += _LANES) {
+            size_t bit = i / _LANES * width;
+            size_t word = bit / 32, shift = bit % 32;
+            uint32_t delta = words[word * _LANES + lane] >> shift;
+            if (shift + width > 32)
+                delta |= words[(word + 1) * _LANES + lane] << (32 - shift);
+            sum += delta & mask;
+            out[i] = sum;
+        }
+    }
+#endif
+    return count;
+}
+
+/**
+ * @brief Decodes the whole list
+ *
+ * @return std::vector<uint32_t> Values of the list, in ascending order
+ */
+std::vector<uint32_t> PostingList::values() const {
+    std::vector<uint32_t> values(blocks() * BLOCK);
+    for (size_t block = 0; block < blocks(); block++)
+        decode(block, &values[block * BLOCK]);
+    values.resize(_size);
+    return values;
+}
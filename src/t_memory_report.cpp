@@ -0,0 +1,114 @@
+/**
+ * @file t_memory_report.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (t)
+ *
+ * The memory accounting behind the `MEMORY` command.
+ * Implementation of System::report_memory and its helpers.
+ */
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <System.h>
+#include <utils.h>
+
+/**
+ * @brief Helper function to get the resident set size of the process
+ *
+ * Both figures are read from the same snapshot of `/proc/self/status`, so
+ * the peak is never below the current size.
+ *
+ * @param peak Set to the peak resident set size so far, in bytes, or 0 if
+ *      unknown
+ * @return size_t Current resident set size in bytes, or 0 if unknown
+ */
+static size_t resident_bytes(size_t& peak) {
+    size_t resident = 0;
+    peak = 0;
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        std::stringstream ss(line);
+        std::string field;
+        size_t kilobytes = 0;
+        ss >> field >> kilobytes;
+        if (field == "VmRSS:") resident = kilobytes * 1024;
+        else if (field == "VmHWM:") peak = kilobytes * 1024;
+    }
+    return resident;
+}
+
+/**
+ * @brief Prints the memory held by each structure of the current version
+ *      of the store
+ *
+ * Each structure's bytes are those its containers have allocated,
+ * including spare capacity and empty hash-map slots, and those used in
+ * place from a mapped snapshot file are shown apart. Earlier versions
+ * still read by running queries, the plan cache and allocator overheads
+ * are not included, and make up the rest of the resident set size.
+ *
+ * @param details Empty for a table, or `JSON` for a single JSON object with
+ *      the same figures
+ * @param out Stream to print to
+ */
+void System::report_memory(std::string details, std::ostream& out) {
+    std::stringstream ss(details);
+    std::string format;
+    ss >> format;
+    if (!format.empty() && format != "JSON")
+        throw std::invalid_argument("Expected MEMORY or MEMORY JSON");
+
+    std::shared_ptr<const _Version> version = std::atomic_load(&_version);
+    std::vector<MemoryUsage> usage;
+    version->index->report_memory(usage);
+    version->dictionary.report_memory(usage);
+    size_t bytes = 0, mapped_bytes = 0;
+    for (const MemoryUsage& structure : usage) {
+        bytes += structure.bytes;
+        mapped_bytes += structure.mapped_bytes;
+    }
+    size_t triples = version->index->statistics().triples;
+    double per_triple = triples ? (double) (bytes + mapped_bytes) / triples
+                                : 0;
+    size_t peak = 0, resident = resident_bytes(peak);
+
+    // Formatted apart so the stream's own flags are left unchanged
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1);
+    if (format == "JSON") {
+        line << "{\"structures\": [";
+        for (size_t k = 0; k < usage.size(); k++) {
+            line << (k ? ", " : "") << "{\"name\": \"" << usage[k].name
+                 << "\", \"entries\": " << usage[k].entries
+                 << ", \"bytes\": " << usage[k].bytes
+                 << ", \"mapped_bytes\": " << usage[k].mapped_bytes << "}";
+        }
+        line << "], \"triples\": " << triples << ", \"bytes\": " << bytes
+             << ", \"mapped_bytes\": " << mapped_bytes
+             << ", \"bytes_per_triple\": " << per_triple
+             << ", \"resident_bytes\": " << resident
+             << ", \"peak_resident_bytes\": " << peak << "}";
+        out << line.str() << std::endl;
+        return;
+    }
+    line << std::left << std::setw(28) << "Structure" << std::right
+         << std::setw(12) << "Entries" << std::setw(14) << "Bytes"
+         << std::setw(14) << "Mapped" << "\n";
+    for (const MemoryUsage& structure : usage) {
+        line << std::left << std::setw(28) << structure.name << std::right
+             << std::setw(12) << structure.entries
+             << std::setw(14) << structure.bytes
+             << std::setw(14) << structure.mapped_bytes << "\n";
+    }
+    line << "Total: " << bytes << " bytes allocated and " << mapped_bytes
+         << " mapped for " << triples << " triples, " << per_triple
+         << " bytes per triple.\n"
+         << "Resident set: " << resident / 1048576.0 << " MB, peak "
+         << peak / 1048576.0 << " MB.";
+    out << line.str() << std::endl;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file u_thread_pool.cpp
+ * @author Candidate 1034792
+ * @brief Implementation component (u)
+ *
+ * The pool of worker threads that queries are evaluated on.
+ * Full implementation of the ThreadPool class.
+ */
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <ThreadPool.h>
+
+/**
+ * @brief Starts the worker threads
+ *
+ * @param threads Number of threads a job can run on, counting the thread
+ *      submitting it; one fewer workers are started
+ */
+ThreadPool::ThreadPool(int threads) {
+    for (int t = 1; t < threads; t++)
+        _workers.emplace_back(&ThreadPool::_work, this);
+}
+
+/**
+ * @brief Stops the worker threads once they finish their current jobs
+ */
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stopping = true;
+        _submitted.notify_all();
+    }
+    for (std::thread& worker : _workers) worker.join();
+}
+
+/**
+ * @brief Runs a job, returning once all its tasks have finished
+ *
+ * The calling thread takes part in the job as thread 0, and idle workers
+ * join it as threads 1 onwards. If any task throws, the others still run,
+ * and the first exception is rethrown once all have finished.
+ *
+ * @param tasks Number of tasks
+ * @param threads Maximum number of threads to run the tasks on, counting
+ *      the calling thread
+ * @param task Function to call with the number of the thread and the
+ *      index of each task
+ */
+void ThreadPool::run(size_t tasks, int threads, const Task& task) {
+    if (tasks == 0) return;
+    size_t width = std::min<size_t>(tasks, std::clamp(threads, 1, size()));
+    _Job job;
+    job.task = &task;
+    job.queues = std::vector<_Queue>(width);
+    for (size_t t = 0; t < width; t++) {
+        job.queues[t].front = tasks * t / width;
+        job.queues[t].back = tasks * (t+1) / width;
+    }
+    job.joined = 1;
+    if (width > 1) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _jobs.push_back(&job);
+        _submitted.notify_all();
+    }
+    std::exception_ptr error = _take_part(job, 0);
+
+    // No more workers may join once this thread has finished its part, as
+    // no tasks are left then
+    std::unique_lock<std::mutex> lock(_lock);
+    auto it = std::find(_jobs.begin(), _jobs.end(), &job);
+    if (it != _jobs.end()) _jobs.erase(it);
+    _finished.wait(lock, [&]() { return job.finished == job.joined - 1; });
+    if (error) std::rethrow_exception(error);
+    if (job.error) std::rethrow_exception(job.error);
+}
+
+/**
+ * @brief Helper function run by each worker thread, taking part in jobs
+ *      until the pool is destroyed
+ */
+void ThreadPool::_work() {
+    std::unique_lock<std::mutex> lock(_lock);
+    while (true) {
+        _submitted.wait(lock, [&]() { return _stopping || !_jobs.empty(); });
+        if (_stopping) return;
+        _Job& job = *_jobs.front();
+        size_t t = job.joined++;
+        if (job.joined == job.queues.size()) _jobs.pop_front();
+        lock.unlock();
+        std::exception_ptr error = _take_part(job, t);
+        lock.lock();
+        if (error && !job.error) job.error = error;
+        job.finished++;
+        _finished.notify_all();
+    }
+}
+
+/**
+ * @brief Helper function to run tasks of a job until none are left
+ *
+ * @param job Job to take part in
+ * @param t Number of the calling thread within the job
+ * @return std::exception_ptr First exception thrown by the tasks run, if
+ *      any
+ */
+std::exception_ptr ThreadPool::_take_part(_Job& job, size_t t) {
+    std::exception_ptr error;
+    size_t i;
+    while (_next(job, t, i)) {
+        try { (*job.task)(t, i); }
+        catch (...) { if (!error) error = std::current_exception(); }
+    }
+    return error;
+}
+
+/**
+ * @brief Helper function to take the next task of a job for a thread
+ *
+ * Takes the first task left in the thread's own queue, or failing that
+ * steals the last task left in the queue of another thread.
+ *
+ * @param job Job to take a task of
+ * @param t Number of the thread within the job
+ * @param task Set to the index of the task taken
+ * @return bool Whether a task was taken, false once none are left
+ */
+bool ThreadPool::_next(_Job& job, size_t t, size_t& task) {
+    for (size_t k = 0; k < job.queues.size(); k++) {
+        _Queue& queue = job.queues[(t + k) % job.queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.front == queue.back) continue;
+        task = (k == 0) ? queue.front++ : --queue.back;
+        return true;
+    }
+    return false;
+}
@@ -3,27 +3,14 @@
  * @author Candidate 1034792
  * @brief Provides utility functions for the various implementation components
  */
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 #include <utils.h>
 
-/**
- * @brief Applies a variable map to a term
- * 
- * Leaves the term unchanged unless the term is a variable contained in the map.
- * 
- * @param map 
- * @param term 
- * @return Term 
- */
-Term utils::apply_map(VariableMap map, Term term) {
-    if (term.index() == 1) return term;
-    else {
-        Variable var = std::get<Variable>(term);
-        if (map.count(var) == 0) return term;
-        else return Term{map.at(var)};
-    }
-}
-
 /**
  * @brief Gets the type of a triple pattern
  * 
@@ -41,6 +28,23 @@ PatternType utils::get_pattern_type(TriplePattern pattern) {
     }
 }
 
+/**
+ * @brief Gets the type of a triple pattern whose variables are slots
+ * 
+ * @param pattern 
+ * @return PatternType 
+ */
+PatternType utils::get_pattern_type(SlotPattern pattern) {
+    auto [a,b,c] = pattern;
+    if (a.slot != NO_SLOT) {
+        if (b.slot != NO_SLOT) return (c.slot != NO_SLOT) ? XYZ : XYO;
+        else return (c.slot != NO_SLOT) ? XPZ : XPO;
+    } else {
+        if (b.slot != NO_SLOT) return (c.slot != NO_SLOT) ? SYZ : SYO;
+        else return (c.slot != NO_SLOT) ? SPZ : SPO;
+    }
+}
+
 /**
  * @brief Gets the set of variables mentioned in a triple pattern
  * 
@@ -78,4 +82,47 @@ std::unordered_set<T> utils::intersect(std::unordered_set<T> set1,
 
 // Explicit instantiation necessary for separate template declaration
 template std::unordered_set<Variable> utils::intersect(
-    std::unordered_set<Variable>, std::unordered_set<Variable>);
\ No newline at end of file
+    std::unordered_set<Variable>, std::unordered_set<Variable>);
+/**
+ * @brief Runs a function on each of the indices 0 to n-1 using several threads
+ * 
+ * Indices are handed out to the threads one at a time as they become free.
+ * If any call throws, the first exception is rethrown once all threads have
+ * finished.
+ * 
+ * @param n Number of indices
+ * @param threads Maximum number of threads to use
+ * @param f Function to call on each index
+ */
+void utils::parallel_for(size_t n, int threads,
+                         std::function<void(size_t)> f) {
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::atomic_flag error_set = ATOMIC_FLAG_INIT;
+    auto work = [&]() {
+        for (size_t i; (i = next++) < n;) {
+            try { f(i); }
+            catch (...) {
+                if (!error_set.test_and_set()) error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads && (size_t) t < n; t++) pool.emplace_back(work);
+    work();
+    for (std::thread& thread : pool) thread.join();
+    if (error) std::rethrow_exception(error);
+}
+
+/**
+ * @brief Abandons a query if its deadline has passed
+ * 
+ * Called periodically by the join engines while evaluating a query.
+ * 
+ * @param deadline Time by which the query must finish, or NO_DEADLINE
+ */
+void utils::check_deadline(Deadline deadline) {
+    if (deadline != NO_DEADLINE &&
+        std::chrono::steady_clock::now() > deadline)
+        throw std::runtime_error("Query timed out");
+}
@@ -0,0 +1,157 @@
+/**
+ * @file corpus_test.cpp
+ * @author Candidate 1034792
+ * @brief Differential test of the store's options over a query corpus
+ *
+ * Generates a few files of benchmark data into a temporary directory, runs
+ * the same corpus of commands through the store once with its default
+ * options and once with the options under test, and checks that every
+ * command gives the same response. Timings are ignored, as is the order of
+ * the lines of a response, since neither is fixed across options.
+ *
+ * Usage: `corpus-test [store] [corpus] [options]`, where the store is the
+ * path of the `my-RDF-store` executable and the corpus a file of commands,
+ * one per line, which are run from the temporary directory.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <DataGenerator.h>
+
+/**
+ * @brief Writes the triples of the benchmark data generator to a file
+ *
+ * @param filename Name of the file to write
+ * @param scale Number of universities to generate
+ * @param seed Seed of the generator
+ */
+static void write_data(const std::string& filename, int scale,
+                       unsigned seed) {
+    std::ofstream out(filename);
+    DataGenerator(scale, seed).generate([&](const std::string& s,
+                                            const std::string& p,
+                                            const std::string& o) {
+        out << s << ' ' << p << ' ' << o << " .\n"; });
+}
+
+/**
+ * @brief Gets the absolute path of an existing file
+ *
+ * @param path Path of the file, relative to the working directory or
+ *      absolute
+ * @return std::string Absolute path of the file, or empty if it does not
+ *      exist
+ */
+static std::string absolute(const char* path) {
+    char* resolved = realpath(path, nullptr);
+    if (resolved == nullptr) return "";
+    std::string result = resolved;
+    free(resolved);
+    return result;
+}
+
+/**
+ * @brief Runs the corpus through the store and splits the output into the
+ *      response to each command
+ *
+ * @param command Shell command running the store on the corpus
+ * @return std::vector<std::string> Response to each command, with timings
+ *      removed and its lines sorted
+ */
+static std::vector<std::string> run(const std::string& command) {
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) return {};
+    std::string output;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+        output.append(buffer, read);
+    pclose(pipe);
+
+    static const std::regex timing("[0-9.]+ ms.*");
+    // Each response follows the prompt for its command
+    std::vector<std::string> responses;
+    size_t start = output.compare(0, 2, "> ") == 0 ? 2 : 0;
+    while (true) {
+        size_t end = output.find("> ", start);
+        if (end == std::string::npos) end = output.size();
+        std::vector<std::string> lines;
+        size_t line_start = start;
+        while (line_start < end) {
+            size_t line_end = std::min(output.find('\n', line_start), end);
+            lines.push_back(std::regex_replace(
+                output.substr(line_start, line_end - line_start), timing,
+                "ms"));
+            line_start = line_end + 1;
+        }
+        std::sort(lines.begin(), lines.end());
+        std::string response;
+        for (const std::string& line : lines) response += line + "\n";
+        responses.push_back(response);
+        if (end == output.size()) break;
+        start = end + 2;
+    }
+    return responses;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        std::cout << "Usage: " << argv[0] << " [store] [corpus] [options]"
+                  << std::endl;
+        return 1;
+    }
+    // Commands are run from the temporary directory, so both files are
+    // referred to by their absolute paths
+    std::string store = absolute(argv[1]), corpus_file = absolute(argv[2]);
+    if (store.empty() || corpus_file.empty()) {
+        std::cout << "Store or corpus not found" << std::endl;
+        return 1;
+    }
+    char directory[] = "/tmp/corpus-test.XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::cout << "Failed to create a temporary directory" << std::endl;
+        return 1;
+    }
+    std::string dir = directory;
+    // Each file overlaps those before it. The linked index is rebuilt for
+    // the first three, which are as large as the store when loaded, and
+    // the last two are added to the versions before them row by row
+    write_data(dir + "/corpus_1.nt", 1, 1);
+    write_data(dir + "/corpus_2.nt", 1, 2);
+    write_data(dir + "/corpus_3.nt", 2, 3);
+    write_data(dir + "/corpus_4.nt", 1, 4);
+    write_data(dir + "/corpus_5.nt", 1, 5);
+
+    std::string prefix = "cd '" + dir + "' && '" + store + "' ";
+    std::string suffix = " < '" + corpus_file + "' 2>&1";
+    std::vector<std::string> expected = run(prefix + suffix);
+    std::vector<std::string> actual = run(prefix + argv[3] + suffix);
+    std::system(("rm -rf '" + dir + "'").c_str());
+
+    std::vector<std::string> commands;
+    std::ifstream corpus(corpus_file);
+    for (std::string line; std::getline(corpus, line);)
+        commands.push_back(line);
+
+    if (expected.size() < commands.size()) {
+        std::cout << "Only " << expected.size() << " responses to "
+                  << commands.size() << " commands" << std::endl;
+        return 1;
+    }
+    for (size_t k = 0; k < expected.size(); k++) {
+        if (k < actual.size() && actual[k] == expected[k]) continue;
+        std::cout << "Different response to command " << k + 1 << ": "
+                  << (k < commands.size() ? commands[k] : "") << "\n"
+                  << "Expected:\n" << expected[k] << "Actual:\n"
+                  << (k < actual.size() ? actual[k] : "") << std::endl;
+        return 1;
+    }
+    std::cout << expected.size() << " responses match" << std::endl;
+    return 0;
+}